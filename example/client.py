@@ -10,6 +10,9 @@ try:
 
     c.callbacks.ping_event(
         lambda tick: print('ping - tick: {}'.format(tick)))
+    c.callbacks.server_state(
+        lambda started, tick: print('state - started: {}, tick: {}'.format(
+            started, tick)))
 
     # We can't use directly c.ping() since it's already
     # defined for ws4py.client.threadedclient.WebSocketClient
@@ -38,6 +41,14 @@ try:
         print('{0} "{2}" {1} = {3}'.format(16 * i, 5 + i,
                                            ops[i % 4], c.calculate2(16 * i, 5 + i, ops[i % 4])))
 
+    squares = c.squares(5000)
+    print('squares(5000) response: {} items, last: {}'.format(
+        len(squares), squares[-1]))
+
+    # Per-connection counter kept in the session
+    c.count_calls()
+    print('count_calls response: {}'.format(c.count_calls()))
+
     # Wrong function
     c.calclate()
 
@@ -1,13 +1,20 @@
+#include "wspc/notification_batch_handler.hpp"
+#include "wspc/replay.hpp"
 #include "wspc/service.hpp"
+#include "wspc/single_flight_handler.hpp"
+#include "wspc/streaming_handler.hpp"
 #include "wspc/typed_service_handler.hpp"
 
 #include <kl/ctti.hpp>
 #include <kl/enum_reflector.hpp>
 #include <kl/enum_traits.hpp>
 
+#include <boost/asio/signal_set.hpp>
 #include <boost/optional.hpp>
 #include <boost/optional/optional_io.hpp>
 
+#include <atomic>
+#include <csignal>
 #include <thread>
 #include <string>
 #include <iostream>
@@ -81,7 +88,16 @@ KL_DEFINE_REFLECTABLE(ping_event, (
     tick
 ))
 
-int main()
+struct server_state
+{
+    unsigned started;
+    unsigned tick;
+};
+KL_DEFINE_REFLECTABLE(server_state, (
+    started, tick
+))
+
+int main(int argc, char* argv[])
 {
     wspc::service service;
 
@@ -119,7 +135,16 @@ int main()
             std::cout << "Got notificiation: " << param << '\n';
         }));
 
-    // Register handler without any parameters
+    // Register handler taking all 'report' notifications at hand in one go
+    service.register_handler(
+        "report",
+        wspc::make_notification_batch_handler(
+            [&](const std::vector<std::tuple<int>>& reports) {
+                std::cout << "Got " << reports.size() << " reports\n";
+            }));
+
+    // Register handler without any parameters. Pings are served ahead of
+    // other requests waiting in the queue.
     service.register_handler(
         "ping", 
         wspc::make_service_handler([&] {
@@ -129,7 +154,8 @@ int main()
                 duration_cast<seconds>(steady_clock::now().time_since_epoch())
                     .count());
             return tick;
-        }));
+        }),
+        wspc::handler_priority::high);
 
     service.register_handler(
         "ping2",
@@ -142,47 +168,122 @@ int main()
             return pong_response{"pong"s, tick};
         }));
 
+    // Per-connection state lives in the session, no locking needed
+    struct call_counter
+    {
+        unsigned calls{0};
+    };
+    service.register_handler(
+        "count_calls",
+        wspc::make_service_handler([](wspc::session& session) {
+            return ++session.get<call_counter>().calls;
+        }));
+
+    // Identical requests arriving while one is still being calculated share
+    // its result
     service.register_handler(
         "calculate",
-        wspc::make_service_handler([](const work_request& work) {
-            std::cout << "calculate(" << work.arg1 << ", " << work.arg2
-                      << ", op: "
-                      << kl::enum_reflector<operation>::to_string(work.op)
-                      << "), comment: " << work.comment << '\n';
+        wspc::make_single_flight_handler(
+            wspc::make_service_handler([](const work_request& work) {
+                std::cout << "calculate(" << work.arg1 << ", " << work.arg2
+                          << ", op: "
+                          << kl::enum_reflector<operation>::to_string(work.op)
+                          << "), comment: " << work.comment << '\n';
 
-            const auto ret = [&] {
-                switch (work.op)
-                {
-                case operation::add:
-                    return work.arg1 + work.arg2;
-                case operation::subtract:
-                    return work.arg1 - work.arg2;
-                case operation::multiply:
-                    return work.arg1 * work.arg2;
-                case operation::divide:
-                    return work.arg1 / work.arg2;
-                }
-                throw std::logic_error{"internal error"};
-            }();
+                const auto ret = [&] {
+                    switch (work.op)
+                    {
+                    case operation::add:
+                        return work.arg1 + work.arg2;
+                    case operation::subtract:
+                        return work.arg1 - work.arg2;
+                    case operation::multiply:
+                        return work.arg1 * work.arg2;
+                    case operation::divide:
+                        return work.arg1 / work.arg2;
+                    }
+                    throw std::logic_error{"internal error"};
+                }();
 
-            std::cout << "result: " << ret << std::endl;
+                std::cout << "result: " << ret << std::endl;
 
-            return work_response{ret};
-        }));
+                return work_response{ret};
+            })));
+
+    // Results are sent in chunks of 1000 numbers as they're calculated
+    service.register_handler(
+        "squares",
+        wspc::make_streaming_handler(
+            [](unsigned count) {
+                unsigned i = 0;
+                return [count, i]() mutable -> boost::optional<unsigned> {
+                    if (i == count)
+                        return boost::none;
+                    ++i;
+                    return i * i;
+                };
+            },
+            1000));
 
     service.register_event<ping_event>();
+    service.register_state<server_state>();
+    // Let reconnecting clients catch up on last 1024 events
+    service.enable_event_log(1024);
+    // Events broadcast within 5ms are sent together in one frame
+    service.enable_broadcast_batching(std::chrono::milliseconds{5}, 64);
+    // Ping clients silent for 30s, drop them if there's no pong within 10s
+    service.enable_keepalive(std::chrono::seconds{30},
+                             std::chrono::seconds{10},
+                             std::chrono::steady_clock::duration::zero());
+    // No client is going to hold more than 16 MiB of server's memory
+    service.limit_connections(1024 * 1024, 16 * 1024 * 1024);
+
+    // --capture <file> records all incoming messages, --replay <file> feeds
+    // recorded messages straight into the service (no networking involved)
+    if (argc == 3 && argv[1] == std::string{"--replay"})
+    {
+        std::cout << wspc::replay(service, argv[2]) << std::endl;
+        return 0;
+    }
+    if (argc == 3 && argv[1] == std::string{"--capture"})
+        service.capture(argv[2]);
+
+    // Another instance can be started on the same port before this one is
+    // stopped (where SO_REUSEPORT is available). On SIGTERM clients are moved
+    // over to it within 10 seconds.
+#if defined(SO_REUSEPORT)
+    service.accept(9001, true);
+#else
+    service.accept(9001, false);
+#endif
+    std::atomic<bool> running{true};
+    boost::asio::signal_set signals{service.get_io_service(), SIGTERM};
+    signals.async_wait([&](const boost::system::error_code& ec, int) {
+        if (ec)
+            return;
+        service.drain(std::chrono::seconds{10}, [&] {
+            running = false;
+            service.get_io_service().stop();
+        });
+    });
 
     std::thread th{[&] {
-        while (true)
-        {
-            using namespace std::chrono;
+        using namespace std::chrono;
+
+        const auto started = static_cast<unsigned>(
+            duration_cast<seconds>(steady_clock::now().time_since_epoch())
+            .count());
 
+        while (running)
+        {
             std::this_thread::sleep_for(seconds{3});
 
             auto tick = static_cast<unsigned>(
                 duration_cast<seconds>(steady_clock::now().time_since_epoch())
                 .count());
             service.broadcast(ping_event{tick});
+            // Only 'tick' is sent after the first time
+            service.publish_state(server_state{started, tick});
         }
     }};
 
@@ -58,15 +58,31 @@ class MessageValidator:
                not 'error' in msg and \
                'id' in msg
 
+    @staticmethod
+    def is_partial(msg):
+        return 'partial' in msg and 'id' in msg
+
     @staticmethod
     def is_notif(msg):
         return 'method' in msg and 'params' in msg
 
+    @staticmethod
+    def is_patch(msg):
+        return 'method' in msg and 'patch' in msg
+
 
 class Client(WebSocketClient):
     def __init__(self, address):
         super(Client, self).__init__(address)
         self.event_registry = EventRegistry()
+        # Last known value of every state topic
+        self.states = {}
+        # Epoch and sequence number of the last received event, if service
+        # numbers them (both are needed to call 'resume')
+        self.epoch = None
+        self.last_seq = None
+        # Items received so far from streaming procedures
+        self.partials = {}
         self.req_id = []
         self.queue = Queue(1)
         self.connect()
@@ -76,23 +92,43 @@ class Client(WebSocketClient):
 
     def received_message(self, m):
         try:
-            resp = json.loads(str(m))
-            if MessageValidator.is_err(resp):
-                raise Exception(resp['error'])
-            if MessageValidator.is_response(resp):
-                # Is this response on our list of pending ones?
-                if int(resp['id']) in self.req_id:
-                    # Put the response dict onto the queue
-                    # and remove its ID from pending list
-                    self.queue.put(resp['result'])
-                    self.req_id.remove(int(resp['id']))
-            elif MessageValidator.is_notif(resp):
-                # Notify of inbound event from the server
-                self._event_received(resp['method'], resp['params'])
+            msg = json.loads(str(m))
+            # Batched events (or responses to a batch) come as an array
+            for resp in msg if isinstance(msg, list) else [msg]:
+                self._process_message(resp)
         except Exception as e:
             print('Invalid response:', str(m), e)
             self.queue.put(e)
 
+    def _process_message(self, resp):
+        if 'seq' in resp:
+            self.epoch = resp.get('epoch')
+            self.last_seq = resp['seq']
+        if MessageValidator.is_err(resp):
+            raise Exception(resp['error'])
+        if MessageValidator.is_partial(resp):
+            self.partials.setdefault(int(resp['id']), []).extend(
+                resp['partial'])
+        elif MessageValidator.is_response(resp):
+            # Is this response on our list of pending ones?
+            if int(resp['id']) in self.req_id:
+                # Put the response dict onto the queue
+                # and remove its ID from pending list. Streamed
+                # result is returned as a list of all items.
+                result = self.partials.pop(int(resp['id']),
+                                           resp['result'])
+                self.queue.put(result)
+                self.req_id.remove(int(resp['id']))
+        elif MessageValidator.is_notif(resp):
+            # Notify of inbound event from the server
+            self.states[resp['method']] = resp['params']
+            self._event_received(resp['method'], resp['params'])
+        elif MessageValidator.is_patch(resp):
+            # Apply changed fields to the last known state
+            state = self.states.setdefault(resp['method'], {})
+            state.update(resp['patch'])
+            self._event_received(resp['method'], dict(state))
+
     def closed(self, code, reason=None):
         print('Closed down: {}, {}'.format(code, reason))
         self.queue.put(None)
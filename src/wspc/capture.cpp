@@ -0,0 +1,158 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/capture.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+namespace wspc {
+
+namespace {
+
+// First version had no header after magic, numbers were in host byte order
+constexpr char legacy_magic[8] = {'W', 'S', 'P', 'C', 'C', 'A', 'P', '1'};
+constexpr char capture_magic[8] = {'W', 'S', 'P', 'C', 'C', 'A', 'P', '2'};
+const std::uint32_t capture_version = 2;
+const std::uint32_t byte_order_mark = 0x01020304;
+
+const auto flush_interval = std::chrono::seconds{1};
+
+template <typename T>
+void write_le(std::ofstream& file, T value)
+{
+    using unsigned_type = std::make_unsigned_t<T>;
+    auto bits = static_cast<unsigned_type>(value);
+    char bytes[sizeof(T)];
+    for (auto& byte : bytes)
+    {
+        byte = static_cast<char>(bits & 0xff);
+        bits = static_cast<unsigned_type>(bits >> 8);
+    }
+    file.write(bytes, sizeof(bytes));
+}
+
+template <typename T>
+bool read_le(std::ifstream& file, T& value)
+{
+    unsigned char bytes[sizeof(T)];
+    if (!file.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+        return false;
+    std::make_unsigned_t<T> bits = 0;
+    for (std::size_t i = sizeof(T); i-- > 0;)
+        bits = static_cast<decltype(bits)>((bits << 8) | bytes[i]);
+    value = static_cast<T>(bits);
+    return true;
+}
+
+template <typename T>
+bool read_pod(std::ifstream& file, T& value)
+{
+    return !!file.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+} // namespace anonymous
+
+capture_writer::capture_writer(const std::string& path)
+    : file_{path, std::ios_base::binary | std::ios_base::trunc},
+      last_flush_{std::chrono::steady_clock::now()}
+{
+    if (!file_)
+        throw std::runtime_error{"can't open capture file: " + path};
+    file_.write(capture_magic, sizeof(capture_magic));
+    write_le(file_, capture_version);
+    write_le(file_, byte_order_mark);
+    file_.flush();
+}
+
+bool capture_writer::write(wspc::connection_id connection,
+                           const std::string& payload)
+{
+    if (payload.size() > std::numeric_limits<std::uint32_t>::max())
+        return false;
+
+    using namespace std::chrono;
+    const std::int64_t timestamp =
+        duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+            .count();
+    const auto length = static_cast<std::uint32_t>(payload.size());
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    write_le(file_, static_cast<std::uint64_t>(connection));
+    write_le(file_, timestamp);
+    write_le(file_, length);
+    file_.write(payload.data(), payload.size());
+
+    const auto now = steady_clock::now();
+    if (now - last_flush_ >= flush_interval)
+    {
+        file_.flush();
+        last_flush_ = now;
+    }
+    return true;
+}
+
+capture_reader::capture_reader(const std::string& path)
+    : file_{path, std::ios_base::binary}
+{
+    char magic[sizeof(capture_magic)];
+    if (!file_ || !file_.read(magic, sizeof(magic)))
+        throw std::runtime_error{"not a capture file: " + path};
+
+    if (std::memcmp(magic, legacy_magic, sizeof(magic)) == 0)
+    {
+        host_byte_order_ = true;
+        return;
+    }
+
+    std::uint32_t version, mark;
+    if (std::memcmp(magic, capture_magic, sizeof(magic)) != 0 ||
+        !read_le(file_, version) || !read_le(file_, mark))
+    {
+        throw std::runtime_error{"not a capture file: " + path};
+    }
+    if (version != capture_version || mark != byte_order_mark)
+    {
+        throw std::runtime_error{"unsupported version of capture file: " +
+                                 path};
+    }
+}
+
+bool capture_reader::next(capture_record& record)
+{
+    std::uint64_t connection;
+    std::uint32_t length;
+    const bool read =
+        host_byte_order_
+            ? read_pod(file_, connection) &&
+                  read_pod(file_, record.timestamp) && read_pod(file_, length)
+            : read_le(file_, connection) &&
+                  read_le(file_, record.timestamp) && read_le(file_, length);
+    if (!read)
+        return false;
+    record.connection = connection;
+    record.payload.resize(length);
+    return length == 0 || !!file_.read(&record.payload[0], length);
+}
+} // namespace wspc
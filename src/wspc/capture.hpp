@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_CAPTURE_HPP_GUARD
+#define WSPC_CAPTURE_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace wspc {
+
+// Single incoming message as seen by the transport
+struct capture_record
+{
+    wspc::connection_id connection;
+    // Nanoseconds since epoch (system clock)
+    std::int64_t timestamp;
+    std::string payload;
+};
+
+// Appends incoming messages to a compact binary log:
+//   magic (8 bytes) | version (u32) | byte order mark (u32) | record | ...
+// where each record is:
+//   connection (u64) | timestamp (i64) | length (u32) | payload
+// All numbers are little-endian, so captures can be replayed on any machine.
+// Byte order mark is 0x01020304, a file written in any other byte order is
+// rejected when read.
+//
+// Records are buffered and flushed at least once a second (when the next one
+// is written), so a crash loses up to a second's worth of them.
+class capture_writer
+{
+public:
+    explicit capture_writer(const std::string& path);
+
+    // Thread-safe. Payloads longer than 4 GiB can't be recorded, they're
+    // skipped and false is returned.
+    bool write(wspc::connection_id connection, const std::string& payload);
+
+private:
+    std::mutex mutex_;
+    std::ofstream file_;
+    std::chrono::steady_clock::time_point last_flush_;
+};
+
+// Reads back log written by capture_writer. Files of the first version of
+// the format (without version and byte order mark, numbers in host byte
+// order) are read as well.
+class capture_reader
+{
+public:
+    // Throws if it's not a capture file or one of unsupported version
+    explicit capture_reader(const std::string& path);
+
+    // Returns false when there are no more records
+    bool next(capture_record& record);
+
+private:
+    std::ifstream file_;
+    bool host_byte_order_{false};
+};
+} // namespace wspc
+
+#endif
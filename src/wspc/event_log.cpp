@@ -0,0 +1,305 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/event_log.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+namespace wspc {
+
+namespace bip = boost::interprocess;
+
+namespace {
+
+// Random, but small enough to be represented exactly by a JSON number
+std::uint64_t make_epoch()
+{
+    std::random_device device;
+    std::mt19937_64 engine{(static_cast<std::uint64_t>(device()) << 32) |
+                           device()};
+    std::uniform_int_distribution<std::uint64_t> dist{
+        1, (std::uint64_t{1} << 53) - 1};
+    return dist(engine);
+}
+} // namespace anonymous
+
+// Memory-mapped file with following layout:
+//   header | data area
+// Data area is a circular buffer of records, each being:
+//   seq (u64) | length (u32) | payload (length bytes)
+// Begin and end are monotonic positions in the data area (wrapped only when
+// accessing it). Record that wouldn't fit before the end of the data area
+// goes to its beginning, skipped tail is marked with seq 0 if there's room
+// for a record header. Oldest records are evicted one by one to make room
+// for new ones. Numbers are stored in host byte order.
+class event_log::segment
+{
+public:
+    segment(const std::string& path, std::size_t size)
+    {
+        if (size < sizeof(header) + sizeof(record_header))
+            throw std::invalid_argument{"event log segment is too small"};
+
+        const bool existing = file_size(path) == size;
+        if (!existing)
+        {
+            // Create (or truncate) file with given size
+            std::filebuf fb;
+            if (!fb.open(path, std::ios_base::in | std::ios_base::out |
+                                   std::ios_base::trunc |
+                                   std::ios_base::binary))
+            {
+                throw std::runtime_error{"can't create event log segment: " +
+                                         path};
+            }
+            fb.pubseekoff(size - 1, std::ios_base::beg);
+            fb.sputc(0);
+        }
+
+        file_ = bip::file_mapping{path.c_str(), bip::read_write};
+        region_ = bip::mapped_region{file_, bip::read_write, 0, size};
+        data_ = static_cast<char*>(region_.get_address());
+        capacity_ = size - sizeof(header);
+
+        if (!existing || std::memcmp(hdr().magic, magic, sizeof(magic)) != 0 ||
+            hdr().end < hdr().begin || hdr().end - hdr().begin > capacity_)
+        {
+            // New history, clients resuming from the old one (if any) must
+            // not mistake it for its continuation
+            std::memcpy(hdr().magic, magic, sizeof(magic));
+            hdr().epoch = make_epoch();
+            hdr().begin = 0;
+            hdr().end = 0;
+        }
+    }
+
+    ~segment() { region_.flush(); }
+
+    std::uint64_t epoch() const { return hdr().epoch; }
+
+    template <typename Func>
+    void for_each(Func&& func) const
+    {
+        auto pos = hdr().begin;
+        while (pos != hdr().end)
+        {
+            record_header rec;
+            if (!read_record(pos, rec))
+                continue;
+            const auto offset = pos % capacity_ + sizeof(rec);
+            func(rec.seq, std::string(area() + offset, rec.length));
+            pos += sizeof(rec) + rec.length;
+        }
+    }
+
+    void append(std::uint64_t seq, const std::string& payload)
+    {
+        const auto record_size = sizeof(record_header) + payload.size();
+        if (record_size > capacity_)
+            return;
+
+        const auto offset = hdr().end % capacity_;
+        auto padding =
+            capacity_ - offset < record_size ? capacity_ - offset : 0;
+        while (hdr().end + padding + record_size - hdr().begin > capacity_)
+        {
+            if (hdr().begin != hdr().end)
+            {
+                evict();
+                continue;
+            }
+            // Nothing left to evict, start from the beginning of data area
+            hdr().end += padding;
+            hdr().begin = hdr().end;
+            padding = 0;
+        }
+
+        if (padding >= sizeof(record_header))
+        {
+            const record_header marker{0, 0};
+            std::memcpy(area() + offset, &marker, sizeof(marker));
+        }
+        const auto pos = hdr().end + padding;
+
+        record_header rec;
+        rec.seq = seq;
+        rec.length = static_cast<std::uint32_t>(payload.size());
+        std::memcpy(area() + pos % capacity_, &rec, sizeof(rec));
+        std::memcpy(area() + pos % capacity_ + sizeof(rec), payload.data(),
+                    payload.size());
+        // Publish record only after it's been completely written
+        hdr().end = pos + record_size;
+    }
+
+private:
+    static constexpr char magic[8] = {'W', 'S', 'P', 'C', 'E', 'L', 'G', '2'};
+
+    struct header
+    {
+        char magic[8];
+        // Identifies history of the log (see event_log::epoch)
+        std::uint64_t epoch;
+        std::uint64_t begin;
+        std::uint64_t end;
+    };
+
+    struct record_header
+    {
+        std::uint64_t seq;
+        std::uint32_t length;
+    };
+
+    static std::size_t file_size(const std::string& path)
+    {
+        std::ifstream file{path, std::ios_base::binary | std::ios_base::ate};
+        return file ? static_cast<std::size_t>(file.tellg()) : 0;
+    }
+
+    header& hdr() const { return *reinterpret_cast<header*>(data_); }
+    char* area() const { return data_ + sizeof(header); }
+
+    // Reads header of the record at pos. If there's padding instead, moves
+    // pos past it and returns false.
+    bool read_record(std::uint64_t& pos, record_header& rec) const
+    {
+        const auto offset = pos % capacity_;
+        if (capacity_ - offset >= sizeof(rec))
+        {
+            std::memcpy(&rec, area() + offset, sizeof(rec));
+            if (rec.seq != 0)
+                return true;
+        }
+        pos += capacity_ - offset;
+        return false;
+    }
+
+    // Drops the oldest record (and padding in front of it)
+    void evict()
+    {
+        auto pos = hdr().begin;
+        record_header rec;
+        while (!read_record(pos, rec))
+            ;
+        hdr().begin = pos + sizeof(rec) + rec.length;
+    }
+
+private:
+    bip::file_mapping file_;
+    bip::mapped_region region_;
+    char* data_{nullptr};
+    std::size_t capacity_{0};
+};
+
+constexpr char event_log::segment::magic[8];
+
+event_log::event_log(std::size_t capacity)
+    : capacity_{capacity}, epoch_{make_epoch()}
+{
+    if (capacity_ == 0)
+        throw std::invalid_argument{"event log capacity must be positive"};
+    ring_.reserve(capacity_);
+}
+
+event_log::event_log(std::size_t capacity, const std::string& segment_path,
+                     std::size_t segment_size)
+    : event_log{capacity}
+{
+    segment_ = std::make_unique<segment>(segment_path, segment_size);
+    // History continues where the segment left off
+    epoch_ = segment_->epoch();
+    segment_->for_each([&](std::uint64_t seq, const std::string& payload) {
+        std::string err;
+        auto event = json11::Json::parse(payload, err);
+        if (err.empty() && seq > last_seq_)
+            push(seq, std::move(event));
+    });
+}
+
+event_log::~event_log() = default;
+
+std::string event_log::append(json11::Json::object event)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto seq = last_seq_ + 1;
+    event["seq"] = static_cast<double>(seq);
+    event["epoch"] = static_cast<double>(epoch_);
+
+    json11::Json event_json{std::move(event)};
+    auto payload = event_json.dump();
+    if (segment_)
+        segment_->append(seq, payload);
+    push(seq, std::move(event_json));
+    return payload;
+}
+
+bool event_log::since(std::uint64_t epoch, std::uint64_t last_seq,
+                      json11::Json::array& events) const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    // Sequence numbers of another history (e.g. from before a restart) say
+    // nothing about what client has missed. Give it everything we have and
+    // let it know it missed something.
+    const bool other_history = epoch != epoch_ || last_seq > last_seq_;
+    if (ring_.empty())
+        return !other_history && last_seq == last_seq_;
+
+    for (std::size_t i = 0; i < ring_.size(); ++i)
+    {
+        const auto& e = ring_[(head_ + i) % ring_.size()];
+        if (other_history || e.seq > last_seq)
+            events.push_back(e.event);
+    }
+    if (other_history)
+        return false;
+
+    const auto oldest_seq = ring_[head_].seq;
+    return last_seq + 1 >= oldest_seq;
+}
+
+std::uint64_t event_log::epoch() const { return epoch_; }
+
+std::uint64_t event_log::last_seq() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return last_seq_;
+}
+
+void event_log::push(std::uint64_t seq, json11::Json event)
+{
+    if (ring_.size() < capacity_)
+    {
+        ring_.push_back({seq, std::move(event)});
+    }
+    else
+    {
+        ring_[head_] = {seq, std::move(event)};
+        head_ = (head_ + 1) % capacity_;
+    }
+    last_seq_ = seq;
+}
+} // namespace wspc
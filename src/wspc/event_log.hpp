@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_EVENT_LOG_HPP_GUARD
+#define WSPC_EVENT_LOG_HPP_GUARD
+
+#include <kl/json_convert.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace wspc {
+
+// Bounded log of broadcast events. Every appended event is given a
+// monotonically increasing sequence number ("seq" field) and the most recent
+// ones are kept in a ring buffer so that reconnecting clients can ask for
+// everything they've missed since the last sequence number they've seen.
+// Optionally events are also written to a memory-mapped segment file which
+// lets the sequence (and recent history) survive a restart of the service.
+//
+// Sequence numbers are meaningful only within one history of the log,
+// identified by its epoch ("epoch" field of every event). A new epoch is
+// picked by every log without a segment and whenever a segment is created.
+class event_log
+{
+public:
+    explicit event_log(std::size_t capacity);
+    // When segment is full its oldest events are evicted to make room for
+    // new ones.
+    event_log(std::size_t capacity, const std::string& segment_path,
+              std::size_t segment_size);
+    ~event_log();
+
+    event_log(const event_log&) = delete;
+    event_log& operator=(const event_log&) = delete;
+
+    // Assigns next sequence number to the event and returns its serialized
+    // form ready to be sent
+    std::string append(json11::Json::object event);
+
+    // Fills events appended after last_seq. Returns false if some of them
+    // have been already dropped from the log or if last_seq comes from
+    // another epoch - in the latter case all retained events are filled.
+    bool since(std::uint64_t epoch, std::uint64_t last_seq,
+               json11::Json::array& events) const;
+
+    std::uint64_t epoch() const;
+    std::uint64_t last_seq() const;
+
+private:
+    struct entry
+    {
+        std::uint64_t seq;
+        json11::Json event;
+    };
+
+    class segment;
+
+    void push(std::uint64_t seq, json11::Json event);
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<entry> ring_;
+    std::size_t capacity_;
+    std::size_t head_{0}; // index of the oldest entry
+    std::uint64_t last_seq_{0};
+    std::uint64_t epoch_;
+    std::unique_ptr<segment> segment_;
+};
+} // namespace wspc
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/handler_registry.hpp"
+
+#include <thread>
+#include <utility>
+
+namespace wspc {
+
+handler_registry::handler_registry() : current_{new table}
+{
+    readers_[0] = 0;
+    readers_[1] = 0;
+}
+
+handler_registry::~handler_registry() { delete current_.load(); }
+
+void handler_registry::insert(const std::string& name, entry value)
+{
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    auto next = std::make_unique<table>(*current_.load());
+    (*next)[name] = std::move(value);
+    publish(std::move(next));
+}
+
+bool handler_registry::erase(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock{write_mutex_};
+    if (!current_.load()->count(name))
+        return false;
+    auto next = std::make_unique<table>(*current_.load());
+    next->erase(name);
+    publish(std::move(next));
+    return true;
+}
+
+handler_registry::entry handler_registry::find(const std::string& name) const
+{
+    snapshot handlers{*this};
+    auto it = handlers->find(name);
+    return it != handlers->end() ? it->second : entry{};
+}
+
+void handler_registry::publish(std::unique_ptr<table> next)
+{
+    std::unique_ptr<const table> previous{current_.exchange(next.release())};
+
+    // Readers which started before the epoch is bumped might still use the
+    // previous table, everyone after that gets the new one
+    const auto epoch = epoch_.fetch_add(1);
+    while (readers_[epoch & 1].load() != 0)
+        std::this_thread::yield();
+}
+
+handler_registry::snapshot::snapshot(const handler_registry& registry)
+    : registry_{registry}
+{
+    // Announcement counts only if the epoch hasn't changed in the meantime,
+    // otherwise the writer might have already checked the counter
+    for (;;)
+    {
+        const auto epoch = registry_.epoch_.load();
+        counter_ = epoch & 1;
+        ++registry_.readers_[counter_];
+        if (registry_.epoch_.load() == epoch)
+            break;
+        --registry_.readers_[counter_];
+    }
+    table_ = registry_.current_.load();
+}
+
+handler_registry::snapshot::~snapshot() { --registry_.readers_[counter_]; }
+} // namespace wspc
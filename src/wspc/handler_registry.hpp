@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_HANDLER_REGISTRY_HPP_GUARD
+#define WSPC_HANDLER_REGISTRY_HPP_GUARD
+
+#include "wspc/request_scheduler.hpp"
+#include "wspc/service_handler.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace wspc {
+
+// Handlers of service's procedures, along with their priorities, that can be
+// changed while requests are being served (read-copy-update). Readers look
+// handlers up without taking a lock or allocating. Every change copies the
+// table and atomically publishes the new one. Replaced table is freed once
+// no reader can see it anymore, handlers themselves live for as long as
+// requests using them.
+//
+// Readers announce themselves in one of two counters, picked by the parity
+// of the current epoch. After publishing, writer bumps the epoch and waits
+// for the counter of the previous one to drop to zero.
+class handler_registry
+{
+public:
+    struct entry
+    {
+        std::shared_ptr<wspc::service_handler> handler;
+        wspc::handler_priority priority{wspc::handler_priority::normal};
+    };
+    using table = std::unordered_map<std::string, entry>;
+
+    handler_registry();
+    ~handler_registry();
+
+    handler_registry(const handler_registry&) = delete;
+    handler_registry& operator=(const handler_registry&) = delete;
+
+    // Replaces handler registered under the same name, if any
+    void insert(const std::string& name, entry value);
+    // Returns false if there's no such procedure
+    bool erase(const std::string& name);
+
+    // Returns entry with null handler if there's no such procedure
+    entry find(const std::string& name) const;
+
+    // Current table, kept alive for as long as the snapshot exists. Writers
+    // wait for it so it should be short-lived (e.g. not held while calling a
+    // handler).
+    class snapshot
+    {
+    public:
+        explicit snapshot(const handler_registry& registry);
+        ~snapshot();
+
+        snapshot(const snapshot&) = delete;
+        snapshot& operator=(const snapshot&) = delete;
+
+        const table& operator*() const { return *table_; }
+        const table* operator->() const { return table_; }
+
+    private:
+        const handler_registry& registry_;
+        std::size_t counter_;
+        const table* table_;
+    };
+
+private:
+    // Requires write_mutex_ to be locked
+    void publish(std::unique_ptr<table> next);
+
+private:
+    std::atomic<const table*> current_;
+    mutable std::atomic<std::uint64_t> epoch_{0};
+    // Readers, by parity of the epoch they've started in
+    mutable std::atomic<std::size_t> readers_[2];
+    std::mutex write_mutex_;
+};
+} // namespace wspc
+
+#endif
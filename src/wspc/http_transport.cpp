@@ -0,0 +1,489 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/http_transport.hpp"
+
+#include <boost/asio/buffers_iterator.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace wspc {
+
+namespace {
+
+const std::size_t max_header_size = 64 * 1024;
+const std::size_t max_body_size = 16 * 1024 * 1024;
+
+using buffer_iterator = boost::asio::buffers_iterator<
+    boost::asio::streambuf::const_buffers_type>;
+
+// Match condition for async_read_until: end of request head. Gives up once
+// there's more than max_header_size buffered without one so a client can't
+// make us buffer far more than that before the size is checked.
+std::pair<buffer_iterator, bool> match_head(buffer_iterator begin,
+                                            buffer_iterator end)
+{
+    static const char delim[] = "\r\n\r\n";
+    const auto it = std::search(begin, end, delim, delim + 4);
+    if (it != end)
+        return {it + 4, true};
+    if (static_cast<std::size_t>(end - begin) > max_header_size)
+        return {end, true};
+    return {begin, false};
+}
+
+struct http_request
+{
+    std::string method;
+    std::string target;
+    bool keep_alive{true};
+    bool chunked{false};
+    bool has_content_length{false};
+    std::size_t content_length{0};
+};
+
+bool iequals(const std::string& a, const char* b)
+{
+    std::size_t i = 0;
+    for (; i < a.size() && b[i]; ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(a[i])) !=
+            std::tolower(static_cast<unsigned char>(b[i])))
+        {
+            return false;
+        }
+    }
+    return i == a.size() && !b[i];
+}
+
+std::string trim(const std::string& str)
+{
+    const auto first = str.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return {};
+    const auto last = str.find_last_not_of(" \t\r");
+    return str.substr(first, last - first + 1);
+}
+
+// Parses request line and the headers we care about
+bool parse_request(const std::string& head, http_request& request)
+{
+    std::istringstream is{head};
+    std::string line;
+    if (!std::getline(is, line))
+        return false;
+
+    std::istringstream request_line{line};
+    std::string version;
+    if (!(request_line >> request.method >> request.target >> version))
+        return false;
+    if (version == "HTTP/1.0")
+        request.keep_alive = false;
+    else if (version != "HTTP/1.1")
+        return false;
+
+    while (std::getline(is, line) && line != "\r")
+    {
+        const auto colon = line.find(':');
+        if (colon == std::string::npos)
+            return false;
+        const auto name = line.substr(0, colon);
+        const auto value = trim(line.substr(colon + 1));
+
+        if (iequals(name, "Content-Length"))
+        {
+            char* end;
+            request.content_length = std::strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end)
+                return false;
+            request.has_content_length = true;
+        }
+        else if (iequals(name, "Connection"))
+        {
+            if (iequals(value, "close"))
+                request.keep_alive = false;
+            else if (iequals(value, "keep-alive"))
+                request.keep_alive = true;
+        }
+        else if (iequals(name, "Transfer-Encoding"))
+        {
+            request.chunked = true;
+        }
+    }
+    return true;
+}
+
+std::string make_response(const char* status, const char* content_type,
+                          const std::string& body, bool keep_alive)
+{
+    std::string response;
+    response.reserve(128 + body.size());
+    response += "HTTP/1.1 ";
+    response += status;
+    response += "\r\nContent-Type: ";
+    response += content_type;
+    response += "\r\nContent-Length: ";
+    response += std::to_string(body.size());
+    response += keep_alive ? "\r\nConnection: keep-alive\r\n\r\n"
+                           : "\r\nConnection: close\r\n\r\n";
+    response += body;
+    return response;
+}
+
+class http_session;
+} // namespace anonymous
+
+class http_transport_impl
+    : public std::enable_shared_from_this<http_transport_impl>
+{
+public:
+    http_transport_impl(wspc::processor& processor,
+                        boost::asio::io_service& io_service,
+                        std::uint16_t port, std::chrono::seconds idle_timeout)
+        : processor_{processor},
+          io_service_{io_service},
+          idle_timeout_{idle_timeout},
+          accept_strand_{io_service},
+          acceptor_{io_service},
+          socket_{io_service}
+    {
+        using boost::asio::ip::tcp;
+        const tcp::endpoint endpoint{tcp::v6(), port};
+        acceptor_.open(endpoint.protocol());
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
+
+    void start_accept();
+    void close();
+    std::uint16_t port() const { return acceptor_.local_endpoint().port(); }
+    void remove(wspc::connection_id id)
+    {
+        std::lock_guard<std::mutex> lock{sessions_mutex_};
+        sessions_.erase(id);
+    }
+
+    // Returns complete HTTP response for given request
+    std::string process(const http_request& request, const std::string& body)
+    {
+        // Request could have been read just before the transport got closed
+        if (closed_)
+            return make_response("503 Service Unavailable", "text/plain", {},
+                                 false);
+
+        try
+        {
+            if (request.method == "POST")
+            {
+                auto response =
+                    processor_.process_message(wspc::no_connection, body);
+                if (response.empty())
+                {
+                    return make_response("204 No Content", "application/json",
+                                         response, request.keep_alive);
+                }
+                return make_response("200 OK", "application/json", response,
+                                     request.keep_alive);
+            }
+            if (request.method == "GET")
+            {
+                auto body = processor_.process_http(request.target);
+                return make_response(
+                    "200 OK",
+                    processor_.http_content_type(request.target).c_str(),
+                    body, request.keep_alive);
+            }
+            return make_response("405 Method Not Allowed", "text/plain", {},
+                                 request.keep_alive);
+        }
+        catch (std::exception& ex)
+        {
+            return make_response("500 Internal Server Error", "text/plain",
+                                 ex.what(), request.keep_alive);
+        }
+    }
+
+    std::chrono::seconds idle_timeout() const { return idle_timeout_; }
+
+private:
+    wspc::processor& processor_;
+    boost::asio::io_service& io_service_;
+    std::chrono::seconds idle_timeout_;
+    // Serializes accept handlers with closing the acceptor
+    boost::asio::io_service::strand accept_strand_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    // Socket for the next connection being accepted
+    boost::asio::ip::tcp::socket socket_;
+
+    std::mutex sessions_mutex_;
+    std::unordered_map<wspc::connection_id, std::shared_ptr<http_session>>
+        sessions_;
+    std::atomic<bool> closed_{false};
+};
+
+namespace {
+
+// Single keep-alive connection handling one request at a time (pipelined
+// requests are read from the buffer in order)
+class http_session : public std::enable_shared_from_this<http_session>
+{
+public:
+    http_session(std::shared_ptr<http_transport_impl> owner,
+                 boost::asio::io_service& io_service,
+                 boost::asio::ip::tcp::socket socket)
+        : owner_{std::move(owner)},
+          socket_{std::move(socket)},
+          strand_{io_service},
+          timer_{io_service},
+          buffer_{max_header_size + max_body_size},
+          id_{wspc::make_connection_id()}
+    {
+    }
+
+    wspc::connection_id id() const { return id_; }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        strand_.post([self] { self->read_head(); });
+    }
+
+    void close()
+    {
+        auto self = shared_from_this();
+        strand_.post([self] { self->shutdown(); });
+    }
+
+private:
+    // Closes the connection if the read that follows doesn't complete within
+    // idle timeout
+    void arm_timer()
+    {
+        auto self = shared_from_this();
+        timer_.expires_from_now(owner_->idle_timeout());
+        timer_.async_wait(
+            strand_.wrap([self](const boost::system::error_code& ec) {
+                if (!ec)
+                    self->shutdown();
+            }));
+    }
+
+    void read_head()
+    {
+        arm_timer();
+
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            socket_, buffer_, match_head,
+            strand_.wrap([self](const boost::system::error_code& ec,
+                                std::size_t head_size) {
+                if (ec || head_size > max_header_size)
+                    return self->shutdown();
+                self->timer_.cancel();
+
+                std::string head(
+                    boost::asio::buffers_begin(self->buffer_.data()),
+                    boost::asio::buffers_begin(self->buffer_.data()) +
+                        head_size);
+                self->buffer_.consume(head_size);
+
+                self->request_ = http_request{};
+                if (!parse_request(head, self->request_))
+                    return self->respond_error("400 Bad Request");
+                self->read_body();
+            }));
+    }
+
+    void read_body()
+    {
+        if (request_.chunked)
+        {
+            return respond_error("501 Not Implemented",
+                                 "chunked encoding not supported");
+        }
+        if (request_.method == "POST" && !request_.has_content_length)
+            return respond_error("411 Length Required");
+        if (request_.content_length > max_body_size)
+            return respond_error("413 Payload Too Large");
+
+        const auto length = request_.content_length;
+        if (buffer_.size() >= length)
+            return process();
+
+        arm_timer();
+
+        auto self = shared_from_this();
+        boost::asio::async_read(
+            socket_, buffer_,
+            boost::asio::transfer_exactly(length - buffer_.size()),
+            strand_.wrap([self](const boost::system::error_code& ec,
+                                std::size_t) {
+                if (ec)
+                    return self->shutdown();
+                self->timer_.cancel();
+                self->process();
+            }));
+    }
+
+    void process()
+    {
+        const auto length = request_.content_length;
+        std::string body(boost::asio::buffers_begin(buffer_.data()),
+                         boost::asio::buffers_begin(buffer_.data()) + length);
+        buffer_.consume(length);
+        respond(owner_->process(request_, body));
+    }
+
+    void respond(std::string response)
+    {
+        response_ = std::move(response);
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(response_),
+            strand_.wrap([self](const boost::system::error_code& ec,
+                                std::size_t) {
+                if (ec || !self->request_.keep_alive)
+                    return self->shutdown();
+                self->read_head();
+            }));
+    }
+
+    // Body of the request (if any) is left unread so the connection can't
+    // be reused - anything after the head can't be trusted to be a request
+    void respond_error(const char* status, std::string body = {})
+    {
+        request_.keep_alive = false;
+        respond(make_response(status, "text/plain", std::move(body), false));
+    }
+
+    void shutdown()
+    {
+        boost::system::error_code ignored_ec;
+        timer_.cancel(ignored_ec);
+        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
+                         ignored_ec);
+        socket_.close(ignored_ec);
+        owner_->remove(id_);
+    }
+
+private:
+    std::shared_ptr<http_transport_impl> owner_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::io_service::strand strand_;
+    boost::asio::steady_timer timer_;
+    boost::asio::streambuf buffer_;
+    wspc::connection_id id_;
+
+    http_request request_;
+    std::string response_;
+};
+} // namespace anonymous
+
+void http_transport_impl::start_accept()
+{
+    auto self = shared_from_this();
+    acceptor_.async_accept(
+        socket_,
+        accept_strand_.wrap([self](const boost::system::error_code& ec) {
+            if (ec == boost::asio::error::operation_aborted || self->closed_)
+                return;
+            if (!ec)
+            {
+                boost::system::error_code ignored_ec;
+                self->socket_.set_option(
+                    boost::asio::ip::tcp::no_delay{true}, ignored_ec);
+                auto session = std::make_shared<http_session>(
+                    self, self->io_service_, std::move(self->socket_));
+                {
+                    std::lock_guard<std::mutex> lock{self->sessions_mutex_};
+                    if (self->closed_)
+                        return;
+                    self->sessions_.emplace(session->id(), session);
+                }
+                session->start();
+            }
+            self->socket_ = boost::asio::ip::tcp::socket{self->io_service_};
+            self->start_accept();
+        }));
+}
+
+void http_transport_impl::close()
+{
+    // Accept handler might be running on another thread right now
+    auto self = shared_from_this();
+    accept_strand_.post([self] {
+        boost::system::error_code ignored_ec;
+        self->acceptor_.close(ignored_ec);
+    });
+
+    std::unordered_map<wspc::connection_id, std::shared_ptr<http_session>>
+        sessions;
+    {
+        std::lock_guard<std::mutex> lock{sessions_mutex_};
+        closed_ = true;
+        sessions.swap(sessions_);
+    }
+    for (auto& kv : sessions)
+        kv.second->close();
+}
+
+http_transport::http_transport(wspc::processor& processor,
+                               boost::asio::io_service& io_service,
+                               std::uint16_t port,
+                               std::chrono::seconds idle_timeout)
+    : impl_{std::make_shared<wspc::http_transport_impl>(processor, io_service,
+                                                        port, idle_timeout)}
+{
+    impl_->start_accept();
+}
+
+http_transport::~http_transport() { impl_->close(); }
+
+void http_transport::close() { impl_->close(); }
+
+std::uint16_t http_transport::port() const { return impl_->port(); }
+
+bool http_transport::send(wspc::connection_id, const std::string&)
+{
+    return false;
+}
+
+void http_transport::broadcast(const std::string&) {}
+
+int http_transport::num_clients() const { return 0; }
+
+bool http_transport::connected(wspc::connection_id) const { return false; }
+} // namespace wspc
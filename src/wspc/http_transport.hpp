@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_HTTP_TRANSPORT_HPP_GUARD
+#define WSPC_HTTP_TRANSPORT_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace wspc {
+
+// Forward declarations
+class http_transport_impl;
+
+// Plain HTTP/1.1 transport for stateless callers (scripts, cron jobs, etc.)
+// which don't want to pay for WebSocket upgrade just to make a call. Body of
+// POST request is a JSON-RPC request or batch and the response carries
+// JSON-RPC response (or 204 No Content if there were only notifications).
+// GET serves processor's HTTP pages. Connections are kept alive unless client
+// asks otherwise and closed after idle_timeout of inactivity.
+//
+// Callers don't get any events so send() and broadcast() do nothing.
+class http_transport : public wspc::transport
+{
+public:
+    http_transport(
+        wspc::processor& processor, boost::asio::io_service& io_service,
+        std::uint16_t port,
+        std::chrono::seconds idle_timeout = std::chrono::seconds{30});
+    ~http_transport() override;
+
+    void close() override;
+    // Port it listens on, useful if it's been given 0 (any free one)
+    std::uint16_t port() const;
+
+    bool send(wspc::connection_id id, const std::string& payload) override;
+    void broadcast(const std::string& payload) override;
+    int num_clients() const override;
+    bool connected(wspc::connection_id id) const override;
+
+private:
+    std::shared_ptr<wspc::http_transport_impl> impl_;
+};
+} // namespace wspc
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/json_rpc.hpp"
+#include "wspc/param_validation.hpp"
+
+#include <cstring>
+
+namespace wspc {
+namespace detail {
+
+json11::Json make_error_response(const json11::Json& id, fault_code code,
+                                 std::string error_message)
+{
+    return json11::Json::object{
+        {"id", id},
+        {"error", json11::Json::object{{"code", static_cast<int>(code)},
+                                       {"message", std::move(error_message)}}}};
+}
+
+json11::Json make_error_response(const json11::Json& id, fault_code code,
+                                 std::string error_message,
+                                 json11::Json data)
+{
+    return json11::Json::object{
+        {"id", id},
+        {"error", json11::Json::object{{"code", static_cast<int>(code)},
+                                       {"message", std::move(error_message)},
+                                       {"data", std::move(data)}}}};
+}
+
+json11::Json make_method_not_found_response(const json11::Json& id,
+                                            const std::string& method)
+{
+    std::string msg;
+    msg.reserve(strlen("procedure '") + method.length() +
+                strlen("' not found"));
+    msg += "procedure '";
+    msg += method;
+    msg += "' not found";
+    return make_error_response(id, fault_code::method_not_found,
+                               std::move(msg));
+}
+
+json11::Json make_invalid_params_response(const json11::Json& id,
+                                          const wspc::param_error& error)
+{
+    std::string msg;
+    msg.reserve(strlen("invalid method params: ") + error.message.length());
+    msg += "invalid method params: ";
+    msg += error.message;
+    return make_error_response(
+        id, fault_code::invalid_params, std::move(msg),
+        json11::Json::object{{"path", "params" + error.path}});
+}
+
+std::string wrap_response(const json11::Json& response)
+{
+    static std::string empty;
+    return !response["id"].is_null() ? response.dump() : empty;
+}
+} // namespace detail
+} // namespace wspc
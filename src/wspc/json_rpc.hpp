@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_JSON_RPC_HPP_GUARD
+#define WSPC_JSON_RPC_HPP_GUARD
+
+#include <kl/json_convert.hpp>
+
+#include <string>
+
+namespace wspc {
+
+struct param_error;
+
+namespace detail {
+
+// JSON-RPC 2.0 error codes
+enum class fault_code
+{
+    parse_error = -32700,
+    invalid_request = -32600,
+    method_not_found = -32601,
+    invalid_params = -32602,
+    internal_error = -32603
+};
+
+json11::Json make_error_response(const json11::Json& id, fault_code code,
+                                 std::string error_message);
+
+// Error response carrying additional data (the "data" member)
+json11::Json make_error_response(const json11::Json& id, fault_code code,
+                                 std::string error_message,
+                                 json11::Json data);
+
+json11::Json make_method_not_found_response(const json11::Json& id,
+                                            const std::string& method);
+
+// Response to request whose params failed validation. Path of offending value
+// is reported as error data.
+json11::Json make_invalid_params_response(const json11::Json& id,
+                                          const wspc::param_error& error);
+
+// Serializes given response unless it's a response to a notification (request
+// without an id) in which case an empty string is returned
+std::string wrap_response(const json11::Json& response);
+} // namespace detail
+} // namespace wspc
+
+#endif
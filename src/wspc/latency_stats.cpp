@@ -0,0 +1,75 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/latency_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+namespace wspc {
+
+void latency_stats::add(std::chrono::nanoseconds sample)
+{
+    samples_.push_back(sample.count());
+    sorted_ = false;
+}
+
+void latency_stats::merge(const latency_stats& other)
+{
+    samples_.insert(end(samples_), begin(other.samples_),
+                    end(other.samples_));
+    sorted_ = false;
+}
+
+std::chrono::nanoseconds latency_stats::percentile(double p) const
+{
+    if (samples_.empty())
+        return std::chrono::nanoseconds{0};
+    if (!sorted_)
+    {
+        std::sort(begin(samples_), end(samples_));
+        sorted_ = true;
+    }
+
+    const auto rank = static_cast<std::size_t>(
+        std::ceil(std::min(std::max(p, 0.0), 100.0) / 100.0 *
+                  samples_.size()));
+    return std::chrono::nanoseconds{samples_[rank > 0 ? rank - 1 : 0]};
+}
+
+std::chrono::nanoseconds latency_stats::max() const
+{
+    return percentile(100.0);
+}
+
+std::ostream& operator<<(std::ostream& os, const latency_stats& stats)
+{
+    auto us = [](std::chrono::nanoseconds ns) { return ns.count() / 1000.0; };
+    return os << "n=" << stats.count()
+              << " p50=" << us(stats.percentile(50)) << "us"
+              << " p90=" << us(stats.percentile(90)) << "us"
+              << " p99=" << us(stats.percentile(99)) << "us"
+              << " p99.9=" << us(stats.percentile(99.9)) << "us"
+              << " max=" << us(stats.max()) << "us";
+}
+} // namespace wspc
@@ -0,0 +1,55 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_LATENCY_STATS_HPP_GUARD
+#define WSPC_LATENCY_STATS_HPP_GUARD
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace wspc {
+
+// Collects latency samples and computes percentiles over them
+class latency_stats
+{
+public:
+    void add(std::chrono::nanoseconds sample);
+    void merge(const latency_stats& other);
+
+    std::size_t count() const { return samples_.size(); }
+    // Nearest-rank percentile, p in [0, 100]
+    std::chrono::nanoseconds percentile(double p) const;
+    std::chrono::nanoseconds max() const;
+
+private:
+    mutable std::vector<std::int64_t> samples_;
+    mutable bool sorted_{true};
+};
+
+// Writes "n=... p50=...us p90=...us p99=...us p99.9=...us max=...us"
+std::ostream& operator<<(std::ostream& os, const latency_stats& stats);
+} // namespace wspc
+
+#endif
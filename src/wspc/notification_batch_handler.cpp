@@ -0,0 +1,52 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/notification_batch_handler.hpp"
+#include "wspc/session.hpp"
+
+namespace wspc {
+
+json11::Json notification_batch_handler::operator()(const json11::Json& request)
+{
+    wspc::session session{wspc::no_connection};
+    return invoke(session, request);
+}
+
+json11::Json notification_batch_handler::invoke(wspc::session& session,
+                                                const json11::Json& request)
+{
+    notify_batch(session, &request, 1);
+    // Same as what void returning typed handlers respond with
+    return kl::to_json(detail::empty_response);
+}
+
+void notification_batch_handler::notify(wspc::session& session,
+                                        const json11::Json& request)
+{
+    notify_batch(session, &request, 1);
+}
+
+bool notification_batch_handler::batches_notifications() const
+{
+    return true;
+}
+} // namespace wspc
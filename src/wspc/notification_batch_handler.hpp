@@ -0,0 +1,134 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_NOTIFICATION_BATCH_HANDLER_HPP_GUARD
+#define WSPC_NOTIFICATION_BATCH_HANDLER_HPP_GUARD
+
+#include "wspc/param_validation.hpp"
+#include "wspc/service_handler.hpp"
+#include "wspc/type_description.hpp"
+#include "wspc/typed_service_handler.hpp"
+
+#include <kl/json_convert.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wspc {
+
+// Base class for handlers of notifications (requests without an id) that are
+// cheaper to process many at once, e.g. telemetry samples written to a
+// database in one go. Service passes all notifications of the procedure from
+// a JSON-RPC batch together and, when requests are queued up (see
+// request_scheduler), all that arrive from the same connection until the
+// batch gets its turn. Params of each notification are validated beforehand,
+// those failing are dropped. Requests with an id are handled as a batch of
+// one.
+class notification_batch_handler : public wspc::service_handler
+{
+public:
+    // Called without a connection, batch gets a fresh session
+    json11::Json operator()(const json11::Json& request) override;
+    json11::Json invoke(wspc::session& session,
+                        const json11::Json& request) override;
+    void notify(wspc::session& session, const json11::Json& request) override;
+
+    bool batches_notifications() const override;
+    void notify_batch(wspc::session& session, const json11::Json* requests,
+                      std::size_t count) override = 0;
+};
+
+namespace detail {
+
+// Functional wrapper over notification_batch_handler. Function takes
+// const std::vector<Params>& where Params is what params of a single
+// notification are deserialized to: reflectable struct for named params or
+// std::tuple for positional ones. Session isn't passed on, derive from
+// notification_batch_handler to make use of it.
+template <typename Func>
+class notification_batch_handler_func : public wspc::notification_batch_handler
+{
+    using params_type = typename decayed_first_arg<Func>::value_type;
+
+public:
+    explicit notification_batch_handler_func(Func func)
+        : func_{std::move(func)}
+    {
+    }
+
+    void notify_batch(wspc::session&, const json11::Json* requests,
+                      std::size_t count) override
+    {
+        std::vector<params_type> batch;
+        batch.reserve(count);
+        try
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                batch.push_back(kl::from_json<params_type>(requests[i]));
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            throw invalid_parameters_exception{"invalid method params: "s +
+                                               ex.what()};
+        }
+        func_(batch);
+    }
+
+    bool validate(const json11::Json& request,
+                  wspc::param_error& error) const override
+    {
+        return validate_params<params_type>(request, error);
+    }
+
+    const std::string& request_description() const override
+    {
+        return get_type_info<params_type>();
+    }
+
+    const std::string& response_description() const override
+    {
+        return get_type_info<void>();
+    }
+
+private:
+    Func func_;
+};
+} // namespace detail
+
+// Factory for notification batch handlers.
+// Usage: make_notification_batch_handler(
+//            [&](const std::vector<sample>& samples) { db.insert(samples); });
+template <typename Func>
+wspc::service_handler_ptr make_notification_batch_handler(Func&& func)
+{
+    return std::make_unique<
+        detail::notification_batch_handler_func<std::decay_t<Func>>>(
+        std::forward<Func>(func));
+}
+} // namespace wspc
+
+#endif
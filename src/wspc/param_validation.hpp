@@ -0,0 +1,277 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_PARAM_VALIDATION_HPP_GUARD
+#define WSPC_PARAM_VALIDATION_HPP_GUARD
+
+#include <kl/ctti.hpp>
+#include <kl/json_convert.hpp>
+#include <kl/type_traits.hpp>
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace wspc {
+
+// Describes why request params can't be decoded. Path points to offending
+// value, e.g. ".items[2].price" (relative to params).
+struct param_error
+{
+    std::string path;
+    std::string message;
+};
+
+namespace detail {
+
+inline bool param_mismatch(wspc::param_error& error, const char* message)
+{
+    error.message = message;
+    return false;
+}
+
+// Decodes the value and throws it away. For types whose rules aren't
+// mirrored here, so their verdict is always the same as kl::from_json's.
+template <typename T>
+bool try_decode(const json11::Json& json, wspc::param_error& error)
+{
+    try
+    {
+        (void)kl::from_json<T>(json);
+        return true;
+    }
+    catch (kl::json_deserialize_exception& ex)
+    {
+        return param_mismatch(error, ex.what());
+    }
+}
+
+// Checks if given JSON can be decoded into T with kl::from_json without
+// throwing, following the same rules. Path is built only on failure, while
+// unwinding. Types not recognized here are decoded (see try_decode).
+template <typename T, typename = void>
+struct param_validator
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        return try_decode<T>(json, error);
+    }
+};
+
+template <>
+struct param_validator<json11::Json>
+{
+    static bool validate(const json11::Json&, wspc::param_error&)
+    {
+        return true;
+    }
+};
+
+template <>
+struct param_validator<bool>
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        return json.is_bool() || param_mismatch(error, "expected bool");
+    }
+};
+
+template <typename T>
+struct param_validator<T, std::enable_if_t<std::is_arithmetic<T>::value &&
+                                           !std::is_same<T, bool>::value>>
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        return json.is_number() || param_mismatch(error, "expected number");
+    }
+};
+
+template <>
+struct param_validator<std::string>
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        return json.is_string() || param_mismatch(error, "expected string");
+    }
+};
+
+template <typename T>
+struct param_validator<boost::optional<T>>
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        return json.is_null() || param_validator<T>::validate(json, error);
+    }
+};
+
+template <typename T>
+struct sequence_param_validator
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        if (!json.is_array())
+            return param_mismatch(error, "expected array");
+
+        const auto& items = json.array_items();
+        for (std::size_t i = 0; i < items.size(); ++i)
+        {
+            if (!param_validator<T>::validate(items[i], error))
+            {
+                error.path.insert(0, "[" + std::to_string(i) + "]");
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename T, typename Alloc>
+struct param_validator<std::vector<T, Alloc>> : sequence_param_validator<T>
+{
+};
+
+template <typename T, typename Alloc>
+struct param_validator<std::list<T, Alloc>> : sequence_param_validator<T>
+{
+};
+
+template <typename T, typename Alloc>
+struct param_validator<std::deque<T, Alloc>> : sequence_param_validator<T>
+{
+};
+
+template <typename T>
+struct map_param_validator
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        if (!json.is_object())
+            return param_mismatch(error, "expected object");
+
+        for (const auto& kv : json.object_items())
+        {
+            if (!param_validator<T>::validate(kv.second, error))
+            {
+                error.path.insert(0, "." + kv.first);
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename T, typename Compare, typename Alloc>
+struct param_validator<std::map<std::string, T, Compare, Alloc>>
+    : map_param_validator<T>
+{
+};
+
+template <typename T, typename Hash, typename Equal, typename Alloc>
+struct param_validator<std::unordered_map<std::string, T, Hash, Equal, Alloc>>
+    : map_param_validator<T>
+{
+};
+
+// Tuples (procedure arguments) can't have more elements than declared. Missing
+// ones are decoded from null, like absent fields of reflectable structs, so
+// trailing optional arguments can be left out.
+template <typename... Ts>
+struct param_validator<std::tuple<Ts...>>
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        if (!json.is_array())
+            return param_mismatch(error, "expected array");
+        if (json.array_items().size() > sizeof...(Ts))
+            return param_mismatch(error, "too many elements");
+        return validate_elements(json, error,
+                                 std::index_sequence_for<Ts...>{});
+    }
+
+private:
+    template <std::size_t... Is>
+    static bool validate_elements(const json11::Json& json,
+                                  wspc::param_error& error,
+                                  std::index_sequence<Is...>)
+    {
+        bool valid = true;
+        using swallow = std::initializer_list<int>;
+        (void)swallow{0, (valid = valid && validate_element<Is>(json, error),
+                          0)...};
+        return valid;
+    }
+
+    template <std::size_t I>
+    static bool validate_element(const json11::Json& json,
+                                 wspc::param_error& error)
+    {
+        using type = std::decay_t<std::tuple_element_t<I, std::tuple<Ts...>>>;
+        if (param_validator<type>::validate(json[I], error))
+            return true;
+        error.path.insert(0, "[" + std::to_string(I) + "]");
+        return false;
+    }
+};
+
+// Reflectable structs are decoded from JSON objects, field by field
+template <typename T>
+struct param_validator<T, std::enable_if_t<kl::is_reflectable<T>::value>>
+{
+    static bool validate(const json11::Json& json, wspc::param_error& error)
+    {
+        if (!json.is_object())
+            return param_mismatch(error, "expected object");
+
+        bool valid = true;
+        kl::ctti::reflect<T>([&](auto fi) {
+            using field_type = std::decay_t<typename decltype(fi)::type>;
+            if (!valid)
+                return;
+            if (!param_validator<field_type>::validate(json[fi.name()],
+                                                       error))
+            {
+                error.path.insert(0, std::string{"."} + fi.name());
+                valid = false;
+            }
+        });
+        return valid;
+    }
+};
+} // namespace detail
+
+// Non-throwing check if params can be decoded into T
+template <typename T>
+bool validate_params(const json11::Json& params, wspc::param_error& error)
+{
+    return detail::param_validator<std::decay_t<T>>::validate(params, error);
+}
+} // namespace wspc
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/replay.hpp"
+#include "wspc/capture.hpp"
+
+#include <ostream>
+#include <unordered_set>
+
+namespace wspc {
+
+double replay_report::throughput() const
+{
+    using seconds = std::chrono::duration<double>;
+    const auto secs = std::chrono::duration_cast<seconds>(elapsed).count();
+    return secs > 0 ? messages / secs : 0.0;
+}
+
+std::ostream& operator<<(std::ostream& os, const replay_report& report)
+{
+    return os << "messages: " << report.messages << ", throughput: "
+              << report.throughput() << " msg/s, latency: " << report.latency;
+}
+
+wspc::replay_report replay(wspc::processor& processor,
+                           const std::string& capture_path)
+{
+    using clock = std::chrono::steady_clock;
+
+    wspc::capture_reader reader{capture_path};
+    wspc::capture_record record;
+    wspc::replay_report report;
+    std::unordered_set<wspc::connection_id> connections;
+
+    const auto start = clock::now();
+    while (reader.next(record))
+    {
+        if (connections.insert(record.connection).second)
+            processor.process_open(record.connection);
+
+        const auto begin = clock::now();
+        processor.process_message(record.connection, record.payload);
+        report.latency.add(clock::now() - begin);
+        ++report.messages;
+    }
+
+    for (const auto id : connections)
+        processor.process_close(id);
+    report.elapsed = clock::now() - start;
+    return report;
+}
+} // namespace wspc
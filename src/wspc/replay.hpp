@@ -0,0 +1,56 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_REPLAY_HPP_GUARD
+#define WSPC_REPLAY_HPP_GUARD
+
+#include "wspc/latency_stats.hpp"
+#include "wspc/transport.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+namespace wspc {
+
+struct replay_report
+{
+    std::size_t messages{0};
+    std::chrono::nanoseconds elapsed{0};
+    // Time spent in process_message() per message
+    wspc::latency_stats latency;
+
+    double throughput() const; // messages per second
+};
+
+std::ostream& operator<<(std::ostream& os, const replay_report& report);
+
+// Feeds every message from given capture file straight into the processor
+// (e.g. wspc::service) as fast as possible, without any networking involved.
+// Connections are opened when their first message is seen and closed after
+// the whole capture has been replayed.
+wspc::replay_report replay(wspc::processor& processor,
+                           const std::string& capture_path);
+} // namespace wspc
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/request_scheduler.hpp"
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace wspc {
+
+class request_scheduler::impl : public std::enable_shared_from_this<impl>
+{
+public:
+    impl(boost::asio::io_service& io_service, std::size_t starvation_limit)
+        : io_service_{io_service}, starvation_limit_{starvation_limit}
+    {
+    }
+
+    void schedule(wspc::handler_priority priority,
+                  wspc::connection_id connection,
+                  std::function<void(wspc::request_guard)> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            const auto lane = static_cast<std::size_t>(priority);
+            const auto seq = next_seq_++;
+            auto& conn = connections_[connection];
+            auto& requests = conn.lanes[lane];
+            if (requests.empty() && !conn.running)
+                ready_[lane].emplace(seq, connection);
+            requests.push_back(queued_request{seq, std::move(task)});
+            ++lane_sizes_[lane];
+            ++size_;
+        }
+        post_run_next();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return size_;
+    }
+
+    bool busy(wspc::connection_id connection) const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        // Connection is forgotten once it has nothing waiting nor running
+        return connections_.count(connection) != 0;
+    }
+
+private:
+    using task_type = std::function<void(wspc::request_guard)>;
+
+    struct request
+    {
+        wspc::connection_id connection;
+        task_type task;
+    };
+
+    static const std::size_t num_lanes = 3;
+
+    struct queued_request
+    {
+        // Order of arrival
+        std::uint64_t seq;
+        task_type task;
+    };
+
+    struct connection_requests
+    {
+        std::array<std::deque<queued_request>, num_lanes> lanes;
+        bool running{false};
+    };
+
+    void post_run_next()
+    {
+        std::weak_ptr<impl> weak = shared_from_this();
+        io_service_.post([weak] {
+            if (auto self = weak.lock())
+                self->run_next();
+        });
+    }
+
+    // There's one run_next() posted per scheduled request, plus one after
+    // every finished request in case others have been waiting for it
+    void run_next()
+    {
+        request next;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (!take_next(next))
+                return;
+        }
+
+        std::weak_ptr<impl> weak = shared_from_this();
+        const auto connection = next.connection;
+        // Unwinding releases it as well
+        wspc::request_guard guard{nullptr, [weak, connection](void*) {
+            if (auto self = weak.lock())
+                self->finish(connection);
+        }};
+        try
+        {
+            next.task(std::move(guard));
+        }
+        catch (...)
+        {
+            // Nobody to tell about it, io_service::run() mustn't throw
+        }
+    }
+
+    void finish(wspc::connection_id connection)
+    {
+        bool waiting;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = connections_.find(connection);
+            auto& conn = it->second;
+            conn.running = false;
+            bool empty = true;
+            for (std::size_t lane = 0; lane < num_lanes; ++lane)
+            {
+                const auto& requests = conn.lanes[lane];
+                if (requests.empty())
+                    continue;
+                ready_[lane].emplace(requests.front().seq, connection);
+                empty = false;
+            }
+            if (empty)
+                connections_.erase(it);
+            waiting = size_ != 0;
+        }
+        if (waiting)
+            post_run_next();
+    }
+
+    // Requires mutex_ to be locked
+    bool take_next(request& next)
+    {
+        // Lowest lane passed over too many times goes first
+        for (std::size_t lane = num_lanes; lane-- > 0;)
+        {
+            if (skipped_[lane] >= starvation_limit_ && take_from(lane, next))
+                return true;
+        }
+        for (std::size_t lane = 0; lane < num_lanes; ++lane)
+        {
+            if (take_from(lane, next))
+                return true;
+        }
+        return false;
+    }
+
+    // Requires mutex_ to be locked
+    bool take_from(std::size_t lane, request& next)
+    {
+        auto& ready = ready_[lane];
+        if (ready.empty())
+            return false;
+
+        // Connection whose request has been waiting the longest
+        const auto connection = ready.begin()->second;
+        ready.erase(ready.begin());
+        auto& conn = connections_[connection];
+        auto& requests = conn.lanes[lane];
+        next = request{connection, std::move(requests.front().task)};
+        requests.pop_front();
+        --lane_sizes_[lane];
+        --size_;
+
+        // Its other requests have to wait till this one is done
+        conn.running = true;
+        for (std::size_t other = 0; other < num_lanes; ++other)
+        {
+            if (other != lane && !conn.lanes[other].empty())
+                ready_[other].erase(conn.lanes[other].front().seq);
+        }
+
+        skipped_[lane] = 0;
+        // Everyone waiting in lower lanes has been passed over
+        for (auto lower = lane + 1; lower < num_lanes; ++lower)
+        {
+            if (lane_sizes_[lower] != 0)
+                ++skipped_[lower];
+        }
+        return true;
+    }
+
+private:
+    boost::asio::io_service& io_service_;
+    const std::size_t starvation_limit_;
+
+    mutable std::mutex mutex_;
+    // Requests of each connection with anything waiting or running
+    std::unordered_map<wspc::connection_id, connection_requests> connections_;
+    // Per lane, connections not running anything with a request waiting in
+    // the lane, keyed by arrival of that request
+    std::array<std::map<std::uint64_t, wspc::connection_id>, num_lanes>
+        ready_;
+    std::array<std::size_t, num_lanes> lane_sizes_{};
+    std::array<std::size_t, num_lanes> skipped_{};
+    std::size_t size_{0};
+    std::uint64_t next_seq_{0};
+};
+
+request_scheduler::request_scheduler(boost::asio::io_service& io_service,
+                                     std::size_t starvation_limit)
+    : impl_{std::make_shared<impl>(io_service, starvation_limit)}
+{
+}
+
+request_scheduler::~request_scheduler() = default;
+
+void request_scheduler::schedule(wspc::handler_priority priority,
+                                 wspc::connection_id connection,
+                                 std::function<void()> task)
+{
+    impl_->schedule(priority, connection,
+                    [task = std::move(task)](wspc::request_guard) { task(); });
+}
+
+void request_scheduler::schedule(
+    wspc::handler_priority priority, wspc::connection_id connection,
+    std::function<void(wspc::request_guard)> task)
+{
+    impl_->schedule(priority, connection, std::move(task));
+}
+
+std::size_t request_scheduler::size() const { return impl_->size(); }
+
+bool request_scheduler::busy(wspc::connection_id connection) const
+{
+    return impl_->busy(connection);
+}
+} // namespace wspc
@@ -0,0 +1,90 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_REQUEST_SCHEDULER_HPP_GUARD
+#define WSPC_REQUEST_SCHEDULER_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <boost/asio/io_service.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace wspc {
+
+// Priority class of a procedure (see service::register_handler)
+enum class handler_priority
+{
+    high,
+    normal,
+    low
+};
+
+// Runs requests on io_service in order of their priority: a waiting request
+// of higher priority is always served before those of lower priority, unless
+// a lower lane has been passed over starvation_limit times in a row - then it
+// gets its turn. Within a lane requests are served in order of arrival.
+//
+// Requests of a single connection are never run concurrently (even if
+// io_service is run by many threads). Hence priority pays off mostly across
+// connections: high priority request overtakes requests of its own
+// connection still waiting in lower lanes, but not the one already running
+// (e.g. a long stream of results).
+//
+// Request is done when its task returns, unless the task keeps a copy of its
+// guard (e.g. for the stream of its results) - then it's done once the last
+// copy is gone. Tasks are expected to report their failures themselves,
+// exceptions escaping them are swallowed (the request is done) so they never
+// reach whoever runs io_service.
+using request_guard = std::shared_ptr<void>;
+
+class request_scheduler
+{
+public:
+    explicit request_scheduler(boost::asio::io_service& io_service,
+                               std::size_t starvation_limit = 16);
+    ~request_scheduler();
+
+    request_scheduler(const request_scheduler&) = delete;
+    request_scheduler& operator=(const request_scheduler&) = delete;
+
+    void schedule(wspc::handler_priority priority,
+                  wspc::connection_id connection, std::function<void()> task);
+    void schedule(wspc::handler_priority priority,
+                  wspc::connection_id connection,
+                  std::function<void(wspc::request_guard)> task);
+
+    // Number of requests waiting to be run
+    std::size_t size() const;
+    // Whether there's a request of given connection waiting or being run
+    bool busy(wspc::connection_id connection) const;
+
+private:
+    class impl;
+    // Shared with handlers posted to io_service so they can outlive us
+    std::shared_ptr<impl> impl_;
+};
+} // namespace wspc
+
+#endif
@@ -21,15 +21,92 @@
  */
 
 #include "wspc/service.hpp"
+#include "wspc/json_rpc.hpp"
+#include "wspc/param_validation.hpp"
+#include "wspc/trace.hpp"
 
+#include <algorithm>
 #include <exception>
-#include <sstream>
+#include <stdexcept>
 
 namespace wspc {
 
+namespace {
+
+// Turns items of a streaming procedure into partial result messages
+// (see wspc::streaming_service_handler)
+class partial_result_stream : public wspc::message_stream
+{
+public:
+    partial_result_stream(json11::Json id, wspc::result_stream_ptr items,
+                          std::size_t chunk_size, wspc::request_guard guard)
+        : id_{std::move(id)},
+          items_{std::move(items)},
+          chunk_size_{chunk_size},
+          guard_{std::move(guard)}
+    {
+    }
+
+    bool next(std::string& payload) override
+    {
+        if (done_)
+            return false;
+
+        json11::Json::array chunk;
+        try
+        {
+            json11::Json item;
+            while (chunk.size() < chunk_size_ && items_->next(item))
+                chunk.push_back(std::move(item));
+        }
+        catch (std::exception& ex)
+        {
+            done_ = true;
+            payload = detail::make_error_response(
+                          id_, detail::fault_code::internal_error, ex.what())
+                          .dump();
+            return true;
+        }
+
+        if (!chunk.empty())
+        {
+            num_items_ += chunk.size();
+            payload = json11::Json{json11::Json::object{
+                                       {"id", id_},
+                                       {"partial", std::move(chunk)},
+                                       {"chunk", num_chunks_++}}}
+                          .dump();
+            return true;
+        }
+
+        done_ = true;
+        payload = json11::Json{
+            json11::Json::object{
+                {"id", id_},
+                {"result",
+                 json11::Json::object{
+                     {"items", static_cast<double>(num_items_)},
+                     {"chunks", num_chunks_}}}}}.dump();
+        return true;
+    }
+
+private:
+    json11::Json id_;
+    wspc::result_stream_ptr items_;
+    std::size_t chunk_size_;
+    std::size_t num_items_{0};
+    int num_chunks_{0};
+    bool done_{false};
+    // Scheduled request is done once the stream is exhausted or dropped
+    // along with its connection
+    wspc::request_guard guard_;
+};
+} // namespace anonymous
+
 service::service()
-    : transport_{std::make_unique<wspc::transport>(*this)},
-      broadcaster_{transport_->get_broadcaster()}
+    : owned_transport_{std::make_unique<wspc::websocket_transport>(*this)},
+      transport_{owned_transport_.get()},
+      route_{transport_}
 {
 }
 
@@ -39,64 +116,95 @@ service::service(std::uint16_t port)
     transport_->accept(port);
 }
 
-std::string service::process_http()
+service::service(boost::asio::io_service& io_service)
+    : owned_transport_{std::make_unique<wspc::websocket_transport>(
+          *this, io_service)},
+      transport_{owned_transport_.get()},
+      route_{transport_}
 {
-    std::stringstream ss;
-    ss <<
-R"(<!doctype html>
-<html><head><title>WebSocket Test Service</title></head>
-<body><p>List of supported remote procedures: </p>
-<ul>)";
-
-    for (const auto& kv : handlers_)
-    {
-        ss << "<li>" << kv.first << ": </li>\n";
-        ss << "<ul><li>takes: " << kv.second->request_description()
-           << "</li>\n";
-        ss << "<li>returns: " << kv.second->response_description()
-           << "</li></ul>\n";
-    }
-
-    ss << "</ul>\n<p>List of supported notifications: </p><ul>\n";
-    for (const auto& desc : event_descriptions_)
-        ss << "<li>" << desc << "</li>\n";
+}
 
-    ss << "</ul>\n</body></html>";
+service::service(boost::asio::io_service& io_service, std::uint16_t port)
+    : service{io_service}
+{
+    transport_->accept(port);
+}
 
-    return ss.str();
+#if defined(WSPC_ENABLE_TLS)
+service::service(boost::asio::io_service& io_service, std::uint16_t port,
+                 const wspc::tls_options& tls)
+    : owned_transport_{std::make_unique<wspc::websocket_transport>(
+          *this, io_service, tls)},
+      transport_{owned_transport_.get()},
+      route_{transport_}
+{
+    transport_->accept(port);
 }
+#endif
 
-namespace {
+service::service(wspc::websocket_transport& transport,
+                 const std::string& path)
+    : transport_{&transport}, route_{&transport.route(path, *this)}
+{
+}
 
-enum class fault_code
+void service::close()
 {
-    parse_error = -32700,
-    invalid_request = -32600,
-    method_not_found = -32601,
-    invalid_params = -32602,
-    internal_error = -32603
-};
+    route_->close();
+    for (auto& transport : transports_)
+        transport->close();
+}
 
-json11::Json make_error_response(const json11::Json& id, fault_code code,
-                                 std::string error_message)
+std::string service::http_content_type(const std::string& resource) const
 {
-    return json11::Json::object{
-        {"id", id},
-        {"error", json11::Json::object{{"code", static_cast<int>(code)},
-                                       {"message", std::move(error_message)}}}};
+    if (!trace_resource_.empty() && resource == trace_resource_)
+        return "application/json";
+    return "text/html";
 }
 
-std::string wrap_response(const json11::Json& response)
+std::string service::process_http(const std::string& resource)
 {
-    static std::string empty;
-    return !response["id"].is_null() ? response.dump() : empty;
+#if defined(WSPC_ENABLE_TRACING)
+    if (!trace_resource_.empty() && resource == trace_resource_)
+        return trace::dump_chrome_trace();
+#else
+    (void)resource;
+#endif
+
+    service_description page;
+    {
+        handler_registry::snapshot handlers{handlers_};
+        for (const auto& kv : *handlers)
+        {
+            const auto& handler = *kv.second.handler;
+            page.add_procedure(kv.first, handler.request_description(),
+                               handler.response_description());
+        }
+    }
+
+    page.begin_section("List of supported notifications: ");
+    for (const auto desc : event_descriptions_)
+        page.add_item(*desc);
+
+    page.begin_section("List of state topics: ");
+    for (const auto desc : state_descriptions_)
+        page.add_item(*desc);
+
+    return page.finish();
 }
-} // namespace anonymous
 
-std::string service::process_message(const std::string& payload)
+std::string service::process_message(wspc::connection_id connection,
+                                     const std::string& payload)
 {
+    using namespace detail;
+
+    WSPC_TRACE_SCOPE(process_span, "process_message");
     std::string err;
-    json11::Json json{json11::Json::parse(payload, err)};
+    json11::Json json;
+    {
+        WSPC_TRACE_SCOPE(parse_span, "parse");
+        json = json11::Json::parse(payload, err);
+    }
 
     if (!err.empty())
     {
@@ -104,64 +212,634 @@ std::string service::process_message(const std::string& payload)
                                    std::move(err))
             .dump();
     }
+
+    // Looked up now so that requests still waiting in the queue when the
+    // connection gets closed get its session anyway
+    auto session = find_session(connection);
+
+    // Once there are prioritized procedures, requests coming from connections
+    // are queued up and their responses sent when they're done
+    if (scheduler_ && connection != no_connection)
+    {
+        const auto priority = request_priority(json);
+        // Joins notifications of the same procedure waiting in the queue
+        if (batching_handler(json))
+        {
+            queue_notification(priority, std::move(session),
+                               json["method"].string_value(), json["params"]);
+            return {};
+        }
+        scheduler_->schedule(
+            priority, connection,
+            [this, session = std::move(session),
+             json = std::move(json)](wspc::request_guard guard) {
+                std::string response;
+                try
+                {
+                    response = process_json(*session, json, guard);
+                }
+                catch (std::exception& ex)
+                {
+                    // Handlers' exceptions are already reported, it's
+                    // something outside of them (e.g. out of memory).
+                    // Notifications don't get a response anyway.
+                    if (json.is_array() || !json["id"].is_null())
+                    {
+                        response =
+                            make_error_response(json["id"],
+                                                fault_code::internal_error,
+                                                ex.what())
+                                .dump();
+                    }
+                }
+                if (!response.empty())
+                    send(session->id(), response);
+            });
+        return {};
+    }
+
+    auto response = process_json(*session, json);
+    if (!response.empty())
+        flush_events();
+    return response;
+}
+
+std::string service::process_json(wspc::session& session,
+                                  const json11::Json& json,
+                                  const wspc::request_guard& guard)
+{
+    using namespace detail;
+
+    if (!json.is_array())
+    {
+        auto response = process_request(session, json, guard);
+        WSPC_TRACE_SCOPE(serialize_span, "serialize");
+        return !response.is_null() ? response.dump() : std::string{};
+    }
+
+    // Batch: responses to all requests except notifications are sent back
+    // together, in any order
+    if (json.array_items().empty())
+    {
+        return make_error_response(nullptr, fault_code::invalid_request,
+                                   "empty batch")
+            .dump();
+    }
+
+    json11::Json::array responses;
+    // Notifications for handlers taking them in batches
+    std::unordered_map<std::shared_ptr<wspc::service_handler>,
+                       std::vector<json11::Json>>
+        notifications;
+    for (const auto& request : json.array_items())
+    {
+        if (auto handler = batching_handler(request))
+        {
+            notifications[std::move(handler)].push_back(request["params"]);
+            continue;
+        }
+        auto response = process_request(session, request, guard);
+        if (!response.is_null())
+            responses.push_back(std::move(response));
+    }
+    for (auto& kv : notifications)
+        notify_batch(*kv.first, session, std::move(kv.second));
+
+    WSPC_TRACE_SCOPE(serialize_span, "serialize");
+    return !responses.empty() ? json11::Json{std::move(responses)}.dump()
+                              : std::string{};
+}
+
+json11::Json service::process_request(wspc::session& session,
+                                      const json11::Json& json,
+                                      const wspc::request_guard& guard)
+{
+    using namespace detail;
+
+    WSPC_TRACE_SCOPE(request_span, "request");
+    std::string err;
     // Check for existance of 'method' string value
     if (!json.has_shape({{"method", json11::Json::STRING}}, err))
     {
         return make_error_response(nullptr, fault_code::invalid_request,
-                                   std::move(err))
-            .dump();
+                                   std::move(err));
     }
 
     const auto& id = json["id"];
     const auto& method = json["method"].string_value();
+    WSPC_TRACE_METHOD(request_span, method);
+    WSPC_TRACE_ID(request_span, id.dump());
 
-    auto handler_ = handlers_.find(method);
-    if (handler_ == end(handlers_))
+    // Notifications (requests without an id) don't get any response so
+    // there's no point in building one
+    if (id.is_null())
     {
-        std::string msg;
-        msg.reserve(strlen("procedure '") + method.length() +
-                    strlen("' not found"));
-        msg += "procedure '";
-        msg += method;
-        msg += "' not found";
-        return wrap_response(make_error_response(
-            id, fault_code::method_not_found, std::move(msg)));
+        process_notification(session, method, json["params"]);
+        return {};
     }
 
+    // Keeps the handler alive even if it's unregistered meanwhile
+    const auto entry = handlers_.find(method);
+    if (!entry.handler)
+        return make_method_not_found_response(id, method);
+
     try
     {
-        auto& handler = *handler_->second;
+        auto& handler = *entry.handler;
         const auto& params = json["params"];
         // If params is an object we treat them as a struct (we can get fields
         // names in reflectable struct in contrast to function/lambdas
         // arguments)
         if (params.is_object() || params.is_array())
         {
-            return wrap_response(
-                json11::Json::object{{"result", handler(params)}, {"id", id}});
+            // Malformed params are reported without going through the
+            // exception path of deserializer
+            param_error error;
+            if (!handler.validate(params, error))
+                return make_invalid_params_response(id, error);
+
+            // Results of streaming procedures are sent later on as they're
+            // produced, unless there's no one to send them to
+            if (connected(session.id()))
+            {
+                if (auto items = handler.open_stream(params))
+                {
+                    stream(session.id(),
+                           std::make_unique<partial_result_stream>(
+                               id, std::move(items), handler.chunk_size(),
+                               guard));
+                    return {};
+                }
+            }
+
+            json11::Json result;
+            {
+                WSPC_TRACE_SCOPE(handler_span, "handler");
+                result = handler.invoke(session, params);
+            }
+            return json11::Json::object{{"result", std::move(result)},
+                                        {"id", id}};
         }
         else
         {
-            return wrap_response(make_error_response(
+            return make_error_response(
                 id, fault_code::invalid_params,
-                "wrong type of 'params' - expected array or object"));
+                "wrong type of 'params' - expected array or object");
         }
     }
     catch (invalid_parameters_exception& ex)
     {
-        return wrap_response(
-            make_error_response(id, fault_code::invalid_params, ex.what()));
+        return make_error_response(id, fault_code::invalid_params, ex.what());
     }
     catch (std::exception& ex)
     {
-        return wrap_response(
-            make_error_response(id, fault_code::internal_error, ex.what()));
+        return make_error_response(id, fault_code::internal_error, ex.what());
     }
 }
 
+void service::process_notification(wspc::session& session,
+                                   const std::string& method,
+                                   const json11::Json& params)
+{
+    // Same checks as for requests, only failures aren't reported
+    const auto entry = handlers_.find(method);
+    if (!entry.handler || (!params.is_object() && !params.is_array()))
+        return;
+    auto& handler = *entry.handler;
+    param_error error;
+    if (!handler.validate(params, error))
+        return;
+
+    try
+    {
+        WSPC_TRACE_SCOPE(handler_span, "handler");
+        handler.notify(session, params);
+    }
+    catch (std::exception&)
+    {
+        // Nobody to tell about it
+    }
+}
+
+std::shared_ptr<wspc::service_handler>
+    service::batching_handler(const json11::Json& json) const
+{
+    if (!json.is_object() || !json["id"].is_null() ||
+        !json["method"].is_string())
+    {
+        return nullptr;
+    }
+    auto entry = handlers_.find(json["method"].string_value());
+    if (!entry.handler || !entry.handler->batches_notifications())
+        return nullptr;
+    return std::move(entry.handler);
+}
+
+void service::notify_batch(wspc::service_handler& handler,
+                           wspc::session& session,
+                           std::vector<json11::Json> params)
+{
+    // Invalid ones are dropped without failing the rest
+    params.erase(std::remove_if(begin(params), end(params),
+                                [&](const json11::Json& p) {
+                                    param_error error;
+                                    return (!p.is_object() && !p.is_array()) ||
+                                           !handler.validate(p, error);
+                                }),
+                 end(params));
+    if (params.empty())
+        return;
+
+    try
+    {
+        WSPC_TRACE_SCOPE(handler_span, "handler");
+        handler.notify_batch(session, params.data(), params.size());
+    }
+    catch (std::exception&)
+    {
+        // Nobody to tell about it
+    }
+}
+
+void service::queue_notification(wspc::handler_priority priority,
+                                 std::shared_ptr<wspc::session> session,
+                                 const std::string& method,
+                                 const json11::Json& params)
+{
+    const auto connection = session->id();
+    auto key = std::make_pair(method, connection);
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock{notifications_mutex_};
+        auto& queued = queued_notifications_[key];
+        first = queued.empty();
+        queued.push_back(params);
+    }
+    if (!first)
+        return;
+
+    // Whatever has been queued by the time it's run goes in one batch
+    scheduler_->schedule(priority, connection, [this, key, session] {
+        std::vector<json11::Json> batch;
+        {
+            std::lock_guard<std::mutex> lock{notifications_mutex_};
+            auto it = queued_notifications_.find(key);
+            batch = std::move(it->second);
+            queued_notifications_.erase(it);
+        }
+
+        // Procedure might have been unregistered or given another handler
+        // while they were waiting
+        const auto entry = handlers_.find(key.first);
+        if (!entry.handler)
+            return;
+        if (entry.handler->batches_notifications())
+        {
+            notify_batch(*entry.handler, *session, std::move(batch));
+            return;
+        }
+        for (const auto& params : batch)
+            process_notification(*session, key.first, params);
+    });
+}
+
+void service::process_open(wspc::connection_id id)
+{
+    {
+        std::lock_guard<std::shared_timed_mutex> lock{sessions_mutex_};
+        sessions_[id] = std::make_shared<wspc::session>(id);
+    }
+
+    std::lock_guard<std::mutex> lock{states_mutex_};
+    for (const auto& kv : states_)
+    {
+        json11::Json::object snapshot{{"method", kv.first},
+                                      {"params", kv.second}};
+        // Patches with sequence number up to this one are already included
+        // in the snapshot
+        if (event_log_)
+        {
+            snapshot["seq"] = static_cast<double>(event_log_->last_seq());
+            snapshot["epoch"] = static_cast<double>(event_log_->epoch());
+        }
+        send(id, json11::Json{std::move(snapshot)}.dump());
+    }
+}
+
+void service::process_close(wspc::connection_id id)
+{
+    std::shared_ptr<wspc::session> session;
+    {
+        std::lock_guard<std::shared_timed_mutex> lock{sessions_mutex_};
+        auto it = sessions_.find(id);
+        if (it == end(sessions_))
+            return;
+        session = std::move(it->second);
+        sessions_.erase(it);
+    }
+    // Unless some request of this connection is still being handled, session
+    // (with all its values) is destroyed here, outside of the lock
+}
+
+bool service::busy(wspc::connection_id id) const
+{
+    // Otherwise requests are responded to before process_message() returns
+    return scheduler_ && scheduler_->busy(id);
+}
+
+std::shared_ptr<wspc::session>
+    service::find_session(wspc::connection_id id) const
+{
+    if (id != no_connection)
+    {
+        std::shared_lock<std::shared_timed_mutex> lock{sessions_mutex_};
+        auto it = sessions_.find(id);
+        if (it != end(sessions_))
+            return it->second;
+    }
+    // Requests from outside of any connection get a fresh one, as do ones
+    // racing with the close of their connection (nobody would ever read
+    // what's stored there anyway)
+    return std::make_shared<wspc::session>(id);
+}
+
+void service::broadcast_event(json11::Json::object event)
+{
+    if (!event_log_ && !batch_timer_)
+    {
+        if (num_clients() == 0)
+            return;
+        broadcast_payload(json11::Json{std::move(event)}.dump());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{broadcast_mutex_};
+    const bool immediate =
+        !batch_timer_ ||
+        immediate_events_.count(event["method"].string_value()) != 0;
+    auto payload = event_log_ ? event_log_->append(std::move(event))
+                              : json11::Json{std::move(event)}.dump();
+
+    if (immediate)
+    {
+        // Keep the order events were broadcast in
+        flush_batch();
+        if (num_clients() != 0)
+            broadcast_payload(payload);
+        return;
+    }
+
+    batch_.push_back(std::move(payload));
+    if (batch_.size() >= batch_max_events_)
+    {
+        flush_batch();
+    }
+    else if (batch_.size() == 1)
+    {
+        // Handler might have been already queued when the batch it was meant
+        // for got flushed, it mustn't flush the next one prematurely
+        const auto generation = batch_generation_;
+        batch_timer_->expires_from_now(batch_window_);
+        batch_timer_->async_wait(
+            [this, generation](const boost::system::error_code& ec) {
+                if (ec)
+                    return;
+                std::lock_guard<std::mutex> lock{broadcast_mutex_};
+                if (generation == batch_generation_)
+                    flush_batch();
+            });
+    }
+}
+
+void service::flush_events()
+{
+    if (!batch_timer_)
+        return;
+    std::lock_guard<std::mutex> lock{broadcast_mutex_};
+    flush_batch();
+}
+
+void service::flush_batch()
+{
+    if (batch_.empty())
+        return;
+
+    batch_timer_->cancel();
+    ++batch_generation_;
+    if (num_clients() != 0)
+    {
+        if (batch_.size() == 1)
+        {
+            broadcast_payload(batch_.front());
+        }
+        else
+        {
+            std::size_t size = batch_.size() + 1;
+            for (const auto& payload : batch_)
+                size += payload.size();
+
+            std::string frame;
+            frame.reserve(size);
+            frame += '[';
+            for (const auto& payload : batch_)
+            {
+                if (frame.size() > 1)
+                    frame += ',';
+                frame += payload;
+            }
+            frame += ']';
+            broadcast_payload(frame);
+        }
+    }
+    batch_.clear();
+}
+
+void service::enable_broadcast_batching(
+    std::chrono::steady_clock::duration window, std::size_t max_events)
+{
+    batch_timer_ =
+        std::make_unique<boost::asio::steady_timer>(get_io_service());
+    batch_window_ = window;
+    batch_max_events_ = max_events != 0 ? max_events : 1;
+}
+
+void service::stream(wspc::connection_id id, wspc::message_stream_ptr stream)
+{
+    flush_events();
+    if (route_->connected(id))
+    {
+        route_->stream(id, std::move(stream));
+        return;
+    }
+    for (auto& transport : transports_)
+    {
+        if (transport->connected(id))
+        {
+            transport->stream(id, std::move(stream));
+            return;
+        }
+    }
+}
+
+void service::send(wspc::connection_id id, const std::string& payload)
+{
+    flush_events();
+    if (route_->send(id, payload))
+        return;
+    for (auto& transport : transports_)
+    {
+        if (transport->send(id, payload))
+            return;
+    }
+}
+
+void service::broadcast_payload(const std::string& payload)
+{
+    route_->broadcast(payload);
+    for (auto& transport : transports_)
+        transport->broadcast(payload);
+}
+
+bool service::connected(wspc::connection_id id) const
+{
+    if (route_->connected(id))
+        return true;
+    for (const auto& transport : transports_)
+    {
+        if (transport->connected(id))
+            return true;
+    }
+    return false;
+}
+
+int service::num_clients() const
+{
+    int num = route_->num_clients();
+    for (const auto& transport : transports_)
+        num += transport->num_clients();
+    return num;
+}
+
+namespace {
+
+// Returns events broadcast after given sequence number of given epoch
+class resume_handler : public wspc::service_handler
+{
+public:
+    explicit resume_handler(const wspc::event_log& log) : log_{log} {}
+
+    json11::Json operator()(const json11::Json& request) override
+    {
+        const auto& epoch = request.is_array() ? request[0] : request["epoch"];
+        const auto& last_seq =
+            request.is_array() ? request[1] : request["last_seq"];
+        if (!epoch.is_number() || epoch.number_value() < 0 ||
+            !last_seq.is_number() || last_seq.number_value() < 0)
+        {
+            throw invalid_parameters_exception{
+                "invalid method params: expected epoch and last seen "
+                "sequence number"};
+        }
+
+        json11::Json::array events;
+        // If some events have been already dropped (or the log has started
+        // a new history) client needs to reload its state the usual way
+        const bool complete =
+            log_.since(static_cast<std::uint64_t>(epoch.number_value()),
+                       static_cast<std::uint64_t>(last_seq.number_value()),
+                       events);
+        return json11::Json::object{
+            {"events", std::move(events)},
+            {"complete", complete},
+            {"epoch", static_cast<double>(log_.epoch())}};
+    }
+
+    const std::string& request_description() const override
+    {
+        static const std::string description{
+            "{ epoch :: uint64, last_seq :: uint64 }"};
+        return description;
+    }
+
+    const std::string& response_description() const override
+    {
+        static const std::string description{
+            "{ events :: [ event ], complete :: bool, epoch :: uint64 }"};
+        return description;
+    }
+
+private:
+    const wspc::event_log& log_;
+};
+} // namespace anonymous
+
+void service::enable_event_log(std::size_t capacity)
+{
+    event_log_ = std::make_unique<wspc::event_log>(capacity);
+    register_handler("resume", std::make_unique<resume_handler>(*event_log_));
+}
+
+void service::enable_event_log(std::size_t capacity,
+                               const std::string& segment_path,
+                               std::size_t segment_size)
+{
+    event_log_ = std::make_unique<wspc::event_log>(capacity, segment_path,
+                                                   segment_size);
+    register_handler("resume", std::make_unique<resume_handler>(*event_log_));
+}
+
+void service::enable_trace_endpoint(const std::string& resource)
+{
+#if defined(WSPC_ENABLE_TRACING)
+    if (resource.empty())
+        throw std::invalid_argument{"trace resource must not be empty"};
+    trace_resource_ = resource;
+#else
+    (void)resource;
+    throw std::logic_error{"wspc has been built without tracing"};
+#endif
+}
+
 void service::register_handler(const std::string& procedureName,
                                wspc::service_handler_ptr handler)
 {
-    handlers_[procedureName] = std::move(handler);
+    register_handler(procedureName, std::move(handler),
+                     handler_priority::normal);
+}
+
+void service::register_handler(const std::string& procedure_name,
+                               wspc::service_handler_ptr handler,
+                               wspc::handler_priority priority)
+{
+    if (priority != handler_priority::normal && !scheduler_)
+    {
+        scheduler_ =
+            std::make_unique<wspc::request_scheduler>(get_io_service());
+    }
+    handlers_.insert(procedure_name,
+                     handler_registry::entry{std::move(handler), priority});
+}
+
+bool service::unregister_handler(const std::string& procedure_name)
+{
+    return handlers_.erase(procedure_name);
+}
+
+wspc::handler_priority
+    service::request_priority(const json11::Json& json) const
+{
+    auto priority_of = [this](const json11::Json& request) {
+        return handlers_.find(request["method"].string_value()).priority;
+    };
+
+    if (!json.is_array())
+        return priority_of(json);
+
+    // Batch goes with its least urgent request so that bulk work can't jump
+    // the queue along with a control call
+    auto priority = handler_priority::high;
+    for (const auto& request : json.array_items())
+        priority = std::max(priority, priority_of(request));
+    return priority;
 }
 } // namespace wspc
@@ -23,16 +23,32 @@
 #ifndef WSPC_SERVICE_HPP_GUARD
 #define WSPC_SERVICE_HPP_GUARD
 
-#include "wspc/transport.hpp"
+#include "wspc/websocket_transport.hpp"
+#include "wspc/event_log.hpp"
+#include "wspc/handler_registry.hpp"
+#include "wspc/request_scheduler.hpp"
 #include "wspc/service_handler.hpp"
+#include "wspc/session.hpp"
 #include "wspc/type_description.hpp"
 
 #include <kl/ctti.hpp>
 #include <kl/json_convert.hpp>
 
+#include <boost/asio/steady_timer.hpp>
+
 #include <vector>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
 
 namespace wspc {
 
@@ -42,44 +58,293 @@ class service : public wspc::processor
 public:
     service();
     explicit service(std::uint16_t port);
+    // Runs on caller-provided io_service (see websocket_transport). Handlers
+    // must be thread-safe if it's run by more than one thread.
+    explicit service(boost::asio::io_service& io_service);
+    service(boost::asio::io_service& io_service, std::uint16_t port);
+#if defined(WSPC_ENABLE_TLS)
+    // Serves WebSocket clients over TLS (wss://)
+    service(boost::asio::io_service& io_service, std::uint16_t port,
+            const wspc::tls_options& tls);
+#endif
+    // Serves clients connecting to given path of a transport shared with
+    // other services (see websocket_transport::route). Accepting, I/O loop
+    // and WebSocket connection settings are then the transport's, shared by
+    // all its services. Must be constructed before the transport starts
+    // accepting connections.
+    service(wspc::websocket_transport& transport, const std::string& path);
 
     void run(std::uint16_t port) { transport_->run(port); }
     void update() { transport_->poll(); }
-    void close() { transport_->close(); }
+    // Budgeted version of update() for frame loops, see
+    // websocket_transport::poll()
+    bool update(std::size_t max_messages,
+                std::chrono::steady_clock::duration max_duration)
+    {
+        return transport_->poll(max_messages, max_duration);
+    }
+    int poll_descriptor() const { return transport_->poll_descriptor(); }
+
+    boost::asio::io_service& get_io_service()
+    {
+        return transport_->get_io_service();
+    }
+    void close();
+
+    // Zero-downtime restart: new instance of the server listens on the same
+    // port (with reuse_port) or takes over the listening socket of the old
+    // one (see listen_descriptor() and adopt_listener()) while the old one
+    // drains its clients (see websocket_transport::drain)
+    void accept(std::uint16_t port, bool reuse_port)
+    {
+        transport_->accept(port, reuse_port);
+    }
+    void adopt_listener(int fd) { transport_->adopt_listener(fd); }
+    int listen_descriptor() const { return transport_->listen_descriptor(); }
+    void drain(std::chrono::steady_clock::duration window,
+               std::function<void()> done = {})
+    {
+        transport_->drain(window, std::move(done));
+    }
+
+    // Serve clients over additional transport (e.g. wspc::unix_transport)
+    // running on service's io_service. Must be called before service starts
+    // processing messages.
+    template <typename Transport, typename... Args>
+    Transport& add_transport(Args&&... args)
+    {
+        auto transport = std::make_unique<Transport>(
+            *this, get_io_service(), std::forward<Args>(args)...);
+        auto& ref = *transport;
+        transports_.push_back(std::move(transport));
+        return ref;
+    }
+
+    // Record every incoming message to given file so the traffic can be
+    // replayed later on (see wspc::replay and wspc_replay tool)
+    void capture(const std::string& path) { transport_->capture(path); }
+
+    // Evict dead and idle WebSocket clients, see
+    // websocket_transport::set_keepalive
+    void enable_keepalive(std::chrono::steady_clock::duration ping_interval,
+                          std::chrono::steady_clock::duration pong_timeout,
+                          std::chrono::steady_clock::duration idle_timeout)
+    {
+        transport_->set_keepalive(ping_interval, pong_timeout, idle_timeout);
+    }
+    wspc::keepalive_stats get_keepalive_stats() const
+    {
+        return transport_->get_keepalive_stats();
+    }
+
+    // Close WebSocket clients sending messages bigger than max_message_size
+    // or leaving more than max_buffered_amount unread (zero - no limit)
+    void limit_connections(std::size_t max_message_size,
+                           std::size_t max_buffered_amount)
+    {
+        transport_->set_max_message_size(max_message_size);
+        transport_->set_max_buffered_amount(max_buffered_amount);
+    }
 
     // Broadcast given event for all listening clients
     template <typename Event>
     void broadcast(Event&& event)
     {
-        if (transport_->num_clients() == 0)
+        // Events are logged even if there's no one to listen to them
+        if (!event_log_ && num_clients() == 0)
             return;
 
-        const auto event_json = json11::Json{json11::Json::object{
-            {"method", kl::ctti::name<Event>()},
-            {"params", kl::to_json(std::forward<Event>(event))}}};
-        broadcaster_.broadcast(event_json.dump());
+        broadcast_event(json11::Json::object{
+            {"method", kl::ctti::name<std::decay_t<Event>>()},
+            {"params", kl::to_json(std::forward<Event>(event))}});
     }
 
-    // Register handler for given, named procedure
+    // Start numbering broadcast events and keep the last 'capacity' of them
+    // so that reconnecting clients can call 'resume' procedure with the epoch
+    // and the last sequence number they've seen and get only what they've
+    // missed (see wspc::event_log). Must be called before service starts
+    // processing messages.
+    void enable_event_log(std::size_t capacity);
+    // Additionally persist events to memory-mapped segment file
+    void enable_event_log(std::size_t capacity,
+                          const std::string& segment_path,
+                          std::size_t segment_size);
+
+    // Serve spans recorded so far (see wspc::trace) as Chrome trace under
+    // given HTTP resource, e.g. "/trace". Anyone who can reach the service
+    // can fetch them, so pick a resource of an admin-only route or port.
+    // Throws if the library has been built without WSPC_ENABLE_TRACING. Must
+    // be called before service starts processing messages.
+    void enable_trace_endpoint(const std::string& resource);
+
+    // Register handler for given, named procedure, replacing the previous
+    // one if any. Handlers can be (un)registered at any time, also while
+    // requests are being served (see handler_registry).
     void register_handler(const std::string& procedure_name,
                           wspc::service_handler_ptr handler);
+    // Requests of high priority procedures (e.g. health checks) are served
+    // before any waiting requests of normal and low priority ones. Registering
+    // any procedure with non-normal priority makes the service queue up
+    // requests and respond to them asynchronously (see request_scheduler).
+    // The first such registration must happen before service starts
+    // processing messages.
+    void register_handler(const std::string& procedure_name,
+                          wspc::service_handler_ptr handler,
+                          wspc::handler_priority priority);
+    // Requests already being handled complete normally. Returns false if
+    // there's no such procedure.
+    bool unregister_handler(const std::string& procedure_name);
 
+    // Immediate events are never batched (see enable_broadcast_batching())
     template <typename Event>
-    void register_event()
+    void register_event(bool immediate = false)
+    {
+        event_descriptions_.push_back(&get_type_info<Event>());
+        if (immediate)
+            immediate_events_.insert(kl::ctti::name<Event>());
+    }
+
+    // Coalesce events (and state patches) broadcast within given window into
+    // a single frame holding JSON array of them. Batch is flushed when the
+    // window elapses or when it reaches max_events, whatever comes first.
+    // Immediate event flushes the pending batch and is sent right after it.
+    // So does every response (and stream of partial results), it never
+    // overtakes events broadcast before it. Must be called before service
+    // starts broadcasting.
+    void enable_broadcast_batching(std::chrono::steady_clock::duration window,
+                                   std::size_t max_events);
+
+    // Publish new value of a state topic. Service keeps the last published
+    // value of every state type: newly connected clients get a full snapshot
+    // ({"method": name, "params": {...}}) and everyone else only fields that
+    // changed since the previous value ({"method": name, "patch": {...}}).
+    template <typename State>
+    void publish_state(const State& state)
     {
-        event_descriptions_.push_back(get_type_info<Event>());
+        static_assert(kl::is_reflectable<State>::value,
+                      "State needs to be a reflectable type");
+
+        json11::Json::object patch;
+        std::lock_guard<std::mutex> lock{states_mutex_};
+        auto& last = states_[kl::ctti::name<State>()];
+        kl::ctti::reflect(state, [&](auto fi) {
+            auto value = kl::to_json(fi.get());
+            auto& last_value = last[fi.name()];
+            if (last_value != value)
+            {
+                patch[fi.name()] = value;
+                last_value = std::move(value);
+            }
+        });
+
+        if (patch.empty())
+            return;
+
+        broadcast_event(json11::Json::object{
+            {"method", kl::ctti::name<State>()}, {"patch", std::move(patch)}});
+    }
+
+    template <typename State>
+    void register_state()
+    {
+        state_descriptions_.push_back(&get_type_info<State>());
     }
 
 private:
     // "wspc::processor" interface implementation
-    std::string process_http() override;
-    std::string process_message(const std::string& payload) override;
+    std::string process_http(const std::string& resource) override;
+    std::string http_content_type(const std::string& resource) const override;
+    std::string process_message(wspc::connection_id id,
+                                const std::string& payload) override;
+    void process_open(wspc::connection_id id) override;
+    void process_close(wspc::connection_id id) override;
+    bool busy(wspc::connection_id id) const override;
+
+    // Streams of results keep a copy of the guard (if any) of the scheduled
+    // request they come from
+    std::string process_json(wspc::session& session,
+                             const json11::Json& json,
+                             const wspc::request_guard& guard = nullptr);
+    wspc::handler_priority request_priority(const json11::Json& json) const;
+    // Returns null for notifications and streamed results
+    json11::Json process_request(wspc::session& session,
+                                 const json11::Json& json,
+                                 const wspc::request_guard& guard);
+    void process_notification(wspc::session& session,
+                              const std::string& method,
+                              const json11::Json& params);
+    // Returns handler of given notification if it takes them in batches
+    std::shared_ptr<wspc::service_handler>
+        batching_handler(const json11::Json& json) const;
+    void notify_batch(wspc::service_handler& handler, wspc::session& session,
+                      std::vector<json11::Json> params);
+    void queue_notification(wspc::handler_priority priority,
+                            std::shared_ptr<wspc::session> session,
+                            const std::string& method,
+                            const json11::Json& params);
+
+    std::shared_ptr<wspc::session> find_session(wspc::connection_id id) const;
+
+    void broadcast_event(json11::Json::object event);
+    // Sends pending batch of events (if any). Called before responses so
+    // clients never get a response before events broadcast earlier.
+    void flush_events();
+    // Requires broadcast_mutex_ to be locked
+    void flush_batch();
+
+    // Operations spanning all transports
+    void send(wspc::connection_id id, const std::string& payload);
+    void stream(wspc::connection_id id, wspc::message_stream_ptr stream);
+    void broadcast_payload(const std::string& payload);
+    int num_clients() const;
+    bool connected(wspc::connection_id id) const;
 
 private:
-    std::unique_ptr<wspc::transport> transport_;
-    wspc::broadcaster broadcaster_;
-    std::unordered_map<std::string, wspc::service_handler_ptr> handlers_;
-    std::vector<std::string> event_descriptions_;
+    // Null if transport is shared with other services
+    std::unique_ptr<wspc::websocket_transport> owned_transport_;
+    wspc::websocket_transport* transport_;
+    // Connections of this service: all of transport_ or only of its route
+    wspc::transport* route_;
+    // Additional transports
+    std::vector<std::unique_ptr<wspc::transport>> transports_;
+    wspc::handler_registry handlers_;
+    std::unique_ptr<wspc::request_scheduler> scheduler_;
+    // Params of notifications waiting in the scheduler's queue, by procedure
+    // and connection (see notification_batch_handler). Batches don't mix
+    // connections so that one connection's notifications are never run
+    // concurrently with its other requests.
+    std::mutex notifications_mutex_;
+    std::map<std::pair<std::string, wspc::connection_id>,
+             std::vector<json11::Json>>
+        queued_notifications_;
+    // Point to descriptions cached by get_type_info<T>()
+    std::vector<const std::string*> event_descriptions_;
+    std::vector<const std::string*> state_descriptions_;
+
+    // Sessions of connected clients. Handlers hold on to a session while
+    // they use it so it's fine for a client to disconnect meanwhile.
+    mutable std::shared_timed_mutex sessions_mutex_;
+    std::unordered_map<wspc::connection_id, std::shared_ptr<wspc::session>>
+        sessions_;
+
+    std::mutex states_mutex_;
+    std::map<std::string, json11::Json::object> states_;
+
+    // Guards order of sequence numbers being the same as order of sending
+    // and the pending batch
+    std::mutex broadcast_mutex_;
+    std::unique_ptr<wspc::event_log> event_log_;
+    // Empty if trace isn't served
+    std::string trace_resource_;
+
+    std::unordered_set<std::string> immediate_events_;
+    std::unique_ptr<boost::asio::steady_timer> batch_timer_;
+    std::chrono::steady_clock::duration batch_window_{};
+    std::size_t batch_max_events_{0};
+    // Serialized events waiting to be flushed
+    std::vector<std::string> batch_;
+    // Incremented by every flush
+    std::uint64_t batch_generation_{0};
 };
 } // namespace wspc
 
@@ -21,12 +21,61 @@
  */
 
 #include "wspc/service_handler.hpp"
+#include "wspc/session.hpp"
+
+#include <kl/json_convert.hpp>
 
 namespace wspc {
 
+result_stream::~result_stream() = default;
+
 service_handler::~service_handler() = default;
 
-std::string service_handler::request_description() const { return {}; }
+json11::Json service_handler::invoke(wspc::session&,
+                                     const json11::Json& request)
+{
+    return (*this)(request);
+}
+
+void service_handler::notify(wspc::session& session,
+                             const json11::Json& request)
+{
+    invoke(session, request);
+}
+
+bool service_handler::takes_session() const { return false; }
+
+bool service_handler::batches_notifications() const { return false; }
+
+void service_handler::notify_batch(wspc::session& session,
+                                   const json11::Json* requests,
+                                   std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        notify(session, requests[i]);
+}
+
+const std::string& service_handler::request_description() const
+{
+    static const std::string empty;
+    return empty;
+}
+
+const std::string& service_handler::response_description() const
+{
+    static const std::string empty;
+    return empty;
+}
+
+wspc::result_stream_ptr service_handler::open_stream(const json11::Json&)
+{
+    return nullptr;
+}
+
+std::size_t service_handler::chunk_size() const { return 1; }
 
-std::string service_handler::response_description() const { return {}; }
+bool service_handler::validate(const json11::Json&, wspc::param_error&) const
+{
+    return true;
+}
 } // namespace wspc
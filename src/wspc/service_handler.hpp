@@ -26,21 +26,67 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <cstddef>
 
 // Forward declaration
 namespace json11 { class Json; }
 
 namespace wspc {
 
+struct param_error;
+class session;
+
+// Result of streaming procedure produced item by item
+class result_stream
+{
+public:
+    virtual ~result_stream();
+    // Returns false when there are no more items
+    virtual bool next(json11::Json& item) = 0;
+};
+
+using result_stream_ptr = std::unique_ptr<result_stream>;
+
 // Base class for named handlers for RPC service
 class service_handler
 {
 public:
     virtual ~service_handler();
     virtual json11::Json operator()(const json11::Json& request) = 0;
+    // Called by the service with session of requesting connection. Handlers
+    // interested in it (see make_service_handler) override this one.
+    virtual json11::Json invoke(wspc::session& session,
+                                const json11::Json& request);
+    // Called for notifications (requests without an id). Since nobody is
+    // waiting for the result typed handlers don't even serialize it.
+    virtual void notify(wspc::session& session, const json11::Json& request);
+    // Whether invoke() makes use of the session, i.e. the result may depend
+    // on the requesting connection. Handlers overriding invoke() to do so
+    // should return true.
+    virtual bool takes_session() const;
+
+    // Handlers returning true here get notifications of their procedure
+    // passed together to notify_batch() whenever there's more than one at
+    // hand (see wspc::notification_batch_handler). Batch never spans
+    // connections, session is the one of connection they all come from.
+    virtual bool batches_notifications() const;
+    virtual void notify_batch(wspc::session& session,
+                              const json11::Json* requests, std::size_t count);
+
+    // Descriptions are expected to outlive the handler (e.g. the ones
+    // returned by get_type_info<T>())
+    virtual const std::string& request_description() const;
+    virtual const std::string& response_description() const;
+
+    // Streaming handlers (see wspc::streaming_service_handler) return
+    // non-null stream here. Its items are sent in chunks of chunk_size().
+    virtual wspc::result_stream_ptr open_stream(const json11::Json& request);
+    virtual std::size_t chunk_size() const;
 
-    virtual std::string request_description() const;
-    virtual std::string response_description() const;
+    // Checks, without throwing, if request can be decoded. On failure fills
+    // in the error (with path to offending value) and returns false.
+    virtual bool validate(const json11::Json& request,
+                          wspc::param_error& error) const;
 };
 
 using service_handler_ptr = std::unique_ptr<service_handler>;
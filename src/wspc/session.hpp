@@ -0,0 +1,122 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_SESSION_HPP_GUARD
+#define WSPC_SESSION_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <memory>
+#include <mutex>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+
+namespace wspc {
+
+// Per-connection context passed to handlers taking wspc::session& as their
+// first argument (and to batches of notifications). Created when a client
+// connects and destroyed when it disconnects and its requests still being
+// processed are done, along with everything stored in it. Requests coming
+// from outside of any connection (e.g. HTTP POST) get a fresh, empty session
+// each time.
+//
+// Storage itself is guarded by a mutex, values stored in it are not. Requests
+// of a connection usually don't overlap, but they can: when the service's
+// io_service is run by many threads or when streamed results (see
+// streaming_service_handler) are still being produced while its next request
+// is processed. Values shared with such code need their own locking.
+class session
+{
+public:
+    explicit session(wspc::connection_id id);
+    ~session();
+
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+    wspc::connection_id id() const { return id_; }
+
+    // Typed storage holding at most one value of each type. Value is default
+    // constructed on first access. Returned references stay valid until the
+    // value is replaced or erased.
+    template <typename T>
+    T& get()
+    {
+        if (auto value = find<T>())
+            return *value;
+        // Constructed outside of the lock, it may use the session as well
+        auto value = std::make_shared<T>();
+        std::lock_guard<std::mutex> lock{mutex_};
+        // Whoever got here first wins
+        auto& stored = *values_.emplace(typeid(T), std::move(value)).first;
+        return *static_cast<T*>(stored.second.get());
+    }
+
+    // Returns nullptr if there's no value of given type
+    template <typename T>
+    T* find()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = values_.find(typeid(T));
+        return it != end(values_) ? static_cast<T*>(it->second.get())
+                                  : nullptr;
+    }
+
+    // Replaces value of given type, if any
+    template <typename T, typename... Args>
+    T& emplace(Args&&... args)
+    {
+        auto value = std::make_shared<T>(std::forward<Args>(args)...);
+        auto& ref = *value;
+        std::shared_ptr<void> old;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            old = std::exchange(values_[typeid(T)], std::move(value));
+        }
+        // Previous value is destroyed outside of the lock
+        return ref;
+    }
+
+    template <typename T>
+    void erase()
+    {
+        std::shared_ptr<void> old;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            auto it = values_.find(typeid(T));
+            if (it == end(values_))
+                return;
+            old = std::move(it->second);
+            values_.erase(it);
+        }
+    }
+
+private:
+    wspc::connection_id id_;
+    std::mutex mutex_;
+    std::unordered_map<std::type_index, std::shared_ptr<void>> values_;
+};
+} // namespace wspc
+
+#endif
@@ -0,0 +1,1003 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/shm_transport.hpp"
+#include "wspc/json_rpc.hpp"
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_semaphore.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#  include <cerrno>
+#  include <signal.h>
+#  include <unistd.h>
+#endif
+
+namespace bip = boost::interprocess;
+
+namespace wspc {
+
+namespace {
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "shared memory rings need lock-free atomics");
+
+const std::uint64_t shm_magic = 0x324d485343505357; // "WSPCSHM2"
+const std::uint32_t padding_marker = 0xffffffff;
+const std::size_t cache_line_size = 64;
+// Responses queued for a client whose response ring is full. Client with more
+// than that is dropped.
+const std::size_t max_pending_responses = 1024;
+// How long the service sleeps without any client activity before it checks
+// if clients are still alive
+const std::chrono::seconds liveness_check_interval{1};
+// Slot that stays claimed for longer than that is taken back: its client
+// must have died (or got stuck) while initializing it
+const std::chrono::seconds claim_grace_period{5};
+
+enum slot_state : std::uint32_t
+{
+    slot_free,
+    // Client is initializing the slot
+    slot_claimed,
+    slot_open,
+    // Client detached, waiting for the service to release the slot
+    slot_closing,
+    // Service dropped the client (it didn't keep up with responses), slot is
+    // released once the client detaches
+    slot_dropped
+};
+
+// Slot state and pid of the client owning the slot are packed into one word
+// so that the client claims the slot and says who it is in the same CAS
+std::uint64_t make_control(slot_state state, int pid)
+{
+    return static_cast<std::uint64_t>(static_cast<std::uint32_t>(pid)) << 32 |
+           state;
+}
+
+slot_state state_of(std::uint64_t control)
+{
+    return static_cast<slot_state>(control & 0xffffffff);
+}
+
+int pid_of(std::uint64_t control)
+{
+    return static_cast<int>(static_cast<std::uint32_t>(control >> 32));
+}
+
+// Positions are monotonic byte offsets, wrapped only when accessing data
+struct ring_header
+{
+    // End of published records (producer)
+    alignas(cache_line_size) std::atomic<std::uint64_t> head;
+    // End of record being written (producer, multi-consumer rings only)
+    std::atomic<std::uint64_t> reserved;
+    // End of consumed records (consumer, single-consumer rings only)
+    alignas(cache_line_size) std::atomic<std::uint64_t> tail;
+};
+
+struct slot_header
+{
+    // See make_control()
+    alignas(cache_line_size) std::atomic<std::uint64_t> control;
+    ring_header requests;
+    ring_header responses;
+};
+
+struct segment_header
+{
+    std::uint64_t magic;
+    std::uint64_t max_clients;
+    std::uint64_t event_ring_size;
+    std::uint64_t client_ring_size;
+    ring_header events;
+    // Bumped by clients whenever they give the service something to do
+    // (request, slot state change)
+    alignas(cache_line_size) std::atomic<std::uint32_t> activity;
+    // Set while service is (about to be) sleeping on the doorbell
+    std::atomic<std::uint32_t> service_waiting;
+    bip::interprocess_semaphore doorbell{0};
+};
+
+std::size_t align_up(std::size_t size, std::size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Records are 4-byte length followed by payload, aligned to 8 bytes so
+// there's always room for a padding marker at the end of ring
+std::uint64_t record_size(std::size_t payload_size)
+{
+    return align_up(sizeof(std::uint32_t) + payload_size, 8);
+}
+
+class ring
+{
+public:
+    ring(ring_header& header, char* data, std::uint64_t size)
+        : header_{header}, data_{data}, size_{size}
+    {
+    }
+
+    void reset()
+    {
+        header_.head.store(0, std::memory_order_relaxed);
+        header_.reserved.store(0, std::memory_order_relaxed);
+        header_.tail.store(0, std::memory_order_relaxed);
+    }
+
+    std::uint64_t head() const
+    {
+        return header_.head.load(std::memory_order_acquire);
+    }
+
+    // Checks if payload of given size can be ever written to the ring
+    bool fits(std::size_t payload_size) const
+    {
+        return record_size(payload_size) <= size_ / 2;
+    }
+
+    // Producer side. If overwrite is set records not yet read by consumers
+    // are overwritten, otherwise returns false when there's not enough space.
+    // Always returns false if payload doesn't fit.
+    bool write(const std::string& payload, bool overwrite)
+    {
+        if (!fits(payload.size()))
+            return false;
+
+        const auto needed = record_size(payload.size());
+
+        const auto head = header_.head.load(std::memory_order_relaxed);
+        const auto offset = head % size_;
+        const auto padding = offset + needed > size_ ? size_ - offset : 0;
+        const auto end = head + padding + needed;
+
+        if (overwrite)
+        {
+            // Let readers detect we're about to overwrite what they read
+            header_.reserved.store(end, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        else if (end - header_.tail.load(std::memory_order_acquire) > size_)
+        {
+            return false;
+        }
+
+        if (padding)
+            std::memcpy(data_ + offset, &padding_marker,
+                        sizeof(padding_marker));
+        const auto pos = (head + padding) % size_;
+        const auto length = static_cast<std::uint32_t>(payload.size());
+        std::memcpy(data_ + pos, &length, sizeof(length));
+        std::memcpy(data_ + pos + sizeof(length), payload.data(),
+                    payload.size());
+        header_.head.store(end, std::memory_order_release);
+        return true;
+    }
+
+    // Single consumer side
+    bool read(std::string& payload)
+    {
+        auto tail = header_.tail.load(std::memory_order_relaxed);
+        const auto head = header_.head.load(std::memory_order_acquire);
+        bool found = false;
+        while (tail != head && !found)
+        {
+            const auto offset = tail % size_;
+            std::uint32_t length;
+            std::memcpy(&length, data_ + offset, sizeof(length));
+            if (length == padding_marker)
+            {
+                tail += size_ - offset;
+                continue;
+            }
+            payload.assign(data_ + offset + sizeof(length), length);
+            tail += record_size(length);
+            found = true;
+        }
+        header_.tail.store(tail, std::memory_order_release);
+        return found;
+    }
+
+    // Multi-consumer side, each consumer keeps its own position. Every
+    // record is copied to the buffer and checked for being overwritten in the
+    // meantime before it's passed to func.
+    bool read_all(std::uint64_t& pos, std::string& buffer,
+                  const std::function<void(const char*, std::size_t)>& func)
+    {
+        const auto head = header_.head.load(std::memory_order_acquire);
+        if (head - pos > size_)
+        {
+            pos = head;
+            return false;
+        }
+
+        while (pos != head)
+        {
+            const auto offset = pos % size_;
+            std::uint32_t length;
+            std::memcpy(&length, data_ + offset, sizeof(length));
+            if (length == padding_marker)
+            {
+                pos += size_ - offset;
+                continue;
+            }
+            // Length itself could have been overwritten
+            if (!valid(pos) || offset + record_size(length) > size_)
+            {
+                pos = header_.head.load(std::memory_order_acquire);
+                return false;
+            }
+
+            buffer.assign(data_ + offset + sizeof(length), length);
+            if (!valid(pos))
+            {
+                pos = header_.head.load(std::memory_order_acquire);
+                return false;
+            }
+            pos += record_size(length);
+            func(buffer.data(), buffer.size());
+        }
+        return true;
+    }
+
+private:
+    // Checks if record at given position hasn't been (partially) overwritten
+    // by now
+    bool valid(std::uint64_t pos) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header_.reserved.load(std::memory_order_relaxed) - pos <= size_;
+    }
+
+private:
+    ring_header& header_;
+    char* data_;
+    std::uint64_t size_;
+};
+
+int current_pid()
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    return static_cast<int>(::getpid());
+#endif
+}
+
+// Pid 0 stands for a client whose pid is unknown, it's assumed to be alive
+bool process_alive(int pid)
+{
+#if defined(_WIN32)
+    (void)pid;
+    return true;
+#else
+    return pid == 0 || ::kill(pid, 0) == 0 || errno != ESRCH;
+#endif
+}
+} // namespace anonymous
+
+// Mapped shared memory object and its layout:
+// [segment_header][event ring][slot_header...][request ring, response ring...]
+class shm_segment
+{
+public:
+    // Creates new segment
+    shm_segment(const std::string& name, std::size_t max_clients,
+                std::size_t event_ring_size, std::size_t client_ring_size)
+        : shm_{bip::create_only, name.c_str(), bip::read_write}
+    {
+        event_ring_size = align_up(event_ring_size, cache_line_size);
+        client_ring_size = align_up(client_ring_size, cache_line_size);
+        shm_.truncate(static_cast<bip::offset_t>(
+            total_size(max_clients, event_ring_size, client_ring_size)));
+        region_ = bip::mapped_region{shm_, bip::read_write};
+        std::memset(region_.get_address(), 0, region_.get_size());
+
+        auto header = new (region_.get_address()) segment_header;
+        header->max_clients = max_clients;
+        header->event_ring_size = event_ring_size;
+        header->client_ring_size = client_ring_size;
+        header_ = header;
+        new (&header_->events) ring_header;
+        event_ring().reset();
+        header_->activity.store(0, std::memory_order_relaxed);
+        header_->service_waiting.store(0, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < max_clients; ++i)
+        {
+            auto slot = new (&this->slot(i)) slot_header;
+            slot->control.store(make_control(slot_free, 0),
+                                std::memory_order_relaxed);
+            request_ring(i).reset();
+            response_ring(i).reset();
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = shm_magic;
+    }
+
+    // Opens existing segment
+    explicit shm_segment(const std::string& name)
+        : shm_{bip::open_only, name.c_str(), bip::read_write},
+          region_{shm_, bip::read_write}
+    {
+        header_ = static_cast<segment_header*>(region_.get_address());
+        if (region_.get_size() < sizeof(segment_header) ||
+            header_->magic != shm_magic ||
+            region_.get_size() < total_size(header_->max_clients,
+                                            header_->event_ring_size,
+                                            header_->client_ring_size))
+        {
+            throw std::runtime_error{"invalid shared memory segment: " +
+                                     name};
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    std::size_t max_clients() const { return header_->max_clients; }
+
+    ring event_ring()
+    {
+        return ring{header_->events, base() + header_offset(),
+                    header_->event_ring_size};
+    }
+
+    slot_header& slot(std::size_t index)
+    {
+        return reinterpret_cast<slot_header*>(base() + slots_offset())[index];
+    }
+
+    ring request_ring(std::size_t index)
+    {
+        return ring{slot(index).requests, client_ring_data(index),
+                    header_->client_ring_size};
+    }
+
+    ring response_ring(std::size_t index)
+    {
+        return ring{slot(index).responses,
+                    client_ring_data(index) + header_->client_ring_size,
+                    header_->client_ring_size};
+    }
+
+    std::uint32_t activity() const
+    {
+        return header_->activity.load(std::memory_order_seq_cst);
+    }
+
+    // Client side (and service, to wake itself up). Wakes the service if it's
+    // waiting for activity.
+    void notify_service()
+    {
+        header_->activity.fetch_add(1, std::memory_order_seq_cst);
+        if (header_->service_waiting.exchange(0, std::memory_order_seq_cst))
+            header_->doorbell.post();
+    }
+
+    // Service side. Blocks until activity moves past the given value (read
+    // before the service last looked at client slots) or timeout expires.
+    void wait_for_activity(std::uint32_t seen,
+                           std::chrono::milliseconds timeout)
+    {
+        header_->service_waiting.store(1, std::memory_order_seq_cst);
+        // Clients bump activity before they check service_waiting, so either
+        // we see their activity here or they ring the doorbell
+        if (activity() == seen)
+        {
+            header_->doorbell.timed_wait(
+                boost::posix_time::microsec_clock::universal_time() +
+                boost::posix_time::milliseconds{timeout.count()});
+        }
+        header_->service_waiting.store(0, std::memory_order_seq_cst);
+    }
+
+private:
+    static std::size_t header_offset()
+    {
+        return align_up(sizeof(segment_header), cache_line_size);
+    }
+
+    static std::size_t total_size(std::size_t max_clients,
+                                  std::size_t event_ring_size,
+                                  std::size_t client_ring_size)
+    {
+        return header_offset() + event_ring_size +
+               max_clients * (sizeof(slot_header) + 2 * client_ring_size);
+    }
+
+    char* base() { return static_cast<char*>(region_.get_address()); }
+
+    std::size_t slots_offset() const
+    {
+        return header_offset() + header_->event_ring_size;
+    }
+
+    char* client_ring_data(std::size_t index)
+    {
+        return base() + slots_offset() +
+               header_->max_clients * sizeof(slot_header) +
+               index * 2 * header_->client_ring_size;
+    }
+
+private:
+    bip::shared_memory_object shm_;
+    bip::mapped_region region_;
+    segment_header* header_{nullptr};
+};
+
+class shm_transport_impl
+    : public std::enable_shared_from_this<shm_transport_impl>
+{
+public:
+    shm_transport_impl(wspc::processor& processor,
+                       boost::asio::io_service& io_service,
+                       const std::string& name, std::size_t max_clients,
+                       std::size_t event_ring_size,
+                       std::size_t client_ring_size,
+                       std::chrono::microseconds poll_interval)
+        : processor_{processor},
+          io_service_{io_service},
+          timer_{io_service},
+          name_{name},
+          poll_interval_{poll_interval},
+          clients_(max_clients)
+    {
+        // Remove leftovers of a previous instance
+        bip::shared_memory_object::remove(name_.c_str());
+        segment_ = std::make_unique<shm_segment>(
+            name_, max_clients, event_ring_size, client_ring_size);
+    }
+
+    ~shm_transport_impl()
+    {
+        bip::shared_memory_object::remove(name_.c_str());
+    }
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        waiter_ = std::thread{[this] { wait_for_activity(); }};
+        schedule_poll();
+    }
+
+    void close()
+    {
+        std::thread waiter;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            closed_ = true;
+            timer_.cancel();
+            waiter = std::move(waiter_);
+        }
+        idle_cv_.notify_one();
+        segment_->notify_service();
+        if (waiter.joinable())
+            waiter.join();
+    }
+
+    bool send(wspc::connection_id id, const std::string& payload)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = slots_.find(id);
+        if (it == end(slots_))
+            return false;
+        const auto index = it->second;
+        if (!segment_->response_ring(index).fits(payload.size()))
+        {
+            ++oversized_messages_;
+            return false;
+        }
+        // Client is dropped by the next poll if it overflows
+        return send_to_slot(index, payload);
+    }
+
+    void broadcast(const std::string& payload)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!segment_->event_ring().write(payload, true))
+            ++oversized_messages_;
+    }
+
+    bool stream(wspc::connection_id id, wspc::message_stream_ptr stream)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = slots_.find(id);
+        if (it == end(slots_))
+            return false;
+        // Pulled by poll() as response ring drains
+        clients_[it->second].streams.push_back(std::move(stream));
+        segment_->notify_service();
+        return true;
+    }
+
+    int num_clients() const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return static_cast<int>(slots_.size());
+    }
+
+    bool connected(wspc::connection_id id) const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return slots_.count(id) != 0;
+    }
+
+    std::uint64_t num_oversized_messages() const
+    {
+        return oversized_messages_;
+    }
+
+    std::uint64_t num_dropped_clients() const { return dropped_clients_; }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct client
+    {
+        wspc::connection_id id{0};
+        // Responses that didn't fit in response ring yet
+        std::deque<std::string> pending;
+        // Too many responses pending, to be dropped by poll()
+        bool overflowed{false};
+        std::deque<std::shared_ptr<wspc::message_stream>> streams;
+        // When poll() first saw the slot claimed (touched only by poll())
+        clock::time_point claimed_since{};
+    };
+
+    // Requires mutex_ to be locked
+    void schedule_poll()
+    {
+        auto self = shared_from_this();
+        timer_.expires_from_now(poll_interval_);
+        timer_.async_wait([self](const boost::system::error_code& ec) {
+            if (!ec)
+                self->run_poll();
+        });
+    }
+
+    // Polls again after poll_interval if there's work left, otherwise hands
+    // over to the waiter thread
+    void run_poll()
+    {
+        // Processor might be already gone if transport's been closed
+        if (closed_)
+            return;
+        const auto activity = segment_->activity();
+        const bool busy = poll();
+
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (closed_)
+            return;
+        if (busy)
+        {
+            schedule_poll();
+            return;
+        }
+        idle_activity_ = activity;
+        idle_ = true;
+        idle_cv_.notify_one();
+    }
+
+    // Runs on its own thread: sleeps on the segment's doorbell while there's
+    // nothing to poll and posts the next poll once clients do something (or
+    // it's time to check if they're still alive)
+    void wait_for_activity()
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        while (true)
+        {
+            idle_cv_.wait(lock, [this] { return idle_ || closed_; });
+            if (closed_)
+                return;
+            idle_ = false;
+            const auto activity = idle_activity_;
+
+            lock.unlock();
+            segment_->wait_for_activity(activity, liveness_check_interval);
+            lock.lock();
+
+            if (closed_)
+                return;
+            auto self = shared_from_this();
+            io_service_.post([self] { self->run_poll(); });
+        }
+    }
+
+    // Returns true if there's work left (requests over the budget, responses
+    // waiting for room in the response ring, streams)
+    bool poll()
+    {
+        const auto now = clock::now();
+        const bool check_liveness =
+            now - last_liveness_check_ >= liveness_check_interval;
+        if (check_liveness)
+            last_liveness_check_ = now;
+
+        bool busy = false;
+        std::string request;
+        for (std::size_t index = 0; index < clients_.size(); ++index)
+        {
+            const auto control =
+                segment_->slot(index).control.load(std::memory_order_acquire);
+            const auto state = state_of(control);
+
+            if (state != slot_claimed)
+                clients_[index].claimed_since = clock::time_point{};
+            if (state == slot_free)
+                continue;
+            if (state == slot_claimed)
+            {
+                auto& since = clients_[index].claimed_since;
+                if (since == clock::time_point{})
+                    since = now;
+                else if (now - since > claim_grace_period)
+                    release(index, control);
+                continue;
+            }
+            if (state == slot_closing ||
+                (check_liveness && !process_alive(pid_of(control))))
+            {
+                release(index, control);
+                continue;
+            }
+            if (state != slot_open)
+                continue;
+
+            if (clients_[index].id == 0)
+                open(index);
+            if (!flush(index))
+            {
+                drop(index, control);
+                continue;
+            }
+            pump(index);
+
+            auto requests = segment_->request_ring(index);
+            // Don't let one client starve the others
+            int budget = 64;
+            bool dropped = false;
+            for (; budget > 0 && requests.read(request); --budget)
+            {
+                auto response =
+                    processor_.process_message(clients_[index].id, request);
+                if (response.empty())
+                    continue;
+                if (!segment_->response_ring(index).fits(response.size()))
+                {
+                    ++oversized_messages_;
+                    response = too_large_response(response);
+                }
+
+                bool sent;
+                {
+                    std::lock_guard<std::mutex> lock{mutex_};
+                    sent = send_to_slot(index, response);
+                }
+                if (!sent)
+                {
+                    drop(index, control);
+                    dropped = true;
+                    break;
+                }
+            }
+            if (dropped)
+                continue;
+
+            std::lock_guard<std::mutex> lock{mutex_};
+            const auto& c = clients_[index];
+            if (budget == 0 || !c.pending.empty() || !c.streams.empty())
+                busy = true;
+        }
+        return busy;
+    }
+
+    void open(std::size_t index)
+    {
+        const auto id = wspc::make_connection_id();
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            clients_[index].id = id;
+            slots_.emplace(id, index);
+        }
+        processor_.process_open(id);
+    }
+
+    // Frees the slot unless its control word has changed since poll() looked
+    // at it (e.g. client finished initializing it in the meantime)
+    void release(std::size_t index, std::uint64_t control)
+    {
+        if (!segment_->slot(index).control.compare_exchange_strong(
+                control, make_control(slot_free, 0),
+                std::memory_order_acq_rel))
+        {
+            return;
+        }
+
+        wspc::connection_id id;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            id = clients_[index].id;
+            slots_.erase(id);
+            clients_[index] = client{};
+        }
+        if (id != 0)
+            processor_.process_close(id);
+    }
+
+    // Stops serving the client, its slot stays taken till the client
+    // detaches (or dies)
+    void drop(std::size_t index, std::uint64_t control)
+    {
+        const auto id = clients_[index].id;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            slots_.erase(id);
+            clients_[index] = client{};
+        }
+        ++dropped_clients_;
+
+        segment_->slot(index).control.compare_exchange_strong(
+            control, make_control(slot_dropped, pid_of(control)),
+            std::memory_order_acq_rel);
+        processor_.process_close(id);
+    }
+
+    // Error response to the request whose response doesn't fit in the ring
+    static std::string too_large_response(const std::string& response)
+    {
+        std::string err;
+        const auto json = json11::Json::parse(response, err);
+        // Batch responses get null id as there's no way to tell which of the
+        // responses is too large
+        const auto id = json.is_object() ? json["id"] : json11::Json{};
+        return detail::make_error_response(id,
+                                           detail::fault_code::internal_error,
+                                           "response too large")
+            .dump();
+    }
+
+    // Requires mutex_ to be locked. Payload must fit in the ring. Returns
+    // false if client has too many responses pending already (it's then
+    // marked as overflowed).
+    bool send_to_slot(std::size_t index, const std::string& payload)
+    {
+        auto& c = clients_[index];
+        if (c.overflowed)
+            return false;
+        if (c.pending.empty() &&
+            segment_->response_ring(index).write(payload, false))
+        {
+            return true;
+        }
+        if (c.pending.size() >= max_pending_responses)
+        {
+            c.overflowed = true;
+            return false;
+        }
+        c.pending.push_back(payload);
+        // Wake up poll() if it's idle
+        segment_->notify_service();
+        return true;
+    }
+
+    // Feeds client's streams (one at a time) as long as their messages go
+    // straight to the response ring
+    void pump(std::size_t index)
+    {
+        std::string payload;
+        while (true)
+        {
+            std::shared_ptr<wspc::message_stream> stream;
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                const auto& c = clients_[index];
+                if (c.streams.empty() || !c.pending.empty())
+                    return;
+                stream = c.streams.front();
+            }
+
+            // Only poll() consumes streams, front one is still there
+            if (!stream->next(payload))
+            {
+                std::lock_guard<std::mutex> lock{mutex_};
+                clients_[index].streams.pop_front();
+                continue;
+            }
+            if (!segment_->response_ring(index).fits(payload.size()))
+            {
+                ++oversized_messages_;
+                continue;
+            }
+            // Ring full: message waits among pending responses and the
+            // stream till they're flushed
+            std::lock_guard<std::mutex> lock{mutex_};
+            if (!send_to_slot(index, payload))
+                return;
+        }
+    }
+
+    // Returns false if client has overflowed and should be dropped
+    bool flush(std::size_t index)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto& c = clients_[index];
+        auto responses = segment_->response_ring(index);
+        while (!c.pending.empty() && responses.write(c.pending.front(), false))
+            c.pending.pop_front();
+        return !c.overflowed;
+    }
+
+private:
+    wspc::processor& processor_;
+    boost::asio::io_service& io_service_;
+    boost::asio::steady_timer timer_;
+    std::string name_;
+    std::chrono::microseconds poll_interval_;
+    std::unique_ptr<shm_segment> segment_;
+    clock::time_point last_liveness_check_;
+
+    // Guards event ring and response rings (producer side) and the
+    // bookkeeping below. Clients are opened and released only by poll().
+    mutable std::mutex mutex_;
+    std::vector<client> clients_;
+    std::unordered_map<wspc::connection_id, std::size_t> slots_;
+    std::atomic<bool> closed_{false};
+
+    // Handing over from poll() to the waiter thread
+    std::thread waiter_;
+    std::condition_variable idle_cv_;
+    bool idle_{false};
+    // Client activity counter read before the last poll()
+    std::uint32_t idle_activity_{0};
+
+    std::atomic<std::uint64_t> oversized_messages_{0};
+    std::atomic<std::uint64_t> dropped_clients_{0};
+};
+
+shm_transport::shm_transport(wspc::processor& processor,
+                             boost::asio::io_service& io_service,
+                             const std::string& name, std::size_t max_clients,
+                             std::size_t event_ring_size,
+                             std::size_t client_ring_size,
+                             std::chrono::microseconds poll_interval)
+    : impl_{std::make_shared<wspc::shm_transport_impl>(
+          processor, io_service, name, max_clients, event_ring_size,
+          client_ring_size, poll_interval)}
+{
+    impl_->start();
+}
+
+shm_transport::~shm_transport() { impl_->close(); }
+
+void shm_transport::close() { impl_->close(); }
+
+bool shm_transport::send(wspc::connection_id id, const std::string& payload)
+{
+    return impl_->send(id, payload);
+}
+
+void shm_transport::broadcast(const std::string& payload)
+{
+    impl_->broadcast(payload);
+}
+
+int shm_transport::num_clients() const { return impl_->num_clients(); }
+
+bool shm_transport::connected(wspc::connection_id id) const
+{
+    return impl_->connected(id);
+}
+
+bool shm_transport::stream(wspc::connection_id id,
+                           wspc::message_stream_ptr stream)
+{
+    return impl_->stream(id, std::move(stream));
+}
+
+std::uint64_t shm_transport::num_oversized_messages() const
+{
+    return impl_->num_oversized_messages();
+}
+
+std::uint64_t shm_transport::num_dropped_clients() const
+{
+    return impl_->num_dropped_clients();
+}
+
+shm_client::shm_client(const std::string& name)
+    : segment_{std::make_unique<wspc::shm_segment>(name)}
+{
+    const auto pid = current_pid();
+    auto claimed = make_control(slot_claimed, pid);
+    for (slot_ = 0; slot_ < segment_->max_clients(); ++slot_)
+    {
+        auto expected = make_control(slot_free, 0);
+        if (segment_->slot(slot_).control.compare_exchange_strong(
+                expected, claimed, std::memory_order_acq_rel))
+        {
+            break;
+        }
+    }
+    if (slot_ == segment_->max_clients())
+        throw std::runtime_error{"no free client slot in " + name};
+
+    segment_->request_ring(slot_).reset();
+    segment_->response_ring(slot_).reset();
+    // Only events published from now on
+    event_pos_ = segment_->event_ring().head();
+    if (!segment_->slot(slot_).control.compare_exchange_strong(
+            claimed, make_control(slot_open, pid), std::memory_order_acq_rel))
+    {
+        throw std::runtime_error{"client slot in " + name +
+                                 " taken back during initialization"};
+    }
+    segment_->notify_service();
+}
+
+shm_client::~shm_client()
+{
+    segment_->slot(slot_).control.store(
+        make_control(slot_closing, current_pid()), std::memory_order_release);
+    segment_->notify_service();
+}
+
+bool shm_client::send(const std::string& payload)
+{
+    if (dropped() || !segment_->request_ring(slot_).write(payload, false))
+        return false;
+    segment_->notify_service();
+    return true;
+}
+
+bool shm_client::receive(std::string& payload)
+{
+    return segment_->response_ring(slot_).read(payload);
+}
+
+bool shm_client::dropped() const
+{
+    return state_of(segment_->slot(slot_).control.load(
+               std::memory_order_acquire)) == slot_dropped;
+}
+
+bool shm_client::read_events(
+    const std::function<void(const char*, std::size_t)>& func)
+{
+    return segment_->event_ring().read_all(event_pos_, event_buffer_, func);
+}
+} // namespace wspc
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_SHM_TRANSPORT_HPP_GUARD
+#define WSPC_SHM_TRANSPORT_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace wspc {
+
+// Forward declarations
+class shm_transport_impl;
+class shm_segment;
+
+// Transport for clients on the same host using named shared memory object
+// (/dev/shm on Linux). Segment holds:
+//  - single-producer, multi-consumer ring of broadcast events which every
+//    client reads on its own pace, with no syscalls and no copies (a slow
+//    client gets overrun instead of slowing down the service),
+//  - a slot per client with a pair of single-producer, single-consumer rings
+//    for requests and responses.
+// Service side polls client slots on given io_service: every poll_interval
+// while there's work left over (requests over the per-client budget,
+// responses waiting for room in the response ring), otherwise it sleeps on a
+// semaphore in the segment which clients post to when they send something.
+// Clients that died without detaching are noticed within a few seconds.
+// Messages (records) can take up to half of the ring they're written to:
+// larger broadcasts and sends are dropped and larger responses are replaced
+// with an "internal error" response. Client that lets more than 1024
+// responses pile up (its response ring being full) is dropped.
+class shm_transport : public wspc::transport
+{
+public:
+    shm_transport(wspc::processor& processor,
+                  boost::asio::io_service& io_service, const std::string& name,
+                  std::size_t max_clients = 16,
+                  std::size_t event_ring_size = 4 * 1024 * 1024,
+                  std::size_t client_ring_size = 256 * 1024,
+                  std::chrono::microseconds poll_interval =
+                      std::chrono::microseconds{50});
+    // Removes shared memory object (already connected clients keep their
+    // mapping)
+    ~shm_transport() override;
+
+    void close() override;
+    bool send(wspc::connection_id id, const std::string& payload) override;
+    void broadcast(const std::string& payload) override;
+    int num_clients() const override;
+    bool connected(wspc::connection_id id) const override;
+    // Pulls next messages only while they fit in client's response ring
+    bool stream(wspc::connection_id id,
+                wspc::message_stream_ptr stream) override;
+
+    // Broadcasts, sends and responses that exceeded the size limit
+    std::uint64_t num_oversized_messages() const;
+    // Clients dropped for not reading their responses
+    std::uint64_t num_dropped_clients() const;
+
+private:
+    std::shared_ptr<wspc::shm_transport_impl> impl_;
+};
+
+// Client side of wspc::shm_transport. None of its methods blocks, the client
+// is supposed to poll them from its own loop. Not thread-safe.
+class shm_client
+{
+public:
+    // Throws if there's no such segment or all client slots are taken
+    explicit shm_client(const std::string& name);
+    ~shm_client();
+
+    shm_client(const shm_client&) = delete;
+    shm_client& operator=(const shm_client&) = delete;
+
+    // Queues a JSON-RPC request. Returns false if request ring is full,
+    // the request is too large or the client has been dropped.
+    bool send(const std::string& payload);
+    // Takes next response, if there's any
+    bool receive(std::string& payload);
+    // Client that didn't keep up with its responses is dropped by the
+    // service and has to reconnect (using a new shm_client)
+    bool dropped() const;
+
+    // Calls func(data, size) for every event published since the last call.
+    // Data is a copy (valid only during the call) that's been checked not to
+    // be overwritten while copying. Returns false if the client has been
+    // overrun by the service and lost some events: these are skipped and the
+    // client should resynchronize (e.g. using 'resume' procedure).
+    bool read_events(const std::function<void(const char*, std::size_t)>& func);
+
+private:
+    std::unique_ptr<wspc::shm_segment> segment_;
+    std::size_t slot_;
+    // Position in the event ring
+    std::uint64_t event_pos_;
+    // Event being read
+    std::string event_buffer_;
+};
+} // namespace wspc
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/single_flight_handler.hpp"
+
+#include <exception>
+#include <stdexcept>
+
+namespace wspc {
+
+single_flight_handler::single_flight_handler(
+    wspc::service_handler_ptr handler)
+    : handler_{std::move(handler)}
+{
+    if (!handler_)
+        throw std::invalid_argument{"handler is null"};
+    if (handler_->takes_session())
+    {
+        throw std::invalid_argument{
+            "single-flight handler can't take a session"};
+    }
+}
+
+json11::Json single_flight_handler::operator()(const json11::Json& request)
+{
+    // json11 keeps object's members in std::map so dump() gives us the
+    // canonical form regardless of the order they were sent in
+    auto key = request.dump();
+
+    std::promise<json11::Json> promise;
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        auto it = in_flight_.find(key);
+        if (it != end(in_flight_))
+        {
+            auto result = it->second;
+            lock.unlock();
+            return result.get();
+        }
+        in_flight_.emplace(key, promise.get_future().share());
+    }
+
+    // Remove the entry before fulfilling the promise - anyone arriving after
+    // that point starts a new execution while already waiting callers
+    // have their own copy of the shared state
+    auto finish = [&] {
+        std::lock_guard<std::mutex> lock{mutex_};
+        in_flight_.erase(key);
+    };
+
+    try
+    {
+        auto result = (*handler_)(request);
+        finish();
+        promise.set_value(result);
+        return result;
+    }
+    catch (...)
+    {
+        finish();
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+json11::Json single_flight_handler::invoke(wspc::session&,
+                                          const json11::Json& request)
+{
+    return (*this)(request);
+}
+
+void single_flight_handler::notify(wspc::session& session,
+                                   const json11::Json& request)
+{
+    // Nobody waits for the result
+    handler_->notify(session, request);
+}
+
+bool single_flight_handler::batches_notifications() const
+{
+    return handler_->batches_notifications();
+}
+
+void single_flight_handler::notify_batch(wspc::session& session,
+                                         const json11::Json* requests,
+                                         std::size_t count)
+{
+    handler_->notify_batch(session, requests, count);
+}
+
+wspc::result_stream_ptr
+    single_flight_handler::open_stream(const json11::Json& request)
+{
+    // Each caller consumes its own stream
+    return handler_->open_stream(request);
+}
+
+std::size_t single_flight_handler::chunk_size() const
+{
+    return handler_->chunk_size();
+}
+
+bool single_flight_handler::validate(const json11::Json& request,
+                                     wspc::param_error& error) const
+{
+    return handler_->validate(request, error);
+}
+
+const std::string& single_flight_handler::request_description() const
+{
+    return handler_->request_description();
+}
+
+const std::string& single_flight_handler::response_description() const
+{
+    return handler_->response_description();
+}
+
+wspc::service_handler_ptr
+    make_single_flight_handler(wspc::service_handler_ptr handler)
+{
+    return std::make_unique<wspc::single_flight_handler>(std::move(handler));
+}
+} // namespace wspc
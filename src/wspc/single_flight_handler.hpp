@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_SINGLE_FLIGHT_HANDLER_HPP_GUARD
+#define WSPC_SINGLE_FLIGHT_HANDLER_HPP_GUARD
+
+#include "wspc/service_handler.hpp"
+
+#include <kl/json_convert.hpp>
+
+#include <cstddef>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace wspc {
+
+// Decorator over a service handler that coalesces identical requests: if a
+// request with the same (canonical) params is already being handled, the
+// caller waits for that execution and gets its result (or exception) instead
+// of running the handler once again. Since a handler is bound to a single
+// procedure the key consists of params only.
+//
+// Only plain calls are coalesced, everything else (notifications, streams)
+// goes straight to the wrapped handler. Handlers taking a session are
+// rejected as callers from different connections would share the result.
+class single_flight_handler : public wspc::service_handler
+{
+public:
+    // Throws std::invalid_argument if handler is null or takes a session
+    explicit single_flight_handler(wspc::service_handler_ptr handler);
+
+    json11::Json operator()(const json11::Json& request) override;
+    // Session is not passed on (see takes_session())
+    json11::Json invoke(wspc::session& session,
+                        const json11::Json& request) override;
+    void notify(wspc::session& session, const json11::Json& request) override;
+
+    bool batches_notifications() const override;
+    void notify_batch(wspc::session& session, const json11::Json* requests,
+                      std::size_t count) override;
+
+    wspc::result_stream_ptr open_stream(const json11::Json& request) override;
+    std::size_t chunk_size() const override;
+
+    bool validate(const json11::Json& request,
+                  wspc::param_error& error) const override;
+
+    const std::string& request_description() const override;
+    const std::string& response_description() const override;
+
+private:
+    wspc::service_handler_ptr handler_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_future<json11::Json>>
+        in_flight_;
+};
+
+// Opts given handler in to single-flight mode.
+// Usage: make_single_flight_handler(make_service_handler([&](int a0)
+//                                   { return ...; }));
+wspc::service_handler_ptr
+    make_single_flight_handler(wspc::service_handler_ptr handler);
+} // namespace wspc
+
+#endif
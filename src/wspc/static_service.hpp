@@ -0,0 +1,343 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_STATIC_SERVICE_HPP_GUARD
+#define WSPC_STATIC_SERVICE_HPP_GUARD
+
+#include "wspc/json_rpc.hpp"
+#include "wspc/param_validation.hpp"
+#include "wspc/type_description.hpp"
+#include "wspc/typed_service_handler.hpp"
+#include "wspc/websocket_transport.hpp"
+
+#include <kl/ctti.hpp>
+#include <kl/json_convert.hpp>
+#include <kl/type_traits.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+#  pragma warning(push)
+   // MSVC complains about using comma inside []
+#  pragma warning(disable: 4709)
+#endif
+
+namespace wspc {
+
+// Named procedure of a static_service. Callable is stored as is.
+template <typename Func>
+struct static_handler
+{
+    const char* name;
+    Func func;
+};
+
+// Usage: make_static_handler("calculate", [](double a0, double a1)
+//                            { return ...; });
+template <typename Func>
+static_handler<std::decay_t<Func>> make_static_handler(const char* name,
+                                                       Func&& func)
+{
+    return {name, std::forward<Func>(func)};
+}
+
+namespace detail {
+
+template <typename Func>
+using static_return_t = typename kl::func_traits<Func>::return_type;
+
+// Deserializes the request and calls the function, without serializing what
+// it returns (enough for notifications)
+template <typename Func>
+static_return_t<Func> static_call(Func& func, const json11::Json&, void_type)
+{
+    return func();
+}
+
+template <typename Func>
+static_return_t<Func> static_call(Func& func, const json11::Json& request,
+                                  key_value_type)
+{
+    auto req_obj = kl::from_json<decayed_first_arg<Func>>(request);
+    return func(std::move(req_obj));
+}
+
+template <typename Func, typename Tuple, std::size_t... Is>
+static_return_t<Func> static_call_tuple(Func& func, Tuple&& args,
+                                        kl::index_sequence<Is...>)
+{
+    return func(std::get<Is>(std::forward<Tuple>(args))...);
+}
+
+template <typename Func>
+static_return_t<Func> static_call(Func& func, const json11::Json& request,
+                                  tuple_type)
+{
+    using args_type = decayed_args_tuple_t<Func>;
+    return static_call_tuple(func, kl::from_json<args_type>(request),
+                             kl::make_tuple_indices<args_type>{});
+}
+
+template <typename Func, typename Category>
+json11::Json static_invoke(Func& func, const json11::Json& request,
+                           Category category)
+{
+    const auto resp_obj =
+        empty_response[static_call(func, request, category), empty_response];
+    return kl::to_json(resp_obj);
+}
+} // namespace detail
+
+// RPC service whose set of procedures is known at compile time. In contrast to
+// wspc::service, handlers are stored directly (no type erasure). Procedure is
+// looked up by binary search in a table of names sorted at construction which
+// points straight at the function calling given handler, so decoding, call
+// and encoding can all be inlined there.
+// Usage: auto service = make_static_service(
+//            make_static_handler("add", [](int a, int b) { return a + b; }),
+//            make_static_handler("ping", [] { return 1; }));
+template <typename... Handlers>
+class static_service : public wspc::processor
+{
+public:
+    // Throws if procedure names aren't unique
+    explicit static_service(Handlers... handlers)
+        : handlers_{std::move(handlers)...},
+          dispatch_table_{make_dispatch_table(indices{})},
+          transport_{std::make_unique<wspc::websocket_transport>(*this)}
+    {
+        std::sort(begin(dispatch_table_), end(dispatch_table_),
+                  [](const dispatch_entry& a, const dispatch_entry& b) {
+                      return std::strcmp(a.name, b.name) < 0;
+                  });
+        const auto duplicate = std::adjacent_find(
+            begin(dispatch_table_), end(dispatch_table_),
+            [](const dispatch_entry& a, const dispatch_entry& b) {
+                return std::strcmp(a.name, b.name) == 0;
+            });
+        if (duplicate != end(dispatch_table_))
+        {
+            throw std::invalid_argument{
+                std::string{"duplicate procedure name: "} + duplicate->name};
+        }
+    }
+
+    static_service(const static_service&) = delete;
+    static_service& operator=(const static_service&) = delete;
+
+    void run(std::uint16_t port) { transport_->run(port); }
+    void update() { transport_->poll(); }
+    void close() { transport_->close(); }
+
+    // Broadcast given event for all listening clients
+    template <typename Event>
+    void broadcast(Event&& event)
+    {
+        if (transport_->num_clients() == 0)
+            return;
+
+        const auto event_json = json11::Json{json11::Json::object{
+            {"method", kl::ctti::name<std::decay_t<Event>>()},
+            {"params", kl::to_json(std::forward<Event>(event))}}};
+        transport_->broadcast(event_json.dump());
+    }
+
+private:
+    using indices = std::index_sequence_for<Handlers...>;
+
+    // Calls handler of given index
+    using invoker = std::string (static_service::*)(const json11::Json& id,
+                                                    const json11::Json& params);
+
+    struct dispatch_entry
+    {
+        const char* name;
+        invoker invoke;
+    };
+
+    using dispatch_table = std::array<dispatch_entry, sizeof...(Handlers)>;
+
+    template <std::size_t... Is>
+    dispatch_table make_dispatch_table(std::index_sequence<Is...>) const
+    {
+        return {{{std::get<Is>(handlers_).name,
+                  &static_service::invoke<Is>}...}};
+    }
+
+    // "wspc::processor" interface implementation
+    std::string process_http(const std::string&) override
+    {
+        service_description page;
+        describe(page, indices{});
+        return page.finish();
+    }
+
+    std::string process_message(wspc::connection_id,
+                                const std::string& payload) override
+    {
+        using namespace detail;
+
+        std::string err;
+        json11::Json json{json11::Json::parse(payload, err)};
+
+        if (!err.empty())
+        {
+            return make_error_response(nullptr, fault_code::parse_error,
+                                       std::move(err))
+                .dump();
+        }
+        if (!json.has_shape({{"method", json11::Json::STRING}}, err))
+        {
+            return make_error_response(nullptr, fault_code::invalid_request,
+                                       std::move(err))
+                .dump();
+        }
+
+        const auto& id = json["id"];
+        const auto& method = json["method"].string_value();
+        const auto& params = json["params"];
+
+        try
+        {
+            return dispatch(method, id, params);
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            return wrap_response(make_error_response(
+                id, fault_code::invalid_params,
+                "invalid method params: "s + ex.what()));
+        }
+        catch (invalid_parameters_exception& ex)
+        {
+            return wrap_response(
+                make_error_response(id, fault_code::invalid_params, ex.what()));
+        }
+        catch (std::exception& ex)
+        {
+            return wrap_response(
+                make_error_response(id, fault_code::internal_error, ex.what()));
+        }
+    }
+
+    std::string dispatch(const std::string& method, const json11::Json& id,
+                         const json11::Json& params)
+    {
+        const auto it = std::lower_bound(
+            begin(dispatch_table_), end(dispatch_table_), method,
+            [](const dispatch_entry& entry, const std::string& name) {
+                return name.compare(entry.name) > 0;
+            });
+        if (it == end(dispatch_table_) || method != it->name)
+        {
+            return detail::wrap_response(
+                detail::make_method_not_found_response(id, method));
+        }
+        return (this->*it->invoke)(id, params);
+    }
+
+    template <std::size_t I>
+    std::string invoke(const json11::Json& id, const json11::Json& params)
+    {
+        using namespace detail;
+
+        auto& handler = std::get<I>(handlers_);
+
+        // Same rules as for wspc::service: params must be array or object
+        if (!params.is_object() && !params.is_array())
+        {
+            return wrap_response(make_error_response(
+                id, fault_code::invalid_params,
+                "wrong type of 'params' - expected array or object"));
+        }
+
+        using func_type = decltype(handler.func);
+        param_error error;
+        if (!validate_request<func_type>(params, error,
+                                         get_request_type<func_type>{}))
+        {
+            return wrap_response(make_invalid_params_response(id, error));
+        }
+
+        // Notification: result is dropped anyway, don't serialize it
+        if (id.is_null())
+        {
+            static_call(handler.func, params, get_request_type<func_type>{});
+            return {};
+        }
+
+        return wrap_response(json11::Json::object{
+            {"result", static_invoke(handler.func, params,
+                                     get_request_type<func_type>{})},
+            {"id", id}});
+    }
+
+    template <std::size_t... Is>
+    void describe(service_description& page, std::index_sequence<Is...>) const
+    {
+        using swallow = std::initializer_list<int>;
+        (void)swallow{0, (describe_one<Is>(page), 0)...};
+    }
+
+    template <std::size_t I>
+    void describe_one(service_description& page) const
+    {
+        using func_type = decltype(std::get<I>(handlers_).func);
+        using return_type = typename kl::func_traits<func_type>::return_type;
+
+        page.add_procedure(std::get<I>(handlers_).name,
+                           detail::request_description<func_type>(
+                               detail::get_request_type<func_type>{}),
+                           get_type_info<return_type>());
+    }
+
+private:
+    std::tuple<Handlers...> handlers_;
+    // Sorted by name
+    dispatch_table dispatch_table_;
+    std::unique_ptr<wspc::websocket_transport> transport_;
+};
+
+template <typename... Handlers>
+std::unique_ptr<static_service<Handlers...>>
+    make_static_service(Handlers... handlers)
+{
+    return std::make_unique<static_service<Handlers...>>(
+        std::move(handlers)...);
+}
+} // namespace wspc
+
+#if defined(_MSC_VER)
+#  pragma warning(pop)
+#endif
+
+#endif
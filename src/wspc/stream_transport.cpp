@@ -0,0 +1,556 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/stream_transport.hpp"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wspc {
+
+class stream_transport_impl
+{
+public:
+    virtual ~stream_transport_impl() = default;
+
+    // Processor is notified about closed connections only if notify is set
+    virtual void close(bool notify) = 0;
+    virtual bool send(wspc::connection_id id, const std::string& payload) = 0;
+    virtual void broadcast(const std::string& payload) = 0;
+    virtual int num_clients() const = 0;
+    virtual bool connected(wspc::connection_id id) const = 0;
+    virtual bool stream(wspc::connection_id id,
+                        wspc::message_stream_ptr stream) = 0;
+    virtual void set_max_buffered_amount(std::size_t bytes) = 0;
+    virtual std::uint64_t num_buffer_overflows() const = 0;
+};
+
+namespace {
+
+// Messages bigger than that are considered as a protocol error
+const std::size_t max_message_size = 16 * 1024 * 1024;
+const std::size_t header_size = 4;
+// Streams are paused when there's more than that (or half of the buffered
+// amount limit, if it's lower) waiting to be written
+const std::size_t max_stream_queued_bytes = 1024 * 1024;
+const std::size_t default_max_buffered_amount = 64 * 1024 * 1024;
+
+std::string make_frame(const std::string& payload)
+{
+    const auto size = static_cast<std::uint32_t>(payload.size());
+    std::string frame;
+    frame.reserve(header_size + payload.size());
+    frame.push_back(static_cast<char>((size >> 24) & 0xff));
+    frame.push_back(static_cast<char>((size >> 16) & 0xff));
+    frame.push_back(static_cast<char>((size >> 8) & 0xff));
+    frame.push_back(static_cast<char>(size & 0xff));
+    frame += payload;
+    return frame;
+}
+
+// Requests and responses are small and latency-sensitive
+void configure_socket(boost::asio::ip::tcp::socket& socket)
+{
+    boost::system::error_code ignored_ec;
+    socket.set_option(boost::asio::ip::tcp::no_delay{true}, ignored_ec);
+}
+
+template <typename Socket>
+void configure_socket(Socket&)
+{
+}
+
+template <typename Protocol>
+class basic_stream_transport_impl;
+
+// Single client connection. All socket operations are serialized through the
+// strand so the session can be safely used from any thread running
+// io_service.
+template <typename Protocol>
+class stream_session
+    : public std::enable_shared_from_this<stream_session<Protocol>>
+{
+public:
+    using socket_type = typename Protocol::socket;
+
+    stream_session(
+        std::shared_ptr<basic_stream_transport_impl<Protocol>> owner,
+        boost::asio::io_service& io_service, socket_type socket)
+        : owner_{std::move(owner)},
+          socket_{std::move(socket)},
+          strand_{io_service},
+          id_{wspc::make_connection_id()}
+    {
+    }
+
+    wspc::connection_id id() const { return id_; }
+
+    void start()
+    {
+        auto self = this->shared_from_this();
+        strand_.post([self] { self->read_header(); });
+    }
+
+    void send(std::string frame)
+    {
+        auto self = this->shared_from_this();
+        strand_.post([self, frame = std::move(frame)]() mutable {
+            self->enqueue(std::move(frame));
+        });
+    }
+
+    void stream(wspc::message_stream_ptr stream)
+    {
+        auto self = this->shared_from_this();
+        // Lambdas must be copyable
+        std::shared_ptr<wspc::message_stream> shared_stream{std::move(stream)};
+        strand_.post([self, shared_stream] {
+            self->streams_.push_back(shared_stream);
+            self->pump();
+        });
+    }
+
+    void close()
+    {
+        auto self = this->shared_from_this();
+        strand_.post([self] {
+            boost::system::error_code ignored_ec;
+            self->socket_.close(ignored_ec);
+        });
+    }
+
+private:
+    void read_header()
+    {
+        auto self = this->shared_from_this();
+        boost::asio::async_read(
+            socket_, boost::asio::buffer(header_),
+            strand_.wrap([self](const boost::system::error_code& ec,
+                                std::size_t) {
+                if (ec)
+                    return self->owner_->remove(self->id_);
+
+                const std::size_t size =
+                    (std::size_t{self->header_[0]} << 24) |
+                    (std::size_t{self->header_[1]} << 16) |
+                    (std::size_t{self->header_[2]} << 8) |
+                    std::size_t{self->header_[3]};
+                if (size > max_message_size)
+                {
+                    boost::system::error_code ignored_ec;
+                    self->socket_.close(ignored_ec);
+                    return self->owner_->remove(self->id_);
+                }
+                self->read_payload(size);
+            }));
+    }
+
+    void read_payload(std::size_t size)
+    {
+        payload_.resize(size);
+        auto self = this->shared_from_this();
+        boost::asio::async_read(
+            socket_, boost::asio::buffer(&payload_[0], payload_.size()),
+            strand_.wrap([self](const boost::system::error_code& ec,
+                                std::size_t) {
+                if (ec)
+                    return self->owner_->remove(self->id_);
+
+                auto response =
+                    self->owner_->process_message(self->id_, self->payload_);
+                if (!response.empty())
+                    self->enqueue(make_frame(response));
+                self->read_header();
+            }));
+    }
+
+    void enqueue(std::string frame)
+    {
+        if (overflowed_)
+            return;
+        const auto cap = owner_->max_buffered_amount();
+        if (cap != 0 && queued_bytes_ + frame.size() > cap)
+        {
+            // Frame being written must stay in the queue till its write
+            // fails. Reading side notices closed socket and removes session.
+            overflowed_ = true;
+            streams_.clear();
+            owner_->buffer_overflow();
+            boost::system::error_code ignored_ec;
+            socket_.close(ignored_ec);
+            return;
+        }
+
+        queued_bytes_ += frame.size();
+        queue_.push_back(std::move(frame));
+        if (queue_.size() == 1)
+            write_next();
+    }
+
+    // Feeds pending streams (one at a time) until enough is queued
+    void pump()
+    {
+        auto limit = max_stream_queued_bytes;
+        const auto cap = owner_->max_buffered_amount();
+        if (cap != 0)
+            limit = std::min(limit, cap / 2);
+
+        std::string payload;
+        while (!streams_.empty() && queued_bytes_ < limit)
+        {
+            if (streams_.front()->next(payload))
+                enqueue(make_frame(payload));
+            else
+                streams_.pop_front();
+        }
+    }
+
+    void write_next()
+    {
+        auto self = this->shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(queue_.front()),
+            strand_.wrap([self](const boost::system::error_code& ec,
+                                std::size_t) {
+                if (ec)
+                {
+                    // Reading side will notice it as well and remove session
+                    self->queue_.clear();
+                    self->queued_bytes_ = 0;
+                    self->streams_.clear();
+                    return;
+                }
+                self->queued_bytes_ -= self->queue_.front().size();
+                self->queue_.pop_front();
+                if (!self->queue_.empty())
+                    self->write_next();
+                self->pump();
+            }));
+    }
+
+private:
+    std::shared_ptr<basic_stream_transport_impl<Protocol>> owner_;
+    socket_type socket_;
+    boost::asio::io_service::strand strand_;
+    wspc::connection_id id_;
+
+    std::array<unsigned char, header_size> header_;
+    std::string payload_;
+    // Framed messages waiting to be written, front one is being written
+    std::deque<std::string> queue_;
+    std::size_t queued_bytes_{0};
+    // Buffered amount limit was exceeded, session is being closed
+    bool overflowed_{false};
+    std::deque<std::shared_ptr<wspc::message_stream>> streams_;
+};
+
+template <typename Protocol>
+class basic_stream_transport_impl
+    : public wspc::stream_transport_impl,
+      public std::enable_shared_from_this<
+          basic_stream_transport_impl<Protocol>>
+{
+public:
+    using session_type = stream_session<Protocol>;
+
+    basic_stream_transport_impl(wspc::processor& processor,
+                                boost::asio::io_service& io_service,
+                                const typename Protocol::endpoint& endpoint)
+        : processor_{processor},
+          io_service_{io_service},
+          acceptor_{io_service},
+          socket_{io_service}
+    {
+        acceptor_.open(endpoint.protocol());
+        acceptor_.bind(endpoint);
+        acceptor_.listen();
+    }
+
+    void start_accept()
+    {
+        auto self = this->shared_from_this();
+        acceptor_.async_accept(
+            socket_, [self](const boost::system::error_code& ec) {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+                if (!ec)
+                {
+                    configure_socket(self->socket_);
+                    self->open(std::move(self->socket_));
+                }
+                self->socket_ =
+                    typename Protocol::socket{self->io_service_};
+                self->start_accept();
+            });
+    }
+
+    void close(bool notify) override
+    {
+        boost::system::error_code ignored_ec;
+        acceptor_.close(ignored_ec);
+
+        // Sessions are removed here so the processor is notified only once
+        // (reading side won't find them anymore)
+        std::unordered_map<wspc::connection_id, std::shared_ptr<session_type>>
+            sessions;
+        {
+            std::lock_guard<std::mutex> lock{sessions_mutex_};
+            closed_ = true;
+            sessions.swap(sessions_);
+        }
+        for (auto& kv : sessions)
+        {
+            kv.second->close();
+            if (notify)
+                processor_.process_close(kv.first);
+        }
+    }
+
+    bool send(wspc::connection_id id, const std::string& payload) override
+    {
+        std::shared_ptr<session_type> session;
+        {
+            std::lock_guard<std::mutex> lock{sessions_mutex_};
+            auto it = sessions_.find(id);
+            if (it == end(sessions_))
+                return false;
+            session = it->second;
+        }
+        session->send(make_frame(payload));
+        return true;
+    }
+
+    void broadcast(const std::string& payload) override
+    {
+        const auto frame = make_frame(payload);
+        std::lock_guard<std::mutex> lock{sessions_mutex_};
+        for (auto& kv : sessions_)
+            kv.second->send(frame);
+    }
+
+    int num_clients() const override
+    {
+        std::lock_guard<std::mutex> lock{sessions_mutex_};
+        return static_cast<int>(sessions_.size());
+    }
+
+    bool connected(wspc::connection_id id) const override
+    {
+        std::lock_guard<std::mutex> lock{sessions_mutex_};
+        return sessions_.count(id) != 0;
+    }
+
+    bool stream(wspc::connection_id id,
+                wspc::message_stream_ptr stream) override
+    {
+        std::shared_ptr<session_type> session;
+        {
+            std::lock_guard<std::mutex> lock{sessions_mutex_};
+            auto it = sessions_.find(id);
+            if (it == end(sessions_))
+                return false;
+            session = it->second;
+        }
+        session->stream(std::move(stream));
+        return true;
+    }
+
+    void set_max_buffered_amount(std::size_t bytes) override
+    {
+        max_buffered_amount_ = bytes;
+    }
+
+    std::uint64_t num_buffer_overflows() const override
+    {
+        return buffer_overflows_;
+    }
+
+    std::size_t max_buffered_amount() const { return max_buffered_amount_; }
+    void buffer_overflow() { ++buffer_overflows_; }
+
+    std::string process_message(wspc::connection_id id,
+                                const std::string& payload)
+    {
+        // Message could have been read just before the transport got closed
+        if (closed_)
+            return {};
+        return processor_.process_message(id, payload);
+    }
+
+    void remove(wspc::connection_id id)
+    {
+        {
+            std::lock_guard<std::mutex> lock{sessions_mutex_};
+            if (!sessions_.erase(id))
+                return;
+        }
+        processor_.process_close(id);
+    }
+
+private:
+    void open(typename Protocol::socket socket)
+    {
+        auto session = std::make_shared<session_type>(
+            this->shared_from_this(), io_service_, std::move(socket));
+        {
+            std::lock_guard<std::mutex> lock{sessions_mutex_};
+            if (closed_)
+                return;
+            sessions_.emplace(session->id(), session);
+        }
+        processor_.process_open(session->id());
+        session->start();
+    }
+
+private:
+    wspc::processor& processor_;
+    boost::asio::io_service& io_service_;
+    typename Protocol::acceptor acceptor_;
+    // Socket for the next connection being accepted
+    typename Protocol::socket socket_;
+
+    mutable std::mutex sessions_mutex_;
+    std::unordered_map<wspc::connection_id, std::shared_ptr<session_type>>
+        sessions_;
+    std::atomic<bool> closed_{false};
+
+    std::atomic<std::size_t> max_buffered_amount_{
+        default_max_buffered_amount};
+    std::atomic<std::uint64_t> buffer_overflows_{0};
+};
+
+template <typename Protocol>
+std::shared_ptr<wspc::stream_transport_impl>
+    make_stream_transport_impl(wspc::processor& processor,
+                               boost::asio::io_service& io_service,
+                               const typename Protocol::endpoint& endpoint)
+{
+    auto impl = std::make_shared<basic_stream_transport_impl<Protocol>>(
+        processor, io_service, endpoint);
+    impl->start_accept();
+    return impl;
+}
+
+std::shared_ptr<wspc::stream_transport_impl>
+    make_tcp_transport_impl(wspc::processor& processor,
+                            boost::asio::io_service& io_service,
+                            std::uint16_t port)
+{
+    using boost::asio::ip::tcp;
+    return make_stream_transport_impl<tcp>(processor, io_service,
+                                           tcp::endpoint{tcp::v6(), port});
+}
+
+std::shared_ptr<wspc::stream_transport_impl>
+    make_unix_transport_impl(wspc::processor& processor,
+                             boost::asio::io_service& io_service,
+                             const std::string& path)
+{
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    using boost::asio::local::stream_protocol;
+    std::remove(path.c_str());
+    return make_stream_transport_impl<stream_protocol>(
+        processor, io_service, stream_protocol::endpoint{path});
+#else
+    (void)processor;
+    (void)io_service;
+    (void)path;
+    throw std::runtime_error{
+        "Unix domain sockets are not supported on this platform"};
+#endif
+}
+} // namespace anonymous
+
+stream_transport::stream_transport(
+    std::shared_ptr<wspc::stream_transport_impl> impl)
+    : impl_{std::move(impl)}
+{
+}
+
+// Processor might be already (partially) destroyed here
+stream_transport::~stream_transport() { impl_->close(false); }
+
+void stream_transport::close() { impl_->close(true); }
+
+bool stream_transport::send(wspc::connection_id id,
+                            const std::string& payload)
+{
+    return impl_->send(id, payload);
+}
+
+void stream_transport::broadcast(const std::string& payload)
+{
+    impl_->broadcast(payload);
+}
+
+int stream_transport::num_clients() const { return impl_->num_clients(); }
+
+bool stream_transport::connected(wspc::connection_id id) const
+{
+    return impl_->connected(id);
+}
+
+bool stream_transport::stream(wspc::connection_id id,
+                              wspc::message_stream_ptr stream)
+{
+    return impl_->stream(id, std::move(stream));
+}
+
+void stream_transport::set_max_buffered_amount(std::size_t bytes)
+{
+    impl_->set_max_buffered_amount(bytes);
+}
+
+std::uint64_t stream_transport::num_buffer_overflows() const
+{
+    return impl_->num_buffer_overflows();
+}
+
+tcp_transport::tcp_transport(wspc::processor& processor,
+                             boost::asio::io_service& io_service,
+                             std::uint16_t port)
+    : stream_transport{make_tcp_transport_impl(processor, io_service, port)}
+{
+}
+
+unix_transport::unix_transport(wspc::processor& processor,
+                               boost::asio::io_service& io_service,
+                               const std::string& path)
+    : stream_transport{make_unix_transport_impl(processor, io_service, path)}
+{
+}
+} // namespace wspc
@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_STREAM_TRANSPORT_HPP_GUARD
+#define WSPC_STREAM_TRANSPORT_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <boost/asio/io_service.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace wspc {
+
+// Forward declarations
+class stream_transport_impl;
+
+// Transport for clients that don't need WebSocket, e.g. other processes on the
+// same host. Every message (JSON-RPC request, response or an event) is framed
+// with 4-byte, big-endian length prefix followed by the payload. There's no
+// handshake, masking nor HTTP pages.
+class stream_transport : public wspc::transport
+{
+public:
+    ~stream_transport() override;
+
+    // Closes all connections, processor is notified about each of them
+    void close() override;
+    bool send(wspc::connection_id id, const std::string& payload) override;
+    void broadcast(const std::string& payload) override;
+    int num_clients() const override;
+    bool connected(wspc::connection_id id) const override;
+    // Pulls next messages as long as less than 1 MiB (or half of the buffered
+    // amount limit) is waiting to be written
+    bool stream(wspc::connection_id id,
+                wspc::message_stream_ptr stream) override;
+
+    // Connections not reading fast enough to keep what's queued for them
+    // below given amount (64 MiB by default) are closed. Zero means no limit.
+    void set_max_buffered_amount(std::size_t bytes);
+    // Number of connections closed for exceeding the buffered amount
+    std::uint64_t num_buffer_overflows() const;
+
+protected:
+    explicit stream_transport(
+        std::shared_ptr<wspc::stream_transport_impl> impl);
+
+private:
+    std::shared_ptr<wspc::stream_transport_impl> impl_;
+};
+
+// Length-prefixed messages over plain TCP (with Nagle's algorithm disabled)
+class tcp_transport : public wspc::stream_transport
+{
+public:
+    tcp_transport(wspc::processor& processor,
+                  boost::asio::io_service& io_service, std::uint16_t port);
+};
+
+// Length-prefixed messages over Unix domain socket bound to given path. Stale
+// socket file is removed before binding.
+class unix_transport : public wspc::stream_transport
+{
+public:
+    unix_transport(wspc::processor& processor,
+                   boost::asio::io_service& io_service,
+                   const std::string& path);
+};
+} // namespace wspc
+
+#endif
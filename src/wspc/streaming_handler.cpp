@@ -0,0 +1,46 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/streaming_handler.hpp"
+
+namespace wspc {
+
+streaming_service_handler::streaming_service_handler(std::size_t chunk_size)
+    : chunk_size_{chunk_size != 0 ? chunk_size : 1}
+{
+}
+
+json11::Json streaming_service_handler::operator()(const json11::Json& request)
+{
+    auto stream = open_stream(request);
+    json11::Json::array items;
+    json11::Json item;
+    while (stream->next(item))
+        items.push_back(std::move(item));
+    return items;
+}
+
+std::size_t streaming_service_handler::chunk_size() const
+{
+    return chunk_size_;
+}
+} // namespace wspc
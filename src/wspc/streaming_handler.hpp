@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_STREAMING_HANDLER_HPP_GUARD
+#define WSPC_STREAMING_HANDLER_HPP_GUARD
+
+#include "wspc/service_handler.hpp"
+#include "wspc/typed_service_handler.hpp"
+
+#include <kl/json_convert.hpp>
+#include <kl/type_traits.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wspc {
+
+// Base class for handlers of procedures producing their result item by item.
+// To connected clients (e.g. over WebSocket) items are sent in chunks as they
+// are produced, paced by the connection's send buffer:
+//   {"id": id, "partial": [items...], "chunk": 0}
+//   {"id": id, "partial": [items...], "chunk": 1}
+//   ...
+//   {"id": id, "result": {"items": number of items, "chunks": 2}}
+// If producing items fails, the last message is an error response instead.
+// Callers without a connection (e.g. HTTP POST) get all items in one array.
+class streaming_service_handler : public wspc::service_handler
+{
+public:
+    explicit streaming_service_handler(std::size_t chunk_size);
+
+    json11::Json operator()(const json11::Json& request) override;
+    wspc::result_stream_ptr
+        open_stream(const json11::Json& request) override = 0;
+    std::size_t chunk_size() const override;
+
+private:
+    std::size_t chunk_size_;
+};
+
+namespace detail {
+
+// Generator is a callable returning boost::optional<Item> (or anything with
+// similar interface), empty when there are no more items
+template <typename Generator>
+class generator_result_stream : public wspc::result_stream
+{
+public:
+    explicit generator_result_stream(Generator generator)
+        : generator_{std::move(generator)}
+    {
+    }
+
+    bool next(json11::Json& item) override
+    {
+        auto value = generator_();
+        if (!value)
+            return false;
+        item = kl::to_json(*value);
+        return true;
+    }
+
+private:
+    Generator generator_;
+};
+
+// Functional wrapper over streaming_service_handler. Request is deserialized
+// the same way as for make_service_handler().
+template <typename Func>
+class streaming_handler_func : public wspc::streaming_service_handler
+{
+    using generator_type =
+        std::decay_t<typename kl::func_traits<Func>::return_type>;
+    using item_type = typename std::decay_t<decltype(
+        std::declval<generator_type&>()())>::value_type;
+    using request_category = get_request_type<Func>;
+
+public:
+    streaming_handler_func(Func func, std::size_t chunk_size)
+        : streaming_service_handler{chunk_size}, func_{std::move(func)}
+    {
+    }
+
+    wspc::result_stream_ptr open_stream(const json11::Json& request) override
+    {
+        try
+        {
+            return std::make_unique<generator_result_stream<generator_type>>(
+                call(request, request_category{}));
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            throw invalid_parameters_exception{"invalid method params: "s +
+                                               ex.what()};
+        }
+    }
+
+    bool validate(const json11::Json& request,
+                  wspc::param_error& error) const override
+    {
+        return detail::validate_request<Func>(request, error,
+                                              request_category{});
+    }
+
+    const std::string& request_description() const override
+    {
+        return detail::request_description<Func>(request_category{});
+    }
+
+    const std::string& response_description() const override
+    {
+        return get_type_info<std::vector<item_type>>();
+    }
+
+private:
+    generator_type call(const json11::Json&, void_type) { return func_(); }
+
+    generator_type call(const json11::Json& request, key_value_type)
+    {
+        return func_(kl::from_json<decayed_first_arg<Func>>(request));
+    }
+
+    generator_type call(const json11::Json& request, tuple_type)
+    {
+        using args_type = decayed_args_tuple_t<Func>;
+        return call_tuple(kl::from_json<args_type>(request),
+                          kl::make_tuple_indices<args_type>{});
+    }
+
+    template <typename Tuple, std::size_t... Is>
+    generator_type call_tuple(Tuple&& args, kl::index_sequence<Is...>)
+    {
+        return func_(std::get<Is>(std::forward<Tuple>(args))...);
+    }
+
+private:
+    Func func_;
+};
+} // namespace detail
+
+// Factory for streaming handlers. Given function takes request arguments
+// (just like in make_service_handler()) and returns a generator.
+// Usage: make_streaming_handler([&](const query& q) {
+//            std::size_t i = 0;
+//            return [&, q, i]() mutable -> boost::optional<row> {
+//                if (i == rows.size())
+//                    return boost::none;
+//                return rows[i++];
+//            };
+//        });
+template <typename Func>
+wspc::service_handler_ptr make_streaming_handler(Func&& func,
+                                                 std::size_t chunk_size = 100)
+{
+    return std::make_unique<detail::streaming_handler_func<std::decay_t<Func>>>(
+        std::forward<Func>(func), chunk_size);
+}
+} // namespace wspc
+
+#endif
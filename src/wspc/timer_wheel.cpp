@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/timer_wheel.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace wspc {
+
+timer_wheel::timer_wheel(clock_type::duration tick, clock_type::time_point now)
+    : tick_{tick}, origin_{now}
+{
+}
+
+void timer_wheel::schedule(clock_type::time_point when, std::uint64_t key)
+{
+    // Round up so a timer never fires early
+    auto since_origin = when > origin_ ? when - origin_
+                                       : clock_type::duration::zero();
+    since_origin = std::min(since_origin, clock_type::duration::max() - tick_);
+    const auto expiry_tick = static_cast<std::uint64_t>(
+        (since_origin + tick_ - clock_type::duration{1}) / tick_);
+    insert(entry{expiry_tick > current_tick_ ? expiry_tick : current_tick_ + 1,
+                 key});
+    ++size_;
+}
+
+void timer_wheel::advance(clock_type::time_point now,
+                          std::vector<std::uint64_t>& expired)
+{
+    if (now < origin_)
+        return;
+    const auto target_tick =
+        static_cast<std::uint64_t>((now - origin_) / tick_);
+
+    while (current_tick_ < target_tick)
+    {
+        // Nothing to wait for, jump straight to the target
+        if (size_ == 0)
+        {
+            current_tick_ = target_tick;
+            break;
+        }
+
+        ++current_tick_;
+        // Level 0 wrapped around - bring timeouts of the next level closer
+        for (std::size_t level_index = 1; level_index < num_levels;
+             ++level_index)
+        {
+            const auto shift = slot_bits * (level_index - 1);
+            if (((current_tick_ >> shift) & (num_slots - 1)) != 0)
+                break;
+            cascade(level_index);
+        }
+
+        auto& slot = levels_[0][current_tick_ & (num_slots - 1)];
+        for (const auto& e : slot)
+            expired.push_back(e.key);
+        size_ -= slot.size();
+        slot.clear();
+    }
+}
+
+void timer_wheel::insert(entry e)
+{
+    const auto delta = e.expiry_tick - current_tick_;
+    for (std::size_t level_index = 0; level_index < num_levels; ++level_index)
+    {
+        const auto shift = slot_bits * level_index;
+        if (delta < (std::uint64_t{1} << (shift + slot_bits)) ||
+            level_index + 1 == num_levels)
+        {
+            auto tick = e.expiry_tick;
+            // Too far away for the last level
+            if (delta >= (std::uint64_t{1} << (shift + slot_bits)))
+                tick = current_tick_ + (std::uint64_t{num_slots - 1} << shift);
+            levels_[level_index][(tick >> shift) & (num_slots - 1)].push_back(
+                e);
+            return;
+        }
+    }
+}
+
+void timer_wheel::cascade(std::size_t level_index)
+{
+    const auto shift = slot_bits * level_index;
+    auto& slot =
+        levels_[level_index][(current_tick_ >> shift) & (num_slots - 1)];
+    auto entries = std::move(slot);
+    slot.clear();
+    for (const auto& e : entries)
+    {
+        // Expire right away if it was due now
+        if (e.expiry_tick <= current_tick_)
+            levels_[0][current_tick_ & (num_slots - 1)].push_back(e);
+        else
+            insert(e);
+    }
+}
+} // namespace wspc
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_TIMER_WHEEL_HPP_GUARD
+#define WSPC_TIMER_WHEEL_HPP_GUARD
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace wspc {
+
+// Hierarchical timer wheel: keeps any number of timeouts at the cost of a
+// single clock driving it, with O(1) insertion. Each of the 4 levels has 64
+// slots, a slot of level N spanning 64^N ticks, so level 0 holds timeouts due
+// within 64 ticks and the rest are cascaded down as the time approaches.
+// Timeouts beyond the last level are parked in its furthest slot.
+//
+// Timers can't be cancelled - the owner is expected to check (when a timer
+// expires) if it still matters. Not thread-safe.
+class timer_wheel
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    explicit timer_wheel(clock_type::duration tick,
+                         clock_type::time_point now = clock_type::now());
+
+    // Key is returned by advance() at (or up to one tick after) given time
+    void schedule(clock_type::time_point when, std::uint64_t key);
+
+    // Moves the wheel forward and appends keys of expired timers
+    void advance(clock_type::time_point now,
+                 std::vector<std::uint64_t>& expired);
+
+    clock_type::duration tick() const { return tick_; }
+    std::size_t size() const { return size_; }
+
+private:
+    struct entry
+    {
+        std::uint64_t expiry_tick;
+        std::uint64_t key;
+    };
+
+    static const std::size_t slot_bits = 6;
+    static const std::size_t num_slots = std::size_t{1} << slot_bits;
+    static const std::size_t num_levels = 4;
+
+    using level = std::array<std::vector<entry>, num_slots>;
+
+    void insert(entry e);
+    void cascade(std::size_t level_index);
+
+private:
+    const clock_type::duration tick_;
+    const clock_type::time_point origin_;
+    std::uint64_t current_tick_{0};
+    std::size_t size_{0};
+    std::array<level, num_levels> levels_;
+};
+} // namespace wspc
+
+#endif
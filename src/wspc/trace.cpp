@@ -0,0 +1,273 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/trace.hpp"
+
+#include <kl/json_convert.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace wspc {
+namespace trace {
+
+namespace {
+
+constexpr std::size_t spans_per_thread = 16384;
+
+struct span
+{
+    const char* name;
+    std::int64_t begin;
+    std::int64_t end;
+    char method[32];
+    char id[24];
+};
+} // namespace anonymous
+
+// Spans recorded by one thread, oldest ones get overwritten once there's
+// spans_per_thread of them
+struct span_chunk
+{
+    span_chunk() { spans.reserve(64); }
+
+    std::vector<span> spans;
+    // Next one to overwrite once there's no room left
+    std::size_t next{0};
+};
+
+// Only the owning thread appends to its current chunk, without locking: it
+// takes the chunk out while appending and puts it back afterwards.
+// dump_chrome_trace() swaps in a fresh chunk, waiting for the owner if it's
+// in the middle of appending.
+struct thread_buffer
+{
+    explicit thread_buffer(unsigned tid) : tid{tid} {}
+    ~thread_buffer() { delete current.load(); }
+
+    // Used by the owning thread
+    span_chunk* acquire() noexcept
+    {
+        return current.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    void release(span_chunk* chunk) noexcept
+    {
+        current.store(chunk, std::memory_order_release);
+    }
+
+    // Used by collector, returns spans recorded so far
+    std::unique_ptr<span_chunk> swap(std::unique_ptr<span_chunk> fresh)
+    {
+        auto chunk = current.load(std::memory_order_relaxed);
+        while (!chunk || !current.compare_exchange_weak(
+                             chunk, fresh.get(), std::memory_order_acq_rel))
+        {
+            std::this_thread::yield();
+            chunk = current.load(std::memory_order_relaxed);
+        }
+        fresh.release();
+        return std::unique_ptr<span_chunk>{chunk};
+    }
+
+    std::atomic<span_chunk*> current{new span_chunk};
+    // Number of scopes constructed but not yet recorded (nested ones), only
+    // for the owning thread
+    std::size_t open_scopes{0};
+    unsigned tid;
+};
+
+namespace {
+
+struct registry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+};
+
+registry& get_registry()
+{
+    static registry reg;
+    return reg;
+}
+
+thread_buffer& local_buffer()
+{
+    // Registry co-owns the buffer so spans of threads that already finished
+    // can still be dumped
+    thread_local std::shared_ptr<thread_buffer> buffer = [] {
+        auto& reg = get_registry();
+        std::lock_guard<std::mutex> lock{reg.mutex};
+        auto buf = std::make_shared<thread_buffer>(
+            static_cast<unsigned>(reg.buffers.size() + 1));
+        reg.buffers.push_back(buf);
+        return buf;
+    }();
+    return *buffer;
+}
+
+std::int64_t now() noexcept
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+template <std::size_t N>
+void copy_truncated(char (&dst)[N], const std::string& src) noexcept
+{
+    const auto len = std::min(src.size(), N - 1);
+    std::memcpy(dst, src.data(), len);
+    dst[len] = 0;
+}
+} // namespace anonymous
+
+scope::scope(const char* name)
+    : buffer_{&local_buffer()}, name_{name}
+{
+    method_[0] = 0;
+    id_[0] = 0;
+
+    // Try to make room for spans of all open scopes so their destructors
+    // don't have to overwrite anything
+    auto& buf = *buffer_;
+    auto chunk = buf.acquire();
+    const auto needed = std::min(
+        chunk->spans.size() + buf.open_scopes + 1, spans_per_thread);
+    if (needed > chunk->spans.capacity())
+    {
+        try
+        {
+            chunk->spans.reserve(
+                std::min(std::max(needed, chunk->spans.capacity() * 2),
+                         spans_per_thread));
+        }
+        catch (...)
+        {
+            buf.release(chunk);
+            throw;
+        }
+    }
+    ++buf.open_scopes;
+    buf.release(chunk);
+
+    begin_ = now();
+}
+
+scope::~scope() noexcept
+{
+    const auto end = now();
+    auto& buf = *buffer_;
+    --buf.open_scopes;
+
+    // Chunk might have been swapped for a smaller one in the meantime, so
+    // without room left the oldest span is overwritten (never allocates)
+    auto chunk = buf.acquire();
+    span* s;
+    if (chunk->spans.size() < chunk->spans.capacity())
+    {
+        chunk->spans.emplace_back();
+        s = &chunk->spans.back();
+    }
+    else
+    {
+        s = &chunk->spans[chunk->next];
+        chunk->next = (chunk->next + 1) % chunk->spans.size();
+    }
+
+    s->name = name_;
+    s->begin = begin_;
+    s->end = end;
+    std::memcpy(s->method, method_, sizeof(method_));
+    std::memcpy(s->id, id_, sizeof(id_));
+    buf.release(chunk);
+}
+
+void scope::set_method(const std::string& method) noexcept
+{
+    copy_truncated(method_, method);
+}
+
+void scope::set_id(const std::string& id) noexcept
+{
+    copy_truncated(id_, id);
+}
+
+std::string dump_chrome_trace()
+{
+    std::vector<std::pair<unsigned, std::unique_ptr<span_chunk>>> chunks;
+    {
+        auto& reg = get_registry();
+        std::lock_guard<std::mutex> lock{reg.mutex};
+        for (const auto& buf : reg.buffers)
+        {
+            chunks.emplace_back(buf->tid,
+                                buf->swap(std::make_unique<span_chunk>()));
+        }
+        // Threads that finished have nothing more to say
+        reg.buffers.erase(
+            std::remove_if(begin(reg.buffers), end(reg.buffers),
+                           [](const std::shared_ptr<thread_buffer>& buf) {
+                               return buf.use_count() == 1;
+                           }),
+            end(reg.buffers));
+    }
+
+    // Formatted without holding any lock
+    json11::Json::array events;
+    for (const auto& kv : chunks)
+    {
+        const auto tid = kv.first;
+        for (const auto& s : kv.second->spans)
+        {
+            json11::Json::object args;
+            if (s.method[0])
+                args["method"] = s.method;
+            if (s.id[0])
+                args["id"] = s.id;
+
+            // Chrome expects timestamps in microseconds
+            events.push_back(json11::Json::object{
+                {"name", s.name},
+                {"cat", "wspc"},
+                {"ph", "X"},
+                {"ts", s.begin / 1000.0},
+                {"dur", (s.end - s.begin) / 1000.0},
+                {"pid", 1},
+                {"tid", static_cast<int>(tid)},
+                {"args", std::move(args)}});
+        }
+    }
+
+    return json11::Json{json11::Json::object{{"traceEvents", std::move(events)},
+                                             {"displayTimeUnit", "ns"}}}
+        .dump();
+}
+} // namespace trace
+} // namespace wspc
@@ -0,0 +1,79 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_TRACE_HPP_GUARD
+#define WSPC_TRACE_HPP_GUARD
+
+#include <cstdint>
+#include <string>
+
+// Request tracing is compiled in only when WSPC_ENABLE_TRACING is defined
+// (CMake option of the same name). Otherwise WSPC_TRACE_* macros expand to
+// nothing and their arguments are never evaluated.
+#if defined(WSPC_ENABLE_TRACING)
+#  define WSPC_TRACE_SCOPE(var, name) ::wspc::trace::scope var{name}
+#  define WSPC_TRACE_METHOD(var, method) var.set_method(method)
+#  define WSPC_TRACE_ID(var, id) var.set_id(id)
+#else
+#  define WSPC_TRACE_SCOPE(var, name) (void)0
+#  define WSPC_TRACE_METHOD(var, method) (void)0
+#  define WSPC_TRACE_ID(var, id) (void)0
+#endif
+
+namespace wspc {
+namespace trace {
+
+struct thread_buffer;
+
+// Measures time from its construction till its destruction and records it as
+// a span into calling thread's ring buffer (oldest spans get overwritten)
+// without taking any lock. Name must be a string literal (or otherwise
+// outlive the trace). Any allocation happens in the constructor so
+// destructor never throws.
+class scope
+{
+public:
+    explicit scope(const char* name);
+    ~scope() noexcept;
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+    // Both are truncated if too long
+    void set_method(const std::string& method) noexcept;
+    void set_id(const std::string& id) noexcept;
+
+private:
+    thread_buffer* buffer_;
+    const char* name_;
+    std::int64_t begin_;
+    char method_[32];
+    char id_[24];
+};
+
+// Returns spans recorded by all threads since the previous call in Chrome
+// trace event format (can be loaded in chrome://tracing or Perfetto UI)
+std::string dump_chrome_trace();
+} // namespace trace
+} // namespace wspc
+
+#endif
@@ -25,69 +25,84 @@
 
 #include <cstdint>
 #include <memory>
-#include <cassert>
 #include <string>
-#include <stdexcept>
 
 namespace wspc {
 
-// Forward declarations
-class transport_impl;
-class processor;
-class broadcaster;
+// Identifies client connection, unique across all transports of a process
+using connection_id = std::uint64_t;
 
-class transport
-{
-public:
-    transport(wspc::processor& processor);
-    ~transport();
+// Returns next free connection id
+wspc::connection_id make_connection_id();
 
-    void close();
+// Passed to processor for messages that don't come from any connection that
+// could be sent to later on (e.g. HTTP POST)
+const wspc::connection_id no_connection = 0;
 
-    // Poll based interface
-    void accept(std::uint16_t port);
-    void poll();
+// Receives messages from transports
+class processor
+{
+public:
+    // Returns body of a response to HTTP GET of given resource (path)
+    virtual std::string process_http(const std::string& resource) = 0;
+    // Returns media type of what process_http returns for given resource
+    virtual std::string http_content_type(const std::string&) const
+    {
+        return "text/html";
+    }
+    virtual std::string process_message(wspc::connection_id id,
+                                        const std::string& payload) = 0;
 
-    // Asio's loop based interface
-    void run(std::uint16_t port);
-    void stop();
+    // Called when client connection is established and after it's closed
+    virtual void process_open(wspc::connection_id) {}
+    virtual void process_close(wspc::connection_id) {}
 
-    wspc::broadcaster get_broadcaster();
-    int num_clients() const;
+    // Whether there are requests of the connection still being processed
+    // (responses to be sent later on). Transports closing connections
+    // gracefully wait for them.
+    virtual bool busy(wspc::connection_id) const { return false; }
 
-private:
-    std::shared_ptr<wspc::transport_impl> impl_;
+protected:
+    ~processor() = default;
 };
 
-// Sends given message to all listening clients
-class broadcaster
+// Lazily produced sequence of messages for one client (e.g. partial results
+// of a streaming procedure)
+class message_stream
 {
 public:
-    void broadcast(const std::string& payload);
-
-private:
-    friend wspc::broadcaster transport::get_broadcaster();
-
-    explicit broadcaster(std::shared_ptr<wspc::transport_impl> svr)
-        : impl_{std::move(svr)}
-    {
-        assert(impl_);
-        if (!impl_)
-            throw std::runtime_error{"svr is null"};
-    }
-
-private:
-    std::shared_ptr<transport_impl> impl_;
+    virtual ~message_stream();
+    // Returns false when there are no more messages
+    virtual bool next(std::string& payload) = 0;
 };
 
-class processor
+using message_stream_ptr = std::unique_ptr<message_stream>;
+
+// Carries JSON-RPC messages and events between processor (e.g. service) and
+// its clients. Implementations call processor's methods for every incoming
+// message and connection state change.
+class transport
 {
 public:
-    virtual std::string process_http() = 0;
-    virtual std::string process_message(const std::string& payload) = 0;
-
-protected:
-    ~processor() = default;
+    virtual ~transport();
+
+    // Closes all client connections
+    virtual void close() = 0;
+
+    // Sends given message to one client only. Returns false if there's no
+    // such connection on this transport.
+    virtual bool send(wspc::connection_id id, const std::string& payload) = 0;
+    // Sends given message to all connected clients
+    virtual void broadcast(const std::string& payload) = 0;
+    virtual int num_clients() const = 0;
+    virtual bool connected(wspc::connection_id id) const = 0;
+
+    // Sends all messages of the stream to given client. Transports that can
+    // tell how much is buffered for the connection pull next messages only
+    // once it drains, the default implementation sends everything at once.
+    // Returns false if there's no such connection on this transport.
+    virtual bool stream(wspc::connection_id id,
+                        wspc::message_stream_ptr stream);
 };
 } // namespace wspc
 
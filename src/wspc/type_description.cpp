@@ -22,25 +22,66 @@
 
 #include "wspc/type_description.hpp"
 
+#include <cstring>
+#include <utility>
+
 namespace wspc {
+
+service_description::service_description()
+{
+    out_ = R"(<!doctype html>
+<html><head><title>WebSocket Test Service</title></head>
+<body><p>List of supported remote procedures: </p>
+<ul>)";
+}
+
+void service_description::add_procedure(const std::string& name,
+                                        const std::string& takes,
+                                        const std::string& returns)
+{
+    out_ += "<li>";
+    out_ += name;
+    out_ += ": </li>\n<ul><li>takes: ";
+    out_ += takes;
+    out_ += "</li>\n<li>returns: ";
+    out_ += returns;
+    out_ += "</li></ul>\n";
+}
+
+void service_description::begin_section(const char* heading)
+{
+    out_ += "</ul>\n<p>";
+    out_ += heading;
+    out_ += "</p><ul>\n";
+}
+
+void service_description::add_item(const std::string& description)
+{
+    out_ += "<li>";
+    out_ += description;
+    out_ += "</li>\n";
+}
+
+std::string service_description::finish()
+{
+    out_ += "</ul>\n</body></html>";
+    return std::move(out_);
+}
+
 namespace detail {
 
-void sanitize_html(std::stringstream& strm, const char* in)
+void sanitize_html(std::string& out, const char* in)
 {
-    for (auto in_ = in; *in_ != 0; ++in_)
+    // Copy runs of characters that don't need escaping at once
+    while (*in)
     {
-        switch (*in_)
-        {
-        case '<':
-            strm << "&lt;";
-            break;
-        case '>':
-            strm << "&gt;";
-            break;
-        default:
-            strm << *in_;
+        const auto len = std::strcspn(in, "<>");
+        out.append(in, len);
+        in += len;
+        if (!*in)
             break;
-        }
+        out += *in == '<' ? "&lt;" : "&gt;";
+        ++in;
     }
 }
 } // namespace detail
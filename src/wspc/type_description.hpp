@@ -26,27 +26,63 @@
 #include <kl/ctti.hpp>
 #include <kl/enum_reflector.hpp>
 #include <kl/enum_traits.hpp>
-#include <kl/stream_join.hpp>
 #include <kl/index_sequence.hpp>
 #include <kl/tuple.hpp>
 
 #include <boost/type_index/ctti_type_index.hpp>
 
-#include <sstream>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <tuple>
 #include <type_traits>
 
 namespace wspc {
 
+// Returns HTML-sanitized description of type T. It's built once, on first use,
+// and then kept for the lifetime of the program so the returned reference
+// stays valid and can be stored instead of a copy.
 template <typename T>
-std::string get_type_info();
-template <typename T>
-void get_type_info(std::stringstream& strm);
+const std::string& get_type_info();
+
+// Builds HTML page describing a service: its procedures, followed by optional
+// sections (e.g. notifications) listing descriptions of types
+class service_description
+{
+public:
+    service_description();
+
+    // Descriptions are expected to be sanitized (see get_type_info)
+    void add_procedure(const std::string& name, const std::string& takes,
+                       const std::string& returns);
+    // Items added afterwards go to the new section
+    void begin_section(const char* heading);
+    void add_item(const std::string& description);
+
+    std::string finish();
+
+private:
+    std::string out_;
+};
 
 namespace detail {
 
-void sanitize_html(std::stringstream& strm, const char* in);
+// Appends 'in' to 'out' with '<' and '>' escaped
+void sanitize_html(std::string& out, const char* in);
+
 template <typename T>
-void sanitize_html_typename(std::stringstream& strm);
+const std::string& sanitized_type_name()
+{
+    static const std::string name = [] {
+        std::string out;
+        sanitize_html(out,
+                      boost::typeindex::ctti_type_index::type_id_with_cvr<T>()
+                          .pretty_name()
+                          .c_str());
+        return out;
+    }();
+    return name;
+}
 
 template <typename T>
 struct is_tuple : std::false_type {};
@@ -63,114 +99,117 @@ using is_custom_type_info =
     kl::bool_constant<kl::is_reflectable<T>::value || is_tuple<T>::value ||
                       is_reflectable_enum<T>::value>;
 
+// Descriptions of nested types are appended from their own (cached)
+// descriptions
 struct type_info_writer
 {
     template <typename T, kl::enable_if<kl::is_reflectable<T>> = 0>
-    static void write(std::stringstream& strm)
+    static void write(std::string& out)
     {
-        sanitize_html_typename<T>(strm);
-        strm << " { ";
-        kl::ctti::reflect<T>(visitor{strm});
-        strm << " }";
+        out += sanitized_type_name<T>();
+        out += " { ";
+        kl::ctti::reflect<T>(visitor{out});
+        out += " }";
     }
 
     template <typename T, kl::enable_if<is_tuple<T>> = 0>
-    static void write(std::stringstream& strm)
+    static void write(std::string& out)
     {
-        write_tuple<T>(strm, kl::make_tuple_indices<T>{});
+        write_tuple<T>(out, kl::make_tuple_indices<T>{});
     }
 
     template <typename T, kl::enable_if<is_reflectable_enum<T>> = 0>
-    static void write(std::stringstream& strm)
+    static void write(std::string& out)
     {
-        sanitize_html_typename<T>(strm);
+        out += sanitized_type_name<T>();
 
         using enum_type = std::remove_cv_t<T>;
         using enum_reflector = kl::enum_reflector<enum_type>;
         using enum_traits = kl::enum_traits<enum_type>;
-        strm << " (";
-        auto joiner = kl::make_outstream_joiner(strm, ", ");
+        out += " (";
+        const auto start = out.size();
         for (auto i = enum_traits::min_value(); i < enum_traits::max_value();
              ++i)
         {
             if (const auto str =
                     enum_reflector::to_string(static_cast<enum_type>(i)))
             {
-                joiner = str;
+                if (out.size() != start)
+                    out += ", ";
+                out += str;
             }
         }
-        strm << ")";
+        out += ")";
     }
 
 private:
     struct visitor
     {
-        explicit visitor(std::stringstream& strm) : strm_{strm} {}
+        explicit visitor(std::string& out) : out_{out} {}
 
         template <typename FieldInfo>
         void operator()(FieldInfo f)
         {
             if (current_field_index_)
-                strm_ << ", ";
-            strm_ << "  ";
-            sanitize_html(strm_, f.name());
-            strm_ << " :: ";
-            get_type_info<typename FieldInfo::type>(strm_);
+                out_ += ", ";
+            out_ += "  ";
+            sanitize_html(out_, f.name());
+            out_ += " :: ";
+            out_ += get_type_info<typename FieldInfo::type>();
             ++current_field_index_;
         }
 
     private:
-        std::stringstream& strm_;
+        std::string& out_;
         std::size_t current_field_index_{0};
     };
 
     template <typename T, std::size_t... Is>
-    static void write_tuple(std::stringstream& strm, kl::index_sequence<Is...>)
+    static void write_tuple(std::string& out, kl::index_sequence<Is...>)
     {
-        strm << "[ ";
-        auto joiner = kl::make_outstream_joiner(strm, ", ");
+        out += "[ ";
+        const auto start = out.size();
         using swallow = std::initializer_list<int>;
         (void)swallow{
-            (joiner = get_type_info<std::tuple_element_t<Is, T>>(), 0)...};
-        strm << " ]";
+            0, (append_element(
+                    out, start, get_type_info<std::tuple_element_t<Is, T>>()),
+                0)...};
+        out += " ]";
     }
-};
 
-template <typename T>
-void sanitize_html_typename(std::stringstream& strm)
-{
-    sanitize_html(strm, boost::typeindex::ctti_type_index::type_id_with_cvr<T>()
-                            .pretty_name()
-                            .c_str());
-}
+    static void append_element(std::string& out, std::size_t start,
+                               const std::string& element)
+    {
+        if (out.size() != start)
+            out += ", ";
+        out += element;
+    }
+};
 
 template <typename T>
-void get_type_info_impl(std::stringstream& strm,
+void get_type_info_impl(std::string& out,
                         std::true_type /*is_custom_type_info*/)
 {
-    type_info_writer::write<T>(strm);
+    type_info_writer::write<T>(out);
 }
 
 template <typename T>
-void get_type_info_impl(std::stringstream& strm,
+void get_type_info_impl(std::string& out,
                         std::false_type /*is_custom_type_info*/)
 {
-    sanitize_html_typename<T>(strm);
+    out += sanitized_type_name<T>();
 }
 } // namespace detail
 
 template <typename T>
-void get_type_info(std::stringstream& strm)
-{
-    detail::get_type_info_impl<T>(strm, detail::is_custom_type_info<T>{});
-}
-
-template <typename T>
-std::string get_type_info()
+const std::string& get_type_info()
 {
-    std::stringstream strm;
-    get_type_info<T>(strm);
-    return strm.str();
+    static const std::string info = [] {
+        std::string out;
+        detail::get_type_info_impl<T>(out, detail::is_custom_type_info<T>{});
+        return out;
+    }();
+    return info;
 }
 } // namespace wspc
 
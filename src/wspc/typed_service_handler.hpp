@@ -23,7 +23,9 @@
 #ifndef WSPC_TYPE_SERVICE_HANDLER_HPP_GUARD
 #define WSPC_TYPE_SERVICE_HANDLER_HPP_GUARD
 
+#include "wspc/param_validation.hpp"
 #include "wspc/service_handler.hpp"
+#include "wspc/session.hpp"
 #include "wspc/type_description.hpp"
 
 #include <kl/json_convert.hpp>
@@ -33,6 +35,8 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <tuple>
+#include <type_traits>
 
 #if defined(_MSC_VER)
 #  pragma warning(push)
@@ -72,7 +76,7 @@ static constexpr auto empty_response = empty_response_t{};
 
 namespace kl {
 template <>
-json11::Json to_json(const wspc::detail::empty_response_t&)
+inline json11::Json to_json(const wspc::detail::empty_response_t&)
 {
     return json11::Json::array{};
 }
@@ -102,12 +106,15 @@ public:
         return kl::to_json(resp_obj);
     }
 
-    std::string request_description() const override
+    void notify(wspc::session&, const json11::Json&) override { handle(); }
+
+    const std::string& request_description() const override
     {
-        return "void";
+        static const std::string description{"void"};
+        return description;
     }
 
-    std::string response_description() const override
+    const std::string& response_description() const override
     {
         return get_type_info<return_type>();
     }
@@ -165,12 +172,32 @@ public:
         }
     }
 
-    std::string request_description() const override
+    void notify(wspc::session&, const json11::Json& request) override
+    {
+        try
+        {
+            handle(kl::from_json<tuple_type>(request));
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            throw invalid_parameters_exception{"invalid method params: "s +
+                                               ex.what()};
+        }
+    }
+
+    bool validate(const json11::Json& request,
+                  wspc::param_error& error) const override
+    {
+        return validate_params<tuple_type>(request, error);
+    }
+
+    const std::string& request_description() const override
     {
         return get_type_info<tuple_type>();
     }
 
-    std::string response_description() const override
+    const std::string& response_description() const override
     {
         return get_type_info<return_type>();
     }
@@ -237,12 +264,32 @@ public:
         }
     }
 
-    std::string request_description() const override
+    void notify(wspc::session&, const json11::Json& request) override
+    {
+        try
+        {
+            handle(kl::from_json<std::decay_t<Request>>(request));
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            throw invalid_parameters_exception{"invalid method params: "s +
+                                               ex.what()};
+        }
+    }
+
+    bool validate(const json11::Json& request,
+                  wspc::param_error& error) const override
+    {
+        return validate_params<Request>(request, error);
+    }
+
+    const std::string& request_description() const override
     {
         return get_type_info<std::decay_t<Request>>();
     }
 
-    std::string response_description() const override
+    const std::string& response_description() const override
     {
         return get_type_info<std::decay_t<Response>>();
     }
@@ -321,6 +368,182 @@ struct get_request_type<
     : void_type
 {};
 
+template <typename Signature>
+struct decayed_args_tuple;
+
+template <typename Return, typename... Args>
+struct decayed_args_tuple<Return(Args...)>
+{
+    using type = std::tuple<std::decay_t<Args>...>;
+};
+
+template <typename Func>
+using decayed_args_tuple_t = typename decayed_args_tuple<
+    typename kl::func_traits<Func>::signature_type>::type;
+
+// Description of request taken by given function
+template <typename Func>
+const std::string& request_description(void_type)
+{
+    static const std::string description{"void"};
+    return description;
+}
+
+template <typename Func>
+const std::string& request_description(key_value_type)
+{
+    return get_type_info<decayed_first_arg<Func>>();
+}
+
+template <typename Func>
+const std::string& request_description(tuple_type)
+{
+    return get_type_info<decayed_args_tuple_t<Func>>();
+}
+
+// Non-throwing check of request taken by given function
+template <typename Func>
+bool validate_request(const json11::Json&, wspc::param_error&, void_type)
+{
+    return true;
+}
+
+template <typename Func>
+bool validate_request(const json11::Json& request, wspc::param_error& error,
+                      key_value_type)
+{
+    return validate_params<decayed_first_arg<Func>>(request, error);
+}
+
+template <typename Func>
+bool validate_request(const json11::Json& request, wspc::param_error& error,
+                      tuple_type)
+{
+    return validate_params<decayed_args_tuple_t<Func>>(request, error);
+}
+
+// Handlers may take session of requesting connection as their first
+// argument: wspc::session&
+template <typename Func, typename = kl::void_t<>>
+struct takes_session : std::false_type
+{};
+template <typename Func>
+struct takes_session<
+    Func, kl::void_t<std::enable_if_t<(kl::func_traits<Func>::arity > 0)>>>
+    : std::is_same<typename kl::func_traits<Func>::template arg<0>::type,
+                   wspc::session&>
+{};
+
+// Implementation of service_handler for functions taking wspc::session& as
+// the first argument. The rest of arguments are deserialized with the same
+// rules as for functions without a session.
+template <typename Func,
+          typename Signature = typename kl::func_traits<Func>::signature_type>
+class service_handler_session_func;
+
+template <typename Func, typename Return, typename... Args>
+class service_handler_session_func<Func, Return(wspc::session&, Args...)>
+    : public wspc::service_handler
+{
+    // Stands in for the function without its session argument when
+    // classifying the request
+    struct unbound_func
+    {
+        Return operator()(Args...) const;
+    };
+    using request_category = get_request_type<unbound_func>;
+
+public:
+    service_handler_session_func(Func func) : call_{std::move(func)} {}
+
+    json11::Json operator()(const json11::Json& request) override
+    {
+        // Not coming from any connection
+        wspc::session session{wspc::no_connection};
+        return invoke(session, request);
+    }
+
+    json11::Json invoke(wspc::session& session,
+                        const json11::Json& request) override
+    {
+        try
+        {
+            const auto resp_obj =
+                empty_response[call(session, request, request_category{}),
+                               empty_response];
+            return kl::to_json(resp_obj);
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            throw invalid_parameters_exception{"invalid method params: "s +
+                                               ex.what()};
+        }
+    }
+
+    void notify(wspc::session& session, const json11::Json& request) override
+    {
+        try
+        {
+            call(session, request, request_category{});
+        }
+        catch (kl::json_deserialize_exception& ex)
+        {
+            using namespace std::string_literals;
+            throw invalid_parameters_exception{"invalid method params: "s +
+                                               ex.what()};
+        }
+    }
+
+    bool takes_session() const override { return true; }
+
+    bool validate(const json11::Json& request,
+                  wspc::param_error& error) const override
+    {
+        return validate_request<unbound_func>(request, error,
+                                              request_category{});
+    }
+
+    const std::string& request_description() const override
+    {
+        return detail::request_description<unbound_func>(request_category{});
+    }
+
+    const std::string& response_description() const override
+    {
+        return get_type_info<std::decay_t<Return>>();
+    }
+
+private:
+    // Deserializes the request and calls the function, result (if any) is
+    // left for the caller to serialize
+    Return call(wspc::session& session, const json11::Json&, void_type)
+    {
+        return call_(session);
+    }
+
+    Return call(wspc::session& session, const json11::Json& request,
+                key_value_type)
+    {
+        auto req_obj = kl::from_json<decayed_first_arg<unbound_func>>(request);
+        return call_(session, req_obj);
+    }
+
+    Return call(wspc::session& session, const json11::Json& request,
+                tuple_type)
+    {
+        auto req_obj =
+            kl::from_json<decayed_args_tuple_t<unbound_func>>(request);
+        return kl::tuple::apply_fn::call(
+            req_obj, [&](const auto&... args) -> Return {
+                return this->call_(session, args...);
+            });
+    }
+
+private:
+    std::function<Return(wspc::session&, Args...)> call_;
+};
+
 template <typename Func>
 wspc::service_handler_ptr make_service_handler(Func&& func, tuple_type)
 {
@@ -341,6 +564,23 @@ wspc::service_handler_ptr make_service_handler(Func&& func, void_type)
     return std::make_unique<wspc::detail::service_handler_void_func<Func>>(
         std::forward<Func>(func));
 }
+
+template <typename Func>
+wspc::service_handler_ptr make_service_handler(Func&& func,
+                                               std::false_type /*session*/)
+{
+    return make_service_handler(std::forward<Func>(func),
+                                get_request_type<Func>{});
+}
+
+template <typename Func>
+wspc::service_handler_ptr make_service_handler(Func&& func,
+                                               std::true_type /*session*/)
+{
+    return std::make_unique<
+        wspc::detail::service_handler_session_func<Func>>(
+        std::forward<Func>(func));
+}
 } // namespace detail
 
 // Factory for service_handler_func or service_handler_kv_func.
@@ -352,11 +592,13 @@ wspc::service_handler_ptr make_service_handler(Func&& func, void_type)
 //  - request's argument and response types. None of them can be void.
 //  - Request and Response types iff lambda is defined in terms of
 //    <Response(Request)>. 
+//  - Optional wspc::session& as the first argument, e.g.
+//    make_service_handler([&](wspc::session& s, int a0) { ... });
 template <typename Func>
 wspc::service_handler_ptr make_service_handler(Func&& func)
 {
     return detail::make_service_handler(std::forward<Func>(func),
-                                        detail::get_request_type<Func>{});
+                                        detail::takes_session<Func>{});
 }
 } // namespace wspc
 
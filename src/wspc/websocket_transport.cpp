@@ -0,0 +1,1807 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/websocket_transport.hpp"
+#include "wspc/capture.hpp"
+#include "wspc/timer_wheel.hpp"
+#include "wspc/trace.hpp"
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+#  define _WEBSOCKETPP_NOEXCEPT_
+#endif
+#define _WEBSOCKETPP_CPP11_CHRONO_
+#define _WEBSOCKETPP_CPP11_THREAD_
+#define _WEBSOCKETPP_CPP11_FUNCTIONAL_
+#define _WEBSOCKETPP_CPP11_SYSTEM_ERROR_
+#define _WEBSOCKETPP_CPP11_RANDOM_DEVICE_
+#define _WEBSOCKETPP_CPP11_MEMORY_
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#if defined(WSPC_ENABLE_TLS)
+#  include <websocketpp/config/asio.hpp>
+#endif
+#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+#include <websocketpp/server.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#if defined(WSPC_ENABLE_TLS)
+#  include <openssl/ssl.h>
+#endif
+
+#if defined(__linux__)
+#  include <sys/epoll.h>
+#  include <unistd.h>
+#endif
+
+namespace wspc {
+
+using clock_type = std::chrono::steady_clock;
+
+// Callbacks waiting for any message of a connection to be written out
+class write_waiters
+{
+public:
+    void add(std::function<void()> waiter)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        waiters_.push_back(std::move(waiter));
+        waiting_ = true;
+    }
+
+    // Called whenever connection's message is released
+    void notify()
+    {
+        if (!waiting_)
+            return;
+        std::vector<std::function<void()>> waiters;
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            waiters.swap(waiters_);
+            waiting_ = false;
+        }
+        for (auto& waiter : waiters)
+            waiter();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::function<void()>> waiters_;
+    std::atomic<bool> waiting_{false};
+};
+
+// Data attached to every websocketpp connection
+struct connection_data
+{
+    wspc::connection_id id{0};
+    // Serves connection's path (see websocket_transport::route)
+    wspc::processor* processor{nullptr};
+    // Keep-alive bookkeeping, read by timer wheel (see
+    // websocket_transport::set_keepalive). Time since clock's epoch.
+    std::atomic<clock_type::rep> last_seen{0};
+    std::atomic<clock_type::rep> last_message{0};
+    // Zero when there's no ping waiting for a pong
+    std::atomic<clock_type::rep> ping_sent{0};
+    // Message streams not sent out entirely yet
+    std::atomic<int> active_streams{0};
+    // Notified about every message we send once it's written out
+    std::shared_ptr<write_waiters> writes{std::make_shared<write_waiters>()};
+};
+
+// Free messages kept for reuse, shared by all connections. Bigger buffers
+// are released so that a single huge message doesn't pin its memory forever.
+const std::size_t max_pooled_messages = 1024;
+const std::size_t max_pooled_capacity = 16 * 1024;
+// Each thread keeps up to that many free messages (and shared_ptr control
+// blocks) for itself
+const std::size_t thread_cached_messages = 64;
+
+// Messages (along with their payload buffers) released by any connection and
+// any thread, waiting to be reused. Messages are mostly released by the
+// thread that acquired them (the one serving the connection) so each thread
+// has its own cache and the shared pool, along with its mutex, is touched
+// only when the cache runs dry or overflows - half of the cache at a time.
+template <typename Message>
+class message_pool
+{
+public:
+    static message_pool& instance()
+    {
+        // Leaked on purpose: messages can still be released during static
+        // destruction
+        static auto pool = new message_pool;
+        return *pool;
+    }
+
+    std::unique_ptr<Message> acquire()
+    {
+        auto cache = local_cache();
+        if (!cache)
+            return take_one();
+        if (cache->free.empty())
+            refill(cache->free);
+        if (cache->free.empty())
+            return nullptr;
+        auto msg = std::move(cache->free.back());
+        cache->free.pop_back();
+        return msg;
+    }
+
+    void release(Message* msg)
+    {
+        std::unique_ptr<Message> owned{msg};
+        if (msg->get_raw_payload().capacity() > max_pooled_capacity)
+            return;
+        auto cache = local_cache();
+        if (!cache)
+        {
+            std::vector<std::unique_ptr<Message>> one;
+            one.push_back(std::move(owned));
+            return spill(one, 1);
+        }
+        cache->free.push_back(std::move(owned));
+        if (cache->free.size() > thread_cached_messages)
+            spill(cache->free, thread_cached_messages / 2);
+    }
+
+private:
+    struct thread_cache
+    {
+        ~thread_cache()
+        {
+            cache_destroyed_ = true;
+            instance().spill(free, free.size());
+        }
+
+        std::vector<std::unique_ptr<Message>> free;
+    };
+
+    // Null while the thread is exiting
+    static thread_cache* local_cache()
+    {
+        if (cache_destroyed_)
+            return nullptr;
+        thread_local thread_cache cache;
+        return &cache;
+    }
+
+    std::unique_ptr<Message> take_one()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (free_.empty())
+            return nullptr;
+        auto msg = std::move(free_.back());
+        free_.pop_back();
+        return msg;
+    }
+
+    void refill(std::vector<std::unique_ptr<Message>>& out)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto count = std::min(free_.size(), thread_cached_messages / 2);
+        std::move(free_.end() - count, free_.end(), std::back_inserter(out));
+        free_.resize(free_.size() - count);
+    }
+
+    // Moves last count messages to the shared pool, those not fitting there
+    // are destroyed (outside of the lock)
+    void spill(std::vector<std::unique_ptr<Message>>& from, std::size_t count)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            while (count != 0 && free_.size() < max_pooled_messages)
+            {
+                free_.push_back(std::move(from.back()));
+                from.pop_back();
+                --count;
+            }
+        }
+        from.resize(from.size() - count);
+    }
+
+private:
+    static thread_local bool cache_destroyed_;
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Message>> free_;
+};
+
+template <typename Message>
+thread_local bool message_pool<Message>::cache_destroyed_ = false;
+
+// Free blocks of given size kept by each thread
+template <std::size_t Size>
+class block_cache
+{
+public:
+    static void* acquire()
+    {
+        auto cache = local_cache();
+        if (!cache || cache->count == 0)
+            return ::operator new(Size);
+        return cache->blocks[--cache->count];
+    }
+
+    static void release(void* block)
+    {
+        auto cache = local_cache();
+        if (!cache || cache->count == thread_cached_messages)
+            return ::operator delete(block);
+        cache->blocks[cache->count++] = block;
+    }
+
+private:
+    struct thread_cache
+    {
+        ~thread_cache()
+        {
+            cache_destroyed_ = true;
+            for (std::size_t i = 0; i < count; ++i)
+                ::operator delete(blocks[i]);
+        }
+
+        void* blocks[thread_cached_messages];
+        std::size_t count{0};
+    };
+
+    // Null while the thread is exiting
+    static thread_cache* local_cache()
+    {
+        if (cache_destroyed_)
+            return nullptr;
+        thread_local thread_cache cache;
+        return &cache;
+    }
+
+    static thread_local bool cache_destroyed_;
+};
+
+template <std::size_t Size>
+thread_local bool block_cache<Size>::cache_destroyed_ = false;
+
+// Allocates shared_ptr control blocks of pooled messages from per-thread
+// caches so that getting a message doesn't need the heap either
+template <typename T>
+struct control_block_allocator
+{
+    using value_type = T;
+
+    control_block_allocator() = default;
+    template <typename U>
+    control_block_allocator(const control_block_allocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (n != 1)
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(block_cache<sizeof(T)>::acquire());
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        if (n != 1)
+            return ::operator delete(p);
+        block_cache<sizeof(T)>::release(p);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const control_block_allocator<T>&,
+                const control_block_allocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const control_block_allocator<T>&,
+                const control_block_allocator<U>&)
+{
+    return false;
+}
+
+// Replaces websocketpp's con_msg_manager which allocates a new message and
+// payload string for every incoming and outgoing frame
+template <typename Message>
+class pooled_con_msg_manager
+    : public std::enable_shared_from_this<pooled_con_msg_manager<Message>>
+{
+public:
+    using type = pooled_con_msg_manager<Message>;
+    using ptr = std::shared_ptr<type>;
+    using weak_ptr = std::weak_ptr<type>;
+    using message_ptr = typename Message::ptr;
+
+    message_ptr get_message()
+    {
+        return get_message(websocketpp::frame::opcode::text, 0);
+    }
+
+    message_ptr get_message(websocketpp::frame::opcode::value op,
+                            std::size_t size)
+    {
+        auto& pool = message_pool<Message>::instance();
+        return message_ptr{make(this->shared_from_this(), op, size).release(),
+                           [&pool](Message* released) {
+                               pool.release(released);
+                           },
+                           control_block_allocator<Message>{}};
+    }
+
+    // Outgoing message not tied to any connection's manager. Calls
+    // on_release once websocketpp is done with it: it's been written out
+    // or dropped along with its connection.
+    static message_ptr get_message(websocketpp::frame::opcode::value op,
+                                   std::size_t size,
+                                   std::function<void()> on_release)
+    {
+        auto& pool = message_pool<Message>::instance();
+        return message_ptr{make(nullptr, op, size).release(),
+                           [&pool, on_release](Message* released) {
+                               pool.release(released);
+                               on_release();
+                           },
+                           control_block_allocator<Message>{}};
+    }
+
+    // Same as above, notifies connection's write waiters instead
+    static message_ptr get_message(websocketpp::frame::opcode::value op,
+                                   std::size_t size,
+                                   std::shared_ptr<write_waiters> writes)
+    {
+        auto& pool = message_pool<Message>::instance();
+        return message_ptr{make(nullptr, op, size).release(),
+                           [&pool, writes](Message* released) {
+                               pool.release(released);
+                               writes->notify();
+                           },
+                           control_block_allocator<Message>{}};
+    }
+
+    // Messages are returned to the pool when the last reference is gone
+    bool recycle(Message*) { return false; }
+
+private:
+    static std::unique_ptr<Message> make(const ptr& manager,
+                                         websocketpp::frame::opcode::value op,
+                                         std::size_t size)
+    {
+        auto msg = message_pool<Message>::instance().acquire();
+        if (!msg)
+            return std::make_unique<Message>(manager, op, size);
+
+        // Same state as of a freshly constructed one
+        msg->set_opcode(op);
+        msg->set_header("");
+        msg->set_prepared(false);
+        msg->set_fin(true);
+        msg->set_terminal(false);
+        msg->set_compressed(false);
+        msg->get_raw_payload().clear();
+        msg->get_raw_payload().reserve(size);
+        return msg;
+    }
+};
+
+// websocketpp config with our per-connection data and pooled messages
+template <typename Config>
+struct server_backend : Config
+{
+    using connection_base = connection_data;
+
+    using message_type =
+        websocketpp::message_buffer::message<pooled_con_msg_manager>;
+    using con_msg_manager_type = pooled_con_msg_manager<message_type>;
+    using endpoint_msg_manager_type =
+        websocketpp::message_buffer::alloc::endpoint_msg_manager<
+            con_msg_manager_type>;
+};
+
+// Streams are paused when there's more than that buffered for the connection
+const std::size_t max_stream_buffered_amount = 1024 * 1024;
+
+const clock_type::duration keepalive_tick = std::chrono::milliseconds{100};
+const clock_type::duration drain_tick = std::chrono::milliseconds{10};
+
+clock_type::rep to_rep(clock_type::time_point t)
+{
+    return t.time_since_epoch().count();
+}
+
+clock_type::time_point from_rep(clock_type::rep rep)
+{
+    return clock_type::time_point{clock_type::duration{rep}};
+}
+
+// Interface of websocket_transport independent of websocketpp config
+// (plain or TLS)
+class websocket_transport_impl
+{
+public:
+    virtual ~websocket_transport_impl() = default;
+
+    // Operations on connections are limited to those of given route (its
+    // processor), null means all connections
+    virtual void close(const wspc::processor* route) = 0;
+    virtual void add_route(const std::string& path,
+                           wspc::processor& processor) = 0;
+    virtual void accept(std::uint16_t port, bool reuse_port) = 0;
+    virtual void adopt_listener(int fd) = 0;
+    virtual int listen_descriptor() const = 0;
+    virtual void drain(clock_type::duration window,
+                       std::function<void()> done) = 0;
+    virtual void poll() = 0;
+    virtual bool poll(std::size_t max_messages,
+                      std::chrono::steady_clock::duration max_duration) = 0;
+    virtual int poll_descriptor() const = 0;
+    virtual void run(std::uint16_t port) = 0;
+    virtual void stop() = 0;
+    virtual void capture(const std::string& path) = 0;
+    virtual bool send(const wspc::processor* route, wspc::connection_id id,
+                      const std::string& payload) = 0;
+    virtual void broadcast(const wspc::processor* route,
+                           const std::string& payload) = 0;
+    virtual int num_clients(const wspc::processor* route) const = 0;
+    virtual bool connected(const wspc::processor* route,
+                           wspc::connection_id id) const = 0;
+    virtual bool stream(const wspc::processor* route, wspc::connection_id id,
+                        wspc::message_stream_ptr stream) = 0;
+    virtual boost::asio::io_service& get_io_service() = 0;
+    virtual void set_keepalive(clock_type::duration ping_interval,
+                               clock_type::duration pong_timeout,
+                               clock_type::duration idle_timeout) = 0;
+    virtual void set_max_message_size(std::size_t bytes) = 0;
+    virtual void set_max_buffered_amount(std::size_t bytes) = 0;
+    virtual std::uint64_t num_buffer_overflows() const = 0;
+    virtual wspc::keepalive_stats get_keepalive_stats() const = 0;
+};
+
+template <typename Backend>
+class basic_websocket_transport_impl final
+    : public websocket_transport_impl,
+      public std::enable_shared_from_this<
+          basic_websocket_transport_impl<Backend>>
+{
+    using server_type = websocketpp::server<Backend>;
+    using connection_ptr = typename server_type::connection_ptr;
+    using connection_type = typename server_type::connection_type;
+    using message_ptr = typename server_type::message_ptr;
+    using message_type = typename Backend::message_type;
+
+public:
+    // Without default processor only routed paths are served
+    basic_websocket_transport_impl(wspc::processor* processor,
+                                   boost::asio::io_service* io_service)
+        : processor_{processor}
+    {
+        // Without an external io_service websocketpp creates its own
+        if (io_service)
+            server_.init_asio(io_service);
+        else
+            server_.init_asio();
+#if defined(__linux__)
+        poll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
+        server_.set_validate_handler([this](websocketpp::connection_hdl hdl) {
+            connection_ptr con = server_.get_con_from_hdl(hdl);
+            std::string resource;
+            con->processor = find_route(con->get_resource(), resource);
+            if (con->processor)
+                return true;
+            con->set_status(websocketpp::http::status_code::not_found);
+            return false;
+        });
+
+        server_.set_open_handler([this](websocketpp::connection_hdl hdl) {
+            connection_ptr con = server_.get_con_from_hdl(hdl);
+            const auto now = clock_type::now();
+            con->last_seen = con->last_message = to_rep(now);
+            {
+                std::lock_guard<std::mutex> lock{connections_mutex_};
+                con->id = wspc::make_connection_id();
+                connections_.emplace(con->id,
+                                     connection_entry{hdl, con->processor});
+            }
+            watch(con->get_raw_socket().native_handle());
+            track(*con, now);
+            con->processor->process_open(con->id);
+            // Handshake completed after drain() has begun, client can go
+            // straight to the new instance
+            if (draining_)
+            {
+                std::error_code ec;
+                con->close(websocketpp::close::status::service_restart,
+                           "server restart", ec);
+            }
+        });
+
+        server_.set_close_handler([this](websocketpp::connection_hdl hdl) {
+            connection_ptr con = server_.get_con_from_hdl(hdl);
+            // Closing the socket removes it from the epoll set
+            bool drained;
+            {
+                std::lock_guard<std::mutex> lock{connections_mutex_};
+                connections_.erase(con->id);
+                drained = draining_ && connections_.empty();
+            }
+            con->processor->process_close(con->id);
+            if (drained)
+                finish_drain();
+        });
+
+        server_.set_message_handler([this](websocketpp::connection_hdl hdl,
+                                           message_ptr msg) {
+            // Single read can carry many frames. Those over poll's budget
+            // wait for the next poll.
+            if (!take_budget())
+            {
+                std::lock_guard<std::mutex> lock{deferred_mutex_};
+                deferred_.emplace_back(std::move(hdl), std::move(msg));
+                return;
+            }
+            process_message(hdl, msg);
+        });
+
+        server_.set_pong_handler(
+            [this](websocketpp::connection_hdl hdl, std::string) {
+                connection_ptr con =
+                    server_.get_con_from_hdl(hdl);
+                con->last_seen = to_rep(clock_type::now());
+                con->ping_sent = 0;
+            });
+
+        server_.set_http_handler([this](websocketpp::connection_hdl hdl) {
+            connection_ptr con = server_.get_con_from_hdl(hdl);
+            std::string resource;
+            auto processor = find_route(con->get_resource(), resource);
+            if (!processor)
+            {
+                con->set_status(websocketpp::http::status_code::not_found);
+                return;
+            }
+            try
+            {
+                // JSON-RPC request or batch from a one-shot caller. Note
+                // websocketpp closes the connection after every HTTP
+                // response, use wspc::http_transport for keep-alive.
+                if (con->get_request().get_method() == "POST")
+                    return process_post(*con, *processor);
+                con->set_body(processor->process_http(resource));
+                con->replace_header("Content-Type",
+                                    processor->http_content_type(resource));
+                con->set_status(websocketpp::http::status_code::ok);
+            }
+            catch (std::exception& ex)
+            {
+                con->set_body(ex.what());
+                con->set_status(
+                    websocketpp::http::status_code::internal_server_error);
+            }
+        });
+    }
+
+    ~basic_websocket_transport_impl() override
+    {
+#if defined(__linux__)
+        if (poll_fd_ != -1)
+            ::close(poll_fd_);
+#endif
+    }
+
+    void close(const wspc::processor* route) override
+    {
+        // Other routes are still served
+        if (!route)
+        {
+            {
+                // Otherwise it'd keep io_service running forever
+                std::lock_guard<std::mutex> lock{wheel_mutex_};
+                if (wheel_timer_)
+                    wheel_timer_->cancel();
+                wheel_.reset();
+            }
+            std::lock_guard<std::mutex> lock{drain_mutex_};
+            if (drain_timer_)
+                drain_timer_->cancel();
+            drain_queue_.clear();
+        }
+
+        std::vector<websocketpp::connection_hdl> hdls;
+        {
+            std::lock_guard<std::mutex> lock{connections_mutex_};
+            for (auto& kv : connections_)
+            {
+                if (on_route(kv.second, route))
+                    hdls.push_back(kv.second.hdl);
+            }
+        }
+
+        for (auto& hdl : hdls)
+        {
+            connection_ptr con = server_.get_con_from_hdl(hdl);
+            con->close(websocketpp::close::status::service_restart,
+                       "connection closed");
+        }
+    }
+
+    void add_route(const std::string& path,
+                   wspc::processor& processor) override
+    {
+        auto route = path;
+        // "/data/" is the same as "/data"
+        while (!route.empty() && route.back() == '/')
+            route.pop_back();
+        routes_.emplace_back(std::move(route), &processor);
+    }
+
+    void accept(std::uint16_t port, bool reuse_port) override
+    {
+        if (port_ != 0)
+            return;
+
+        // We manage the listening socket ourselves (instead of
+        // server_.listen()) so its descriptor can be watched as well
+        using boost::asio::ip::tcp;
+        const tcp::endpoint endpoint{tcp::v6(), port};
+        acceptor_ = std::make_unique<tcp::acceptor>(server_.get_io_service());
+        acceptor_->open(endpoint.protocol());
+        if (reuse_port)
+        {
+#if defined(SO_REUSEPORT)
+            using reuse_port_option =
+                boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                            SO_REUSEPORT>;
+            acceptor_->set_option(reuse_port_option{true});
+#else
+            throw std::runtime_error{"SO_REUSEPORT is not supported"};
+#endif
+        }
+        acceptor_->bind(endpoint);
+        acceptor_->listen();
+        watch(acceptor_->native_handle());
+
+        start_accept();
+        port_ = port;
+    }
+
+    void adopt_listener(int fd) override
+    {
+        if (port_ != 0)
+            return;
+
+        // Socket can be bound to IPv4 or IPv6 address
+        sockaddr_storage addr{};
+        socklen_t addr_size = sizeof(addr);
+        if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr),
+                          &addr_size) != 0)
+        {
+            throw std::system_error{errno, std::system_category(),
+                                    "invalid listening socket"};
+        }
+
+        using boost::asio::ip::tcp;
+        acceptor_ = std::make_unique<tcp::acceptor>(server_.get_io_service());
+        acceptor_->assign(addr.ss_family == AF_INET ? tcp::v4() : tcp::v6(),
+                          fd);
+        watch(fd);
+
+        start_accept();
+        port_ = acceptor_->local_endpoint().port();
+    }
+
+    int listen_descriptor() const override
+    {
+        if (!acceptor_ || !acceptor_->is_open())
+            return -1;
+        return static_cast<int>(acceptor_->native_handle());
+    }
+
+    void drain(clock_type::duration window,
+               std::function<void()> done) override
+    {
+        if (acceptor_ && acceptor_->is_open())
+        {
+            // Descriptor shared with another process stays open (and in the
+            // epoll set) after we close our copy
+            unwatch(acceptor_->native_handle());
+            accept_backlog();
+            boost::system::error_code ec;
+            acceptor_->close(ec);
+        }
+
+        bool drained;
+        {
+            std::lock_guard<std::mutex> lock{drain_mutex_};
+            drain_queue_.clear();
+            {
+                std::lock_guard<std::mutex> connections_lock{
+                    connections_mutex_};
+                for (const auto& kv : connections_)
+                    drain_queue_.push_back(kv.first);
+                draining_ = true;
+                drained = connections_.empty();
+            }
+            drain_start_ = clock_type::now();
+            drain_window_ = window;
+            drain_total_ = drain_queue_.size();
+            drain_closed_ = 0;
+            drain_done_ = std::move(done);
+
+            if (!drain_timer_)
+            {
+                drain_timer_ = std::make_unique<boost::asio::steady_timer>(
+                    server_.get_io_service());
+            }
+            if (!drained)
+                arm_drain_timer();
+        }
+
+        if (drained)
+        {
+            std::weak_ptr<basic_websocket_transport_impl> weak_self =
+                this->shared_from_this();
+            server_.get_io_service().post([weak_self] {
+                if (auto self = weak_self.lock())
+                    self->finish_drain();
+            });
+        }
+    }
+
+    void poll() override
+    {
+        process_deferred();
+        server_.poll();
+    }
+
+    bool poll(std::size_t max_messages,
+              std::chrono::steady_clock::duration max_duration) override
+    {
+        const auto deadline = std::chrono::steady_clock::now() + max_duration;
+        poll_budget_ = max_messages;
+
+        bool exhausted = !process_deferred();
+        while (!exhausted)
+        {
+            if (server_.poll_one() == 0)
+                break;
+            exhausted = poll_budget_ == 0 ||
+                        std::chrono::steady_clock::now() >= deadline;
+        }
+
+        poll_budget_ = unlimited_budget;
+        return exhausted;
+    }
+
+    int poll_descriptor() const override
+    {
+        return poll_fd_;
+    }
+
+    void run(std::uint16_t port) override
+    {
+        // Might be listening already, see accept() and adopt_listener()
+        accept(port, false);
+        process_deferred();
+        server_.run();
+    }
+
+    void stop() override
+    {
+        server_.stop();
+    }
+
+    void capture(const std::string& path) override
+    {
+        capture_ = std::make_unique<wspc::capture_writer>(path);
+    }
+
+    bool send(const wspc::processor* route, wspc::connection_id id,
+              const std::string& payload) override
+    {
+        websocketpp::connection_hdl hdl;
+        if (!find_connection(route, id, hdl))
+            return false;
+        std::error_code ec;
+        connection_ptr con = server_.get_con_from_hdl(hdl, ec);
+        if (!ec)
+            send_capped(*con, payload);
+        return true;
+    }
+
+    void broadcast(const wspc::processor* route,
+                   const std::string& payload) override
+    {
+        std::lock_guard<std::mutex> lock{connections_mutex_};
+        for (auto& kv : connections_)
+        {
+            if (!on_route(kv.second, route))
+                continue;
+            std::error_code ec;
+            connection_ptr con =
+                server_.get_con_from_hdl(kv.second.hdl, ec);
+            if (!ec)
+                send_capped(*con, payload);
+        }
+    }
+
+    int num_clients(const wspc::processor* route) const override
+    {
+        std::lock_guard<std::mutex> lock{connections_mutex_};
+        if (!route)
+            return connections_.size();
+        return static_cast<int>(
+            std::count_if(begin(connections_), end(connections_),
+                          [route](const auto& kv) {
+                              return kv.second.processor == route;
+                          }));
+    }
+
+    bool connected(const wspc::processor* route,
+                   wspc::connection_id id) const override
+    {
+        websocketpp::connection_hdl hdl;
+        return find_connection(route, id, hdl);
+    }
+
+    bool stream(const wspc::processor* route, wspc::connection_id id,
+                wspc::message_stream_ptr stream) override
+    {
+        websocketpp::connection_hdl hdl;
+        if (!find_connection(route, id, hdl))
+            return false;
+        std::error_code ec;
+        connection_ptr con = server_.get_con_from_hdl(hdl, ec);
+        if (ec)
+            return false;
+        ++con->active_streams;
+
+        auto state =
+            std::make_shared<stream_state>(std::move(hdl), std::move(stream));
+        std::weak_ptr<basic_websocket_transport_impl> weak_self =
+            this->shared_from_this();
+        server_.get_io_service().post([weak_self, state] {
+            if (auto self = weak_self.lock())
+                self->pump(state);
+        });
+        return true;
+    }
+
+    boost::asio::io_service& get_io_service() override
+    {
+        return server_.get_io_service();
+    }
+
+    // Only for TLS backend
+    template <typename Handler>
+    void set_tls_init_handler(Handler handler)
+    {
+        server_.set_tls_init_handler(std::move(handler));
+    }
+
+    void set_keepalive(clock_type::duration ping_interval,
+                       clock_type::duration pong_timeout,
+                       clock_type::duration idle_timeout) override
+    {
+        const auto now = clock_type::now();
+        {
+            std::lock_guard<std::mutex> lock{wheel_mutex_};
+            ping_interval_ = ping_interval;
+            pong_timeout_ = pong_timeout;
+            idle_timeout_ = idle_timeout;
+
+            if (ping_interval == clock_type::duration::zero() &&
+                idle_timeout == clock_type::duration::zero())
+            {
+                if (wheel_timer_)
+                    wheel_timer_->cancel();
+                wheel_.reset();
+                return;
+            }
+
+            // Timers can't be cancelled so the wheel is replaced: checks
+            // scheduled under previous settings might be way too late
+            wheel_ = std::make_unique<wspc::timer_wheel>(keepalive_tick, now);
+            if (!wheel_timer_)
+            {
+                wheel_timer_ = std::make_unique<boost::asio::steady_timer>(
+                    server_.get_io_service());
+            }
+            arm_wheel_timer();
+
+            // Already connected clients get checked on the next tick
+            std::lock_guard<std::mutex> connections_lock{connections_mutex_};
+            for (const auto& kv : connections_)
+                wheel_->schedule(now, kv.first);
+        }
+    }
+
+    void set_max_message_size(std::size_t bytes) override
+    {
+        server_.set_max_message_size(bytes);
+    }
+
+    void set_max_buffered_amount(std::size_t bytes) override
+    {
+        max_buffered_amount_ = bytes;
+    }
+
+    std::uint64_t num_buffer_overflows() const override
+    {
+        return buffer_overflows_;
+    }
+
+    wspc::keepalive_stats get_keepalive_stats() const override
+    {
+        wspc::keepalive_stats stats;
+        stats.pings_sent = pings_sent_;
+        stats.pong_timeouts = pong_timeouts_;
+        stats.idle_timeouts = idle_timeouts_;
+        return stats;
+    }
+
+private:
+    struct stream_state
+    {
+        stream_state(websocketpp::connection_hdl hdl,
+                     wspc::message_stream_ptr stream)
+            : hdl{std::move(hdl)}, stream{std::move(stream)}
+        {
+        }
+
+        websocketpp::connection_hdl hdl;
+        wspc::message_stream_ptr stream;
+        // Stream's messages handed over to websocketpp, not written out yet
+        std::atomic<int> in_flight{0};
+        // Set when pump stopped because of full send buffer, resumed once
+        // any of in-flight messages (or, if there are none, any other
+        // message of the connection) gets written out
+        std::atomic<bool> paused{false};
+    };
+
+    void pump(std::shared_ptr<stream_state> state)
+    {
+        std::error_code ec;
+        connection_ptr con =
+            server_.get_con_from_hdl(state->hdl, ec);
+        // Stream is dropped along with the connection
+        if (ec || con->get_state() != websocketpp::session::state::open)
+            return;
+
+        // Stay well below the cap so streams are paused rather than closed
+        const auto cap = max_buffered_amount_.load();
+        const auto limit = cap != 0
+                               ? std::min(max_stream_buffered_amount, cap / 2)
+                               : max_stream_buffered_amount;
+        std::string payload;
+        while (con->get_buffered_amount() < limit)
+        {
+            if (!state->stream->next(payload) ||
+                !send_stream_message(*con, state, payload))
+            {
+                --con->active_streams;
+                return;
+            }
+        }
+
+        // Resumed by write completion of any of stream's messages
+        state->paused = true;
+        if (state->in_flight != 0)
+            return;
+
+        // Nothing of the stream in flight, send buffer is full of other
+        // messages. Any of them being written out resumes the stream.
+        std::weak_ptr<basic_websocket_transport_impl> weak_self =
+            this->shared_from_this();
+        auto resume = [weak_self, state] {
+            if (!state->paused.exchange(false))
+                return;
+            if (auto self = weak_self.lock())
+            {
+                self->get_io_service().post([weak_self, state] {
+                    if (auto self = weak_self.lock())
+                        self->pump(state);
+                });
+            }
+        };
+        con->writes->add(resume);
+        // Buffer might have drained before we started waiting
+        if (con->get_buffered_amount() < limit)
+            resume();
+    }
+
+    bool send_stream_message(connection_type& con,
+                             const std::shared_ptr<stream_state>& state,
+                             const std::string& payload)
+    {
+        if (!check_capped(con, payload.size()))
+            return false;
+
+        std::weak_ptr<basic_websocket_transport_impl> weak_self =
+            this->shared_from_this();
+        // Called from websocketpp's write completion (possibly from any
+        // thread running the io_service)
+        auto on_release = [weak_self, state, writes = con.writes] {
+            writes->notify();
+            --state->in_flight;
+            if (!state->paused.exchange(false))
+                return;
+            if (auto self = weak_self.lock())
+            {
+                self->get_io_service().post([weak_self, state] {
+                    if (auto self = weak_self.lock())
+                        self->pump(state);
+                });
+            }
+        };
+
+        auto msg = message_type::con_msg_manager_type::get_message(
+            websocketpp::frame::opcode::text, payload.size(),
+            std::move(on_release));
+        msg->get_raw_payload().assign(payload);
+        msg->set_compressed(true);
+        ++state->in_flight;
+        // Message is released (and in_flight decremented) on failure too
+        return !con.send(msg);
+    }
+
+    void process_message(websocketpp::connection_hdl hdl, message_ptr msg)
+    {
+        WSPC_TRACE_SCOPE(message_span, "message");
+        connection_ptr con = server_.get_con_from_hdl(hdl);
+        con->last_seen = con->last_message = to_rep(clock_type::now());
+        if (capture_)
+            capture_->write(con->id, msg->get_payload());
+        auto resp =
+            con->processor->process_message(con->id, msg->get_payload());
+        if (!resp.empty())
+        {
+            WSPC_TRACE_SCOPE(send_span, "send");
+            send_capped(*con, resp);
+        }
+    }
+
+    // Counts a message against budget of the ongoing poll(max_messages, ...).
+    // Returns false if there's none left.
+    bool take_budget()
+    {
+        auto budget = poll_budget_.load();
+        do
+        {
+            if (budget == 0)
+                return false;
+            if (budget == unlimited_budget)
+                return true;
+        } while (!poll_budget_.compare_exchange_weak(budget, budget - 1));
+        return true;
+    }
+
+    // Processes messages left over by previous poll(max_messages, ...).
+    // Returns false if budget ran out before all of them were processed.
+    bool process_deferred()
+    {
+        for (;;)
+        {
+            std::pair<websocketpp::connection_hdl, message_ptr> next;
+            {
+                std::lock_guard<std::mutex> lock{deferred_mutex_};
+                // Connection might have been closed in the meantime
+                while (!deferred_.empty() && deferred_.front().first.expired())
+                    deferred_.pop_front();
+                if (deferred_.empty())
+                    return true;
+                if (!take_budget())
+                    return false;
+                next = std::move(deferred_.front());
+                deferred_.pop_front();
+            }
+            process_message(std::move(next.first), std::move(next.second));
+        }
+    }
+
+    void process_post(connection_type& con, wspc::processor& processor)
+    {
+        WSPC_TRACE_SCOPE(message_span, "message");
+        // Body is already read in full so there's no deferring it
+        take_budget();
+        const auto& body = con.get_request_body();
+        if (capture_)
+            capture_->write(wspc::no_connection, body);
+        auto resp = processor.process_message(wspc::no_connection, body);
+        if (resp.empty())
+        {
+            // Only notifications
+            con.set_status(websocketpp::http::status_code::no_content);
+            return;
+        }
+        con.replace_header("Content-Type", "application/json");
+        con.set_body(std::move(resp));
+        con.set_status(websocketpp::http::status_code::ok);
+    }
+
+    // Sends unless it'd make the connection exceed its cap on buffered bytes,
+    // in which case the connection is closed instead. Returns false if
+    // nothing was sent.
+    bool send_capped(connection_type& con,
+                     const std::string& payload)
+    {
+        if (!check_capped(con, payload.size()))
+            return false;
+        // Lets streams waiting for the send buffer to drain know about it
+        auto msg = message_type::con_msg_manager_type::get_message(
+            websocketpp::frame::opcode::text, payload.size(), con.writes);
+        msg->get_raw_payload().assign(payload);
+        msg->set_compressed(true);
+        return !con.send(msg);
+    }
+
+    // Checks if connection is open and can take size more bytes, closes it if
+    // it'd exceed the cap
+    bool check_capped(connection_type& con, std::size_t size)
+    {
+        if (con.get_state() != websocketpp::session::state::open)
+            return false;
+
+        const auto cap = max_buffered_amount_.load();
+        if (cap != 0 && con.get_buffered_amount() + size > cap)
+        {
+            ++buffer_overflows_;
+            std::error_code ec;
+            con.close(websocketpp::close::status::policy_violation,
+                      "send buffer limit exceeded", ec);
+            return false;
+        }
+        return true;
+    }
+
+    // Puts newly opened connection on the timer wheel
+    void track(connection_data& con, clock_type::time_point now)
+    {
+        std::lock_guard<std::mutex> lock{wheel_mutex_};
+        if (wheel_)
+            wheel_->schedule(next_check(con, now), con.id);
+    }
+
+    // Requires wheel_mutex_ to be locked
+    clock_type::time_point next_check(const connection_data& con,
+                                      clock_type::time_point now) const
+    {
+        const auto zero = clock_type::duration::zero();
+        auto next = clock_type::time_point::max();
+        if (idle_timeout_ != zero)
+            next = std::min(next, from_rep(con.last_message) + idle_timeout_);
+
+        const auto ping_sent = con.ping_sent.load();
+        if (ping_sent != 0)
+            next = std::min(next, from_rep(ping_sent) + pong_timeout_);
+        else if (ping_interval_ != zero)
+        {
+            next = std::min(next, from_rep(con.last_seen) + ping_interval_);
+        }
+        return std::max(next, now);
+    }
+
+    // Requires wheel_mutex_ to be locked
+    void arm_wheel_timer()
+    {
+        std::weak_ptr<basic_websocket_transport_impl> weak_self =
+            this->shared_from_this();
+        wheel_timer_->expires_from_now(keepalive_tick);
+        wheel_timer_->async_wait(
+            [weak_self](const boost::system::error_code& ec) {
+                auto self = weak_self.lock();
+                if (!ec && self)
+                    self->on_wheel_tick();
+            });
+    }
+
+    void on_wheel_tick()
+    {
+        const auto now = clock_type::now();
+        std::vector<std::uint64_t> expired;
+        {
+            std::lock_guard<std::mutex> lock{wheel_mutex_};
+            if (!wheel_)
+                return;
+            wheel_->advance(now, expired);
+            arm_wheel_timer();
+        }
+
+        for (const auto id : expired)
+            check_connection(id, now);
+    }
+
+    void check_connection(wspc::connection_id id, clock_type::time_point now)
+    {
+        websocketpp::connection_hdl hdl;
+        // Closed in the meantime
+        if (!find_connection(nullptr, id, hdl))
+            return;
+
+        std::error_code ec;
+        connection_ptr con = server_.get_con_from_hdl(hdl, ec);
+        if (ec || con->get_state() != websocketpp::session::state::open)
+            return;
+
+        std::lock_guard<std::mutex> lock{wheel_mutex_};
+        if (!wheel_)
+            return;
+
+        const auto zero = clock_type::duration::zero();
+        // Pong timeout might have been disabled meanwhile
+        if (pong_timeout_ == zero)
+            con->ping_sent = 0;
+        const auto ping_sent = con->ping_sent.load();
+        // Peers which don't respond won't complete the close handshake
+        // either, websocketpp drops them after its close handshake timeout
+        if (idle_timeout_ != zero &&
+            now - from_rep(con->last_message) >= idle_timeout_)
+        {
+            ++idle_timeouts_;
+            con->close(websocketpp::close::status::going_away, "idle timeout",
+                       ec);
+            return;
+        }
+        if (ping_sent != 0 && pong_timeout_ != zero &&
+            now - from_rep(ping_sent) >= pong_timeout_)
+        {
+            ++pong_timeouts_;
+            con->close(websocketpp::close::status::going_away, "pong timeout",
+                       ec);
+            return;
+        }
+        if (ping_sent == 0 && ping_interval_ != zero &&
+            now - from_rep(con->last_seen) >= ping_interval_)
+        {
+            con->ping("", ec);
+            if (!ec)
+            {
+                // Without pong timeout we just keep pinging every interval
+                if (pong_timeout_ != zero)
+                    con->ping_sent = to_rep(now);
+                ++pings_sent_;
+            }
+        }
+
+        wheel_->schedule(next_check(*con, now), id);
+    }
+
+    // Requires drain_mutex_ to be locked
+    void arm_drain_timer()
+    {
+        std::weak_ptr<basic_websocket_transport_impl> weak_self =
+            this->shared_from_this();
+        drain_timer_->expires_from_now(drain_tick);
+        drain_timer_->async_wait(
+            [weak_self](const boost::system::error_code& ec) {
+                auto self = weak_self.lock();
+                if (!ec && self)
+                    self->on_drain_tick();
+            });
+    }
+
+    void on_drain_tick()
+    {
+        std::vector<wspc::connection_id> to_close;
+        {
+            std::lock_guard<std::mutex> lock{drain_mutex_};
+            const auto elapsed = clock_type::now() - drain_start_;
+            // Number of connections that should have been closed by now
+            auto due = drain_total_;
+            if (elapsed < drain_window_)
+            {
+                due = static_cast<std::size_t>(
+                    static_cast<double>(drain_total_) * elapsed.count() /
+                    drain_window_.count());
+            }
+            const bool overdue = elapsed >= 2 * drain_window_;
+
+            // Busy connections go to the back of the queue and are checked
+            // again on the next tick
+            for (auto n = drain_queue_.size(); n > 0 && drain_closed_ < due;
+                 --n)
+            {
+                const auto id = drain_queue_.front();
+                drain_queue_.pop_front();
+                if (!overdue && busy(id))
+                {
+                    drain_queue_.push_back(id);
+                    continue;
+                }
+                to_close.push_back(id);
+                ++drain_closed_;
+            }
+
+            if (!drain_queue_.empty())
+                arm_drain_timer();
+        }
+
+        for (const auto id : to_close)
+        {
+            websocketpp::connection_hdl hdl;
+            // Client has gone already
+            if (!find_connection(nullptr, id, hdl))
+                continue;
+
+            // Close frame is queued after responses sent so far
+            std::error_code ec;
+            connection_ptr con = server_.get_con_from_hdl(hdl, ec);
+            if (!ec)
+            {
+                con->close(websocketpp::close::status::service_restart,
+                           "server restart", ec);
+            }
+        }
+    }
+
+    // Whether there are responses to the connection yet to be sent
+    bool busy(wspc::connection_id id)
+    {
+        websocketpp::connection_hdl hdl;
+        if (!find_connection(nullptr, id, hdl))
+            return false;
+        std::error_code ec;
+        connection_ptr con = server_.get_con_from_hdl(hdl, ec);
+        return !ec &&
+               (con->processor->busy(id) || con->active_streams != 0);
+    }
+
+    void finish_drain()
+    {
+        std::function<void()> done;
+        {
+            std::lock_guard<std::mutex> lock{drain_mutex_};
+            done = std::move(drain_done_);
+            drain_done_ = nullptr;
+        }
+        if (done)
+            done();
+    }
+
+    struct connection_entry
+    {
+        websocketpp::connection_hdl hdl;
+        wspc::processor* processor;
+    };
+
+    static bool on_route(const connection_entry& entry,
+                         const wspc::processor* route)
+    {
+        return !route || entry.processor == route;
+    }
+
+    // Returns false if there's no such connection on given route
+    bool find_connection(const wspc::processor* route, wspc::connection_id id,
+                         websocketpp::connection_hdl& hdl) const
+    {
+        std::lock_guard<std::mutex> lock{connections_mutex_};
+        auto it = connections_.find(id);
+        if (it == end(connections_) || !on_route(it->second, route))
+            return false;
+        hdl = it->second.hdl;
+        return true;
+    }
+
+    // Returns processor serving given request URI (null if there's none)
+    // and the rest of URI, relative to the route's path
+    wspc::processor* find_route(const std::string& uri,
+                                std::string& rest) const
+    {
+        const auto path = uri.substr(0, uri.find('?'));
+        const std::pair<std::string, wspc::processor*>* found = nullptr;
+        for (const auto& route : routes_)
+        {
+            const auto& prefix = route.first;
+            // The longest one matching whole path segments
+            if (found && found->first.size() >= prefix.size())
+                continue;
+            if (path.compare(0, prefix.size(), prefix) != 0)
+                continue;
+            if (path.size() > prefix.size() && path[prefix.size()] != '/')
+                continue;
+            found = &route;
+        }
+
+        if (!found)
+        {
+            rest = uri;
+            return processor_;
+        }
+        rest = uri.substr(found->first.size());
+        if (rest.empty() || rest[0] != '/')
+            rest.insert(0, "/");
+        return found->second;
+    }
+
+    void start_accept()
+    {
+        auto con = server_.get_connection();
+        acceptor_->async_accept(
+            con->get_raw_socket(),
+            [this, con](const boost::system::error_code& ec) {
+                if (ec == boost::asio::error::operation_aborted)
+                    return;
+                if (!ec)
+                    con->start();
+                start_accept();
+            });
+    }
+
+    // Takes connections already waiting in listening socket's backlog which
+    // would be otherwise reset once it's closed (when it's not shared with
+    // another process). They're closed with "service restart" as soon as
+    // their handshake completes.
+    void accept_backlog()
+    {
+        boost::system::error_code ec;
+        acceptor_->non_blocking(true, ec);
+        while (!ec)
+        {
+            auto con = server_.get_connection();
+            acceptor_->accept(con->get_raw_socket(), ec);
+            if (!ec)
+                con->start();
+        }
+    }
+
+    void watch(int fd)
+    {
+#if defined(__linux__)
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(poll_fd_, EPOLL_CTL_ADD, fd, &ev);
+#else
+        (void)fd;
+#endif
+    }
+
+    void unwatch(int fd)
+    {
+#if defined(__linux__)
+        epoll_ctl(poll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+        (void)fd;
+#endif
+    }
+
+private:
+    // Serves paths without a route, might be null
+    wspc::processor* processor_;
+    // Set up before accepting connections, read without locking
+    std::vector<std::pair<std::string, wspc::processor*>> routes_;
+    server_type server_;
+    // Handlers can be run from many threads if io_service is shared
+    mutable std::mutex connections_mutex_;
+    std::unordered_map<wspc::connection_id, connection_entry> connections_;
+    std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
+    std::uint16_t port_{0};
+    // Messages that can still be processed by the ongoing poll
+    static constexpr std::size_t unlimited_budget =
+        std::numeric_limits<std::size_t>::max();
+    std::atomic<std::size_t> poll_budget_{unlimited_budget};
+    std::mutex deferred_mutex_;
+    std::deque<std::pair<websocketpp::connection_hdl, message_ptr>> deferred_;
+    int poll_fd_{-1};
+    std::unique_ptr<wspc::capture_writer> capture_;
+
+    // Zero means no limit
+    std::atomic<std::size_t> max_buffered_amount_{0};
+    std::atomic<std::uint64_t> buffer_overflows_{0};
+
+    // Keep-alive checks of all connections
+    mutable std::mutex wheel_mutex_;
+    std::unique_ptr<wspc::timer_wheel> wheel_;
+    std::unique_ptr<boost::asio::steady_timer> wheel_timer_;
+    clock_type::duration ping_interval_{};
+    clock_type::duration pong_timeout_{};
+    clock_type::duration idle_timeout_{};
+    std::atomic<std::uint64_t> pings_sent_{0};
+    std::atomic<std::uint64_t> pong_timeouts_{0};
+    std::atomic<std::uint64_t> idle_timeouts_{0};
+
+    // Graceful shutdown, see drain()
+    std::atomic<bool> draining_{false};
+    std::mutex drain_mutex_;
+    std::unique_ptr<boost::asio::steady_timer> drain_timer_;
+    // Connections yet to be closed
+    std::deque<wspc::connection_id> drain_queue_;
+    clock_type::time_point drain_start_;
+    clock_type::duration drain_window_{};
+    std::size_t drain_total_{0};
+    std::size_t drain_closed_{0};
+    std::function<void()> drain_done_;
+};
+
+using plain_backend = server_backend<websocketpp::config::asio>;
+
+#if defined(WSPC_ENABLE_TLS)
+using tls_backend = server_backend<websocketpp::config::asio_tls>;
+using ssl_context = boost::asio::ssl::context;
+
+std::shared_ptr<ssl_context> make_tls_context(const wspc::tls_options& tls)
+{
+    auto context = std::make_shared<ssl_context>(ssl_context::sslv23_server);
+    context->set_options(ssl_context::default_workarounds |
+                         ssl_context::no_sslv2 | ssl_context::no_sslv3 |
+                         ssl_context::no_tlsv1 | ssl_context::no_tlsv1_1 |
+                         ssl_context::single_dh_use);
+    context->use_certificate_chain_file(tls.certificate_chain_file);
+    context->use_private_key_file(tls.private_key_file, ssl_context::pem);
+
+    auto ctx = context->native_handle();
+    auto options = SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_COMPRESSION;
+#if defined(SSL_OP_PRIORITIZE_CHACHA)
+    // Clients preferring ChaCha20 (no AES hardware, e.g. phones) get it
+    // despite server's order
+    options |= SSL_OP_PRIORITIZE_CHACHA;
+#endif
+    if (!tls.session_tickets)
+        options |= SSL_OP_NO_TICKET;
+    SSL_CTX_set_options(ctx, options);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    // Enabled by default since 1.1.0, otherwise ECDHE suites aren't usable
+    SSL_CTX_set_ecdh_auto(ctx, 1);
+#endif
+
+    if (SSL_CTX_set_cipher_list(ctx, tls.cipher_list.c_str()) != 1)
+        throw std::runtime_error{"invalid TLS cipher list: " + tls.cipher_list};
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    if (SSL_CTX_set_ciphersuites(ctx, tls.cipher_suites.c_str()) != 1)
+    {
+        throw std::runtime_error{"invalid TLS cipher suites: " +
+                                 tls.cipher_suites};
+    }
+#endif
+
+    // Session cache lives in the context which is shared by all connections.
+    // Ticket keys are generated per context as well.
+    static const unsigned char session_id_context[] = "wspc";
+    SSL_CTX_set_session_id_context(ctx, session_id_context,
+                                   sizeof(session_id_context) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, static_cast<long>(tls.session_cache_size));
+    SSL_CTX_set_timeout(ctx, static_cast<long>(tls.session_timeout.count()));
+    return context;
+}
+
+std::shared_ptr<websocket_transport_impl>
+    make_tls_impl(wspc::processor* processor,
+                  boost::asio::io_service& io_service,
+                  const wspc::tls_options& tls)
+{
+    auto impl = std::make_shared<basic_websocket_transport_impl<tls_backend>>(
+        processor, &io_service);
+    auto context = make_tls_context(tls);
+    impl->set_tls_init_handler(
+        [context](websocketpp::connection_hdl) { return context; });
+    return impl;
+}
+#endif
+
+// Connections of one path of websocket_transport (see route())
+class websocket_route : public wspc::transport
+{
+public:
+    websocket_route(std::shared_ptr<websocket_transport_impl> impl,
+                    wspc::processor& processor)
+        : impl_{std::move(impl)}, processor_{&processor}
+    {
+    }
+
+    void close() override { impl_->close(processor_); }
+
+    bool send(wspc::connection_id id, const std::string& payload) override
+    {
+        return impl_->send(processor_, id, payload);
+    }
+
+    void broadcast(const std::string& payload) override
+    {
+        impl_->broadcast(processor_, payload);
+    }
+
+    int num_clients() const override { return impl_->num_clients(processor_); }
+
+    bool connected(wspc::connection_id id) const override
+    {
+        return impl_->connected(processor_, id);
+    }
+
+    bool stream(wspc::connection_id id,
+                wspc::message_stream_ptr stream) override
+    {
+        return impl_->stream(processor_, id, std::move(stream));
+    }
+
+private:
+    std::shared_ptr<websocket_transport_impl> impl_;
+    const wspc::processor* processor_;
+};
+
+websocket_transport::websocket_transport(wspc::processor& processor)
+    : impl_{std::make_shared<basic_websocket_transport_impl<plain_backend>>(
+          &processor, nullptr)}
+{
+}
+
+websocket_transport::websocket_transport(wspc::processor& processor,
+                                         boost::asio::io_service& io_service)
+    : impl_{std::make_shared<basic_websocket_transport_impl<plain_backend>>(
+          &processor, &io_service)}
+{
+}
+
+websocket_transport::websocket_transport(boost::asio::io_service& io_service)
+    : impl_{std::make_shared<basic_websocket_transport_impl<plain_backend>>(
+          nullptr, &io_service)}
+{
+}
+
+#if defined(WSPC_ENABLE_TLS)
+websocket_transport::websocket_transport(wspc::processor& processor,
+                                         boost::asio::io_service& io_service,
+                                         const wspc::tls_options& tls)
+    : impl_{make_tls_impl(&processor, io_service, tls)}
+{
+}
+
+websocket_transport::websocket_transport(boost::asio::io_service& io_service,
+                                         const wspc::tls_options& tls)
+    : impl_{make_tls_impl(nullptr, io_service, tls)}
+{
+}
+#endif
+
+websocket_transport::~websocket_transport() = default;
+
+void websocket_transport::accept(std::uint16_t port)
+{
+    impl_->accept(port, false);
+}
+
+void websocket_transport::accept(std::uint16_t port, bool reuse_port)
+{
+    impl_->accept(port, reuse_port);
+}
+
+void websocket_transport::adopt_listener(int fd) { impl_->adopt_listener(fd); }
+
+int websocket_transport::listen_descriptor() const
+{
+    return impl_->listen_descriptor();
+}
+
+void websocket_transport::drain(std::chrono::steady_clock::duration window,
+                                std::function<void()> done)
+{
+    impl_->drain(window, std::move(done));
+}
+
+void websocket_transport::poll() { impl_->poll(); }
+
+bool websocket_transport::poll(
+    std::size_t max_messages, std::chrono::steady_clock::duration max_duration)
+{
+    return impl_->poll(max_messages, max_duration);
+}
+
+int websocket_transport::poll_descriptor() const
+{
+    return impl_->poll_descriptor();
+}
+
+boost::asio::io_service& websocket_transport::get_io_service()
+{
+    return impl_->get_io_service();
+}
+
+void websocket_transport::close() { impl_->close(nullptr); }
+
+wspc::transport& websocket_transport::route(const std::string& path,
+                                            wspc::processor& processor)
+{
+    impl_->add_route(path, processor);
+    routes_.push_back(std::make_unique<websocket_route>(impl_, processor));
+    return *routes_.back();
+}
+
+void websocket_transport::run(std::uint16_t port) { impl_->run(port); }
+
+void websocket_transport::stop() { impl_->stop(); }
+
+void websocket_transport::capture(const std::string& path)
+{
+    impl_->capture(path);
+}
+
+void websocket_transport::set_keepalive(
+    std::chrono::steady_clock::duration ping_interval,
+    std::chrono::steady_clock::duration pong_timeout,
+    std::chrono::steady_clock::duration idle_timeout)
+{
+    impl_->set_keepalive(ping_interval, pong_timeout, idle_timeout);
+}
+
+void websocket_transport::set_max_message_size(std::size_t bytes)
+{
+    impl_->set_max_message_size(bytes);
+}
+
+void websocket_transport::set_max_buffered_amount(std::size_t bytes)
+{
+    impl_->set_max_buffered_amount(bytes);
+}
+
+std::uint64_t websocket_transport::num_buffer_overflows() const
+{
+    return impl_->num_buffer_overflows();
+}
+
+wspc::keepalive_stats websocket_transport::get_keepalive_stats() const
+{
+    return impl_->get_keepalive_stats();
+}
+
+bool websocket_transport::send(wspc::connection_id id,
+                               const std::string& payload)
+{
+    return impl_->send(nullptr, id, payload);
+}
+
+void websocket_transport::broadcast(const std::string& payload)
+{
+    impl_->broadcast(nullptr, payload);
+}
+
+int websocket_transport::num_clients() const
+{
+    return impl_->num_clients(nullptr);
+}
+
+bool websocket_transport::connected(wspc::connection_id id) const
+{
+    return impl_->connected(nullptr, id);
+}
+
+bool websocket_transport::stream(wspc::connection_id id,
+                                 wspc::message_stream_ptr stream)
+{
+    return impl_->stream(nullptr, id, std::move(stream));
+}
+} // namespace wspc
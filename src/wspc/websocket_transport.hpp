@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#ifndef WSPC_WEBSOCKET_TRANSPORT_HPP_GUARD
+#define WSPC_WEBSOCKET_TRANSPORT_HPP_GUARD
+
+#include "wspc/transport.hpp"
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace wspc {
+
+// Forward declarations
+class websocket_transport_impl;
+
+// Counters of keep-alive checks (see websocket_transport::set_keepalive)
+struct keepalive_stats
+{
+    std::uint64_t pings_sent{0};
+    // Connections closed for not answering a ping in time
+    std::uint64_t pong_timeouts{0};
+    // Connections closed for not sending any message for too long
+    std::uint64_t idle_timeouts{0};
+};
+
+#if defined(WSPC_ENABLE_TLS)
+// TLS settings of websocket_transport (wss://). A single SSL context is
+// shared by all connections so reconnecting clients can resume their
+// sessions (from the server-side cache or with a session ticket) and skip the
+// full handshake.
+struct tls_options
+{
+    // PEM files
+    std::string certificate_chain_file;
+    std::string private_key_file;
+    // OpenSSL cipher list for TLS 1.2 and cipher suites for TLS 1.3. Only
+    // AEAD ciphers with forward secrecy by default: AES-GCM, favoured when
+    // there's hardware support for it, and ChaCha20-Poly1305.
+    std::string cipher_list{"ECDHE-ECDSA-AES128-GCM-SHA256:"
+                            "ECDHE-RSA-AES128-GCM-SHA256:"
+                            "ECDHE-ECDSA-CHACHA20-POLY1305:"
+                            "ECDHE-RSA-CHACHA20-POLY1305:"
+                            "ECDHE-ECDSA-AES256-GCM-SHA384:"
+                            "ECDHE-RSA-AES256-GCM-SHA384"};
+    std::string cipher_suites{"TLS_AES_128_GCM_SHA256:"
+                              "TLS_CHACHA20_POLY1305_SHA256:"
+                              "TLS_AES_256_GCM_SHA384"};
+    // Number of sessions kept in the server-side cache
+    std::size_t session_cache_size{20 * 1024};
+    std::chrono::seconds session_timeout{3600};
+    bool session_tickets{true};
+};
+#endif
+
+// Transport based on websocketpp. Also serves processor's HTTP pages.
+class websocket_transport : public wspc::transport
+{
+public:
+    websocket_transport(wspc::processor& processor);
+    // Runs on caller-provided io_service which can be shared with other I/O
+    // and run by a pool of threads. All handlers are then invoked from
+    // whichever thread runs it.
+    websocket_transport(wspc::processor& processor,
+                        boost::asio::io_service& io_service);
+    // Serves routed paths only (see route()), other requests get 404
+    explicit websocket_transport(boost::asio::io_service& io_service);
+#if defined(WSPC_ENABLE_TLS)
+    // Serves clients over TLS only. Throws if certificate or key can't be
+    // loaded.
+    websocket_transport(wspc::processor& processor,
+                        boost::asio::io_service& io_service,
+                        const wspc::tls_options& tls);
+    websocket_transport(boost::asio::io_service& io_service,
+                        const wspc::tls_options& tls);
+#endif
+    ~websocket_transport() override;
+
+    void close() override;
+
+    // Connections with request URI path equal to given path or below it
+    // (e.g. /data and /data/...) are served by given processor, as are HTTP
+    // requests (with the path stripped, /data/trace becomes /trace). Returns
+    // transport limited to these connections. Must be called before
+    // transport starts accepting connections. Processor must not be destroyed
+    // while the transport is running.
+    wspc::transport& route(const std::string& path,
+                           wspc::processor& processor);
+
+    // Poll based interface
+    void accept(std::uint16_t port);
+    // With reuse_port (SO_REUSEPORT) another process can listen on the same
+    // port at the same time, e.g. new instance of the server starting up
+    // before the old one drains. Throws where it's not supported.
+    void accept(std::uint16_t port, bool reuse_port);
+    // Accepts connections on already listening socket, e.g. inherited from
+    // the process being replaced (see listen_descriptor())
+    void adopt_listener(int fd);
+    // Descriptor of the listening socket, -1 if there's none. Can be passed to
+    // a new process (over a Unix socket or inherited across fork and exec) so
+    // it accepts connections while this one drains.
+    int listen_descriptor() const;
+    // Stops accepting new connections and closes existing ones (with 1012
+    // status, "service restart") gradually, spread evenly over given window,
+    // so their clients don't all reconnect at once. Connection with requests
+    // still being processed (see processor::busy) is closed after they're
+    // done, or once twice the window has elapsed. Calls done when the last
+    // connection is closed.
+    //
+    // Connections waiting in the listening socket's backlog are accepted
+    // (and closed the same way) before it's closed, but a client connecting
+    // at that very moment may still get reset when the socket isn't shared
+    // with another process (SO_REUSEPORT distributes connections among
+    // listeners with their own backlogs). Handing the descriptor over (see
+    // listen_descriptor and adopt_listener) is the only lossless way.
+    void drain(std::chrono::steady_clock::duration window,
+               std::function<void()> done = {});
+    void poll();
+    // Processes at most max_messages or until max_duration elapses, whatever
+    // comes first, leaving the rest queued. Messages already read from the
+    // socket past the limit are held and processed first by the next poll.
+    // HTTP POST requests are counted but never held. Returns true if the
+    // budget has been exhausted (there may be more work pending).
+    bool poll(std::size_t max_messages,
+              std::chrono::steady_clock::duration max_duration);
+    // Descriptor that becomes readable when there's incoming data or a new
+    // connection pending so the poll-based interface can be driven from an
+    // external epoll/select loop. Timers (e.g. close handshake timeouts) are
+    // not reflected so poll at least every now and then anyway. Returns -1 on
+    // platforms other than Linux.
+    int poll_descriptor() const;
+
+    // Asio's loop based interface
+    void run(std::uint16_t port);
+    void stop();
+
+    // Append every incoming message to given capture file
+    // (see wspc::capture_writer)
+    void capture(const std::string& path);
+
+    // Pings connections which haven't sent anything for ping_interval and
+    // closes them if there's no pong within pong_timeout. Connections which
+    // haven't sent any message (pongs don't count) for idle_timeout are closed
+    // as well. Zero disables given check. All connections are tracked by a
+    // single timer wheel with 100 ms resolution, driven by one asio timer.
+    // Can be called again to change settings, every connection is then
+    // checked on the next tick.
+    void set_keepalive(std::chrono::steady_clock::duration ping_interval,
+                       std::chrono::steady_clock::duration pong_timeout,
+                       std::chrono::steady_clock::duration idle_timeout);
+    wspc::keepalive_stats get_keepalive_stats() const;
+
+    // Connections sending bigger messages are closed with 1009 status
+    // ("message too big"). Applies to connections accepted afterwards.
+    void set_max_message_size(std::size_t bytes);
+    // Connections not reading fast enough to keep what's queued for them
+    // below given amount are closed. Streams are paused at half of it. Zero
+    // (the default) means no limit.
+    void set_max_buffered_amount(std::size_t bytes);
+    // Number of connections closed for exceeding the buffered amount
+    std::uint64_t num_buffer_overflows() const;
+
+    bool send(wspc::connection_id id, const std::string& payload) override;
+    void broadcast(const std::string& payload) override;
+    int num_clients() const override;
+    bool connected(wspc::connection_id id) const override;
+    // Pulls next messages as long as less than 1 MiB is buffered for the
+    // connection, otherwise resumes once one of them is written out
+    bool stream(wspc::connection_id id,
+                wspc::message_stream_ptr stream) override;
+
+    boost::asio::io_service& get_io_service();
+
+private:
+    std::shared_ptr<wspc::websocket_transport_impl> impl_;
+    std::vector<std::unique_ptr<wspc::transport>> routes_;
+};
+} // namespace wspc
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/capture.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+class capture_test : public ::testing::Test
+{
+protected:
+    void TearDown() override { std::remove(path().c_str()); }
+
+    std::string path() const
+    {
+        return ::testing::TempDir() + "wspc_" +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+
+    std::string contents() const
+    {
+        std::ifstream file{path(), std::ios_base::binary};
+        return {std::istreambuf_iterator<char>{file},
+                std::istreambuf_iterator<char>{}};
+    }
+};
+} // namespace anonymous
+
+TEST_F(capture_test, reads_back_records)
+{
+    {
+        wspc::capture_writer writer{path()};
+        EXPECT_TRUE(writer.write(1, "first"));
+        EXPECT_TRUE(writer.write(wspc::no_connection, ""));
+        EXPECT_TRUE(writer.write(0x0102030405060708, "third"));
+    }
+
+    wspc::capture_reader reader{path()};
+    wspc::capture_record record;
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(1u, record.connection);
+    EXPECT_EQ("first", record.payload);
+    EXPECT_GT(record.timestamp, 0);
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(wspc::no_connection, record.connection);
+    EXPECT_EQ("", record.payload);
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(0x0102030405060708u, record.connection);
+    EXPECT_EQ("third", record.payload);
+    EXPECT_FALSE(reader.next(record));
+}
+
+TEST_F(capture_test, numbers_are_little_endian)
+{
+    {
+        wspc::capture_writer writer{path()};
+        writer.write(0x0102030405060708, "x");
+    }
+
+    const auto data = contents();
+    // Magic, version and byte order mark
+    ASSERT_EQ(8u + 4 + 4 + 8 + 8 + 4 + 1, data.size());
+    EXPECT_EQ(std::string("WSPCCAP2\x02\0\0\0\x04\x03\x02\x01", 16),
+              data.substr(0, 16));
+    EXPECT_EQ(std::string("\x08\x07\x06\x05\x04\x03\x02\x01", 8),
+              data.substr(16, 8));
+    EXPECT_EQ(std::string("\x01\0\0\0x", 5), data.substr(32));
+}
+
+TEST_F(capture_test, rejects_other_files)
+{
+    {
+        std::ofstream file{path(), std::ios_base::binary};
+        file.write("WSPCCAP2\x03\0\0\0\x04\x03\x02\x01", 16);
+    }
+    EXPECT_THROW(wspc::capture_reader{path()}, std::runtime_error);
+
+    {
+        std::ofstream file{path(), std::ios_base::binary};
+        file << "{\"jsonrpc\": \"2.0\"}";
+    }
+    EXPECT_THROW(wspc::capture_reader{path()}, std::runtime_error);
+}
+
+TEST_F(capture_test, reads_legacy_files)
+{
+    {
+        std::ofstream file{path(), std::ios_base::binary};
+        const std::uint64_t connection = 7;
+        const std::int64_t timestamp = 1;
+        const std::uint32_t length = 2;
+        file.write("WSPCCAP1", 8);
+        file.write(reinterpret_cast<const char*>(&connection), 8);
+        file.write(reinterpret_cast<const char*>(&timestamp), 8);
+        file.write(reinterpret_cast<const char*>(&length), 4);
+        file.write("{}", 2);
+    }
+
+    wspc::capture_reader reader{path()};
+    wspc::capture_record record;
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(7u, record.connection);
+    EXPECT_EQ(1, record.timestamp);
+    EXPECT_EQ("{}", record.payload);
+    EXPECT_FALSE(reader.next(record));
+}
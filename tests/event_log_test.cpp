@@ -0,0 +1,197 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/event_log.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+std::uint64_t seq_of(const json11::Json& event)
+{
+    return static_cast<std::uint64_t>(event["seq"].number_value());
+}
+
+json11::Json::object make_event(int value)
+{
+    return json11::Json::object{{"value", value}};
+}
+
+class event_log_segment : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        path_ = ::testing::TempDir() + "wspc_event_log_" +
+                ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        std::remove(path_.c_str());
+    }
+
+    void TearDown() override { std::remove(path_.c_str()); }
+
+    std::string path_;
+};
+} // namespace anonymous
+
+TEST(event_log, since_returns_events_after_last_seq)
+{
+    wspc::event_log log{8};
+    for (int i = 0; i < 5; ++i)
+        log.append(make_event(i));
+
+    json11::Json::array events;
+    EXPECT_TRUE(log.since(log.epoch(), 3, events));
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(4u, seq_of(events[0]));
+    EXPECT_EQ(5u, seq_of(events[1]));
+    EXPECT_EQ(log.epoch(), events[0]["epoch"].number_value());
+}
+
+TEST(event_log, since_is_complete_when_up_to_date)
+{
+    wspc::event_log log{4};
+    json11::Json::array events;
+    EXPECT_TRUE(log.since(log.epoch(), 0, events));
+    EXPECT_TRUE(events.empty());
+
+    log.append(make_event(0));
+    EXPECT_TRUE(log.since(log.epoch(), 1, events));
+    EXPECT_TRUE(events.empty());
+}
+
+TEST(event_log, since_is_incomplete_when_events_were_dropped)
+{
+    wspc::event_log log{3};
+    for (int i = 0; i < 6; ++i)
+        log.append(make_event(i));
+
+    json11::Json::array events;
+    EXPECT_FALSE(log.since(log.epoch(), 1, events));
+    ASSERT_EQ(3u, events.size());
+    EXPECT_EQ(4u, seq_of(events.front()));
+    EXPECT_EQ(6u, seq_of(events.back()));
+
+    events.clear();
+    EXPECT_TRUE(log.since(log.epoch(), 3, events));
+    EXPECT_EQ(3u, events.size());
+}
+
+TEST(event_log, since_is_incomplete_for_another_epoch)
+{
+    wspc::event_log log{8};
+    for (int i = 0; i < 3; ++i)
+        log.append(make_event(i));
+
+    json11::Json::array events;
+    EXPECT_FALSE(log.since(log.epoch() + 1, 3, events));
+    EXPECT_EQ(3u, events.size());
+
+    wspc::event_log empty{8};
+    events.clear();
+    EXPECT_FALSE(empty.since(empty.epoch() + 1, 0, events));
+    EXPECT_TRUE(events.empty());
+}
+
+TEST(event_log, since_is_incomplete_when_client_is_ahead)
+{
+    wspc::event_log log{8};
+    log.append(make_event(0));
+
+    json11::Json::array events;
+    EXPECT_FALSE(log.since(log.epoch(), 7, events));
+    EXPECT_EQ(1u, events.size());
+}
+
+TEST_F(event_log_segment, history_survives_restart)
+{
+    std::uint64_t epoch;
+    {
+        wspc::event_log log{8, path_, 4096};
+        epoch = log.epoch();
+        for (int i = 0; i < 4; ++i)
+            log.append(make_event(i));
+    }
+
+    wspc::event_log log{8, path_, 4096};
+    EXPECT_EQ(epoch, log.epoch());
+    EXPECT_EQ(4u, log.last_seq());
+
+    json11::Json::array events;
+    EXPECT_TRUE(log.since(epoch, 2, events));
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(2, events[0]["value"].int_value());
+
+    // Sequence continues where it left off
+    std::string err;
+    const auto event = json11::Json::parse(log.append(make_event(4)), err);
+    EXPECT_EQ(5u, seq_of(event));
+}
+
+TEST_F(event_log_segment, full_segment_evicts_oldest_events)
+{
+    std::uint64_t epoch;
+    {
+        // Room for a handful of events only
+        wspc::event_log log{64, path_, 1024};
+        epoch = log.epoch();
+        for (int i = 0; i < 100; ++i)
+        {
+            // Records of varying size so that some of them wrap around
+            auto event = make_event(i);
+            event["text"] = std::string(static_cast<std::size_t>(i % 13), 'x');
+            log.append(std::move(event));
+        }
+    }
+
+    wspc::event_log log{64, path_, 1024};
+    EXPECT_EQ(epoch, log.epoch());
+    EXPECT_EQ(100u, log.last_seq());
+
+    json11::Json::array events;
+    EXPECT_FALSE(log.since(epoch, 0, events));
+    ASSERT_GT(events.size(), 1u);
+    // Retained events are the most recent ones, without gaps
+    EXPECT_EQ(100u, seq_of(events.back()));
+    for (std::size_t i = 1; i < events.size(); ++i)
+        EXPECT_EQ(seq_of(events[i - 1]) + 1, seq_of(events[i]));
+}
+
+TEST_F(event_log_segment, segment_of_another_size_starts_new_epoch)
+{
+    std::uint64_t epoch;
+    {
+        wspc::event_log log{8, path_, 4096};
+        epoch = log.epoch();
+        log.append(make_event(0));
+    }
+
+    wspc::event_log log{8, path_, 8192};
+    EXPECT_NE(epoch, log.epoch());
+    EXPECT_EQ(0u, log.last_seq());
+
+    json11::Json::array events;
+    EXPECT_FALSE(log.since(epoch, 1, events));
+    EXPECT_TRUE(events.empty());
+}
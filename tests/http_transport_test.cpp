@@ -0,0 +1,178 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/http_transport.hpp"
+
+#include <gtest/gtest.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+
+// Echoes bodies of POST requests
+class echo_processor : public wspc::processor
+{
+public:
+    std::string process_http(const std::string& resource) override
+    {
+        return "page " + resource;
+    }
+
+    std::string http_content_type(const std::string&) const override
+    {
+        return "text/plain";
+    }
+
+    std::string process_message(wspc::connection_id,
+                                const std::string& payload) override
+    {
+        return payload;
+    }
+};
+
+class http_transport_test : public ::testing::Test
+{
+protected:
+    http_transport_test()
+        : work_{std::make_unique<boost::asio::io_service::work>(io_service_)},
+          transport_{processor_, io_service_, 0}
+    {
+        thread_ = std::thread{[this] { io_service_.run(); }};
+    }
+
+    ~http_transport_test() override
+    {
+        transport_.close();
+        work_.reset();
+        thread_.join();
+    }
+
+    // Sends given requests at once and returns everything received till
+    // server closes the connection
+    std::string exchange(const std::string& requests)
+    {
+        using boost::asio::ip::tcp;
+        boost::asio::io_service io_service;
+        tcp::socket socket{io_service};
+        socket.connect(
+            {boost::asio::ip::address_v4::loopback(), transport_.port()});
+        boost::asio::write(socket, boost::asio::buffer(requests));
+
+        std::string received;
+        char buf[1024];
+        boost::system::error_code ec;
+        while (!ec)
+        {
+            const auto n = socket.read_some(boost::asio::buffer(buf), ec);
+            received.append(buf, n);
+        }
+        return received;
+    }
+
+    static std::string response(const std::string& status,
+                                const std::string& content_type,
+                                const std::string& body, bool keep_alive)
+    {
+        return "HTTP/1.1 " + status + "\r\nContent-Type: " + content_type +
+               "\r\nContent-Length: " + std::to_string(body.size()) +
+               (keep_alive ? "\r\nConnection: keep-alive\r\n\r\n"
+                           : "\r\nConnection: close\r\n\r\n") +
+               body;
+    }
+
+    boost::asio::io_service io_service_;
+    std::unique_ptr<boost::asio::io_service::work> work_;
+    echo_processor processor_;
+    wspc::http_transport transport_;
+    std::thread thread_;
+};
+} // namespace anonymous
+
+TEST_F(http_transport_test, answers_pipelined_requests_in_order)
+{
+    const auto received = exchange("POST / HTTP/1.1\r\n"
+                                   "Content-Length: 3\r\n\r\n"
+                                   "one"
+                                   "GET /info HTTP/1.1\r\n\r\n"
+                                   "POST / HTTP/1.1\r\n"
+                                   "content-length: 5\r\n"
+                                   "Connection: close\r\n\r\n"
+                                   "three");
+    EXPECT_EQ(response("200 OK", "application/json", "one", true) +
+                  response("200 OK", "text/plain", "page /info", true) +
+                  response("200 OK", "application/json", "three", false),
+              received);
+}
+
+TEST_F(http_transport_test, closes_connection_when_asked_to)
+{
+    EXPECT_EQ(response("200 OK", "text/plain", "page /", false),
+              exchange("GET / HTTP/1.1\r\nConnection: close\r\n\r\n"));
+    // HTTP/1.0 doesn't keep connections alive by default
+    EXPECT_EQ(response("200 OK", "text/plain", "page /", false),
+              exchange("GET / HTTP/1.0\r\n\r\n"));
+}
+
+TEST_F(http_transport_test, rejects_chunked_body)
+{
+    // Body is left unread and the connection closed, whatever follows
+    EXPECT_EQ(response("501 Not Implemented", "text/plain",
+                       "chunked encoding not supported", false),
+              exchange("POST / HTTP/1.1\r\n"
+                       "Transfer-Encoding: chunked\r\n\r\n"
+                       "3\r\none\r\n0\r\n\r\n"
+                       "GET / HTTP/1.1\r\n\r\n"));
+}
+
+TEST_F(http_transport_test, requires_length_of_post_body)
+{
+    EXPECT_EQ(response("411 Length Required", "text/plain", "", false),
+              exchange("POST / HTTP/1.1\r\n\r\none"));
+}
+
+TEST_F(http_transport_test, rejects_malformed_requests)
+{
+    EXPECT_EQ(response("400 Bad Request", "text/plain", "", false),
+              exchange("GET /\r\n\r\n"));
+    EXPECT_EQ(response("400 Bad Request", "text/plain", "", false),
+              exchange("GET / HTTP/2\r\n\r\n"));
+    EXPECT_EQ(response("400 Bad Request", "text/plain", "", false),
+              exchange("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n"));
+    EXPECT_EQ(response("400 Bad Request", "text/plain", "", false),
+              exchange("GET / HTTP/1.1\r\nno colon\r\n\r\n"));
+}
+
+TEST_F(http_transport_test, rejects_unsupported_methods)
+{
+    EXPECT_EQ(response("405 Method Not Allowed", "text/plain", "", false),
+              exchange("PUT / HTTP/1.1\r\n"
+                       "Content-Length: 0\r\n"
+                       "Connection: close\r\n\r\n"));
+}
@@ -0,0 +1,144 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/param_validation.hpp"
+
+#include <gtest/gtest.h>
+
+#include <boost/optional.hpp>
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+struct item
+{
+    std::string name;
+    double price;
+    boost::optional<int> quantity;
+};
+
+struct order
+{
+    int id;
+    std::vector<item> items;
+};
+} // namespace anonymous
+
+KL_DEFINE_REFLECTABLE(item, (name, price, quantity))
+KL_DEFINE_REFLECTABLE(order, (id, items))
+
+namespace {
+
+json11::Json parse(const char* text)
+{
+    std::string err;
+    auto json = json11::Json::parse(text, err);
+    EXPECT_TRUE(err.empty()) << text;
+    return json;
+}
+
+// Validation is only a faster way of finding out whether kl::from_json
+// would throw, verdicts must be the same
+template <typename T>
+void expect_same_verdict(std::initializer_list<const char*> texts)
+{
+    for (const auto text : texts)
+    {
+        const auto json = parse(text);
+        wspc::param_error error;
+        const bool valid = wspc::validate_params<T>(json, error);
+
+        bool decoded = true;
+        try
+        {
+            (void)kl::from_json<T>(json);
+        }
+        catch (kl::json_deserialize_exception&)
+        {
+            decoded = false;
+        }
+        EXPECT_EQ(decoded, valid) << text;
+    }
+}
+} // namespace anonymous
+
+TEST(param_validation_test, agrees_with_kl_on_scalars)
+{
+    expect_same_verdict<int>({"1", "1.5", "\"1\"", "true", "null", "[]"});
+    expect_same_verdict<bool>({"true", "0", "\"true\"", "null"});
+    expect_same_verdict<std::string>({"\"a\"", "1", "null", "{}"});
+    expect_same_verdict<boost::optional<int>>({"null", "2", "\"2\""});
+}
+
+TEST(param_validation_test, agrees_with_kl_on_containers)
+{
+    expect_same_verdict<std::vector<int>>(
+        {"[]", "[1, 2]", "[1, \"2\"]", "{}", "1", "null"});
+    expect_same_verdict<std::map<std::string, int>>(
+        {"{}", "{\"a\": 1}", "{\"a\": \"1\"}", "[]", "null"});
+}
+
+TEST(param_validation_test, agrees_with_kl_on_tuples)
+{
+    using args = std::tuple<int, std::string>;
+    expect_same_verdict<args>({"[1, \"a\"]", "[1]", "[]", "[1, \"a\", 2]",
+                               "[\"a\", 1]", "{}", "null"});
+    using optional_args = std::tuple<int, boost::optional<int>>;
+    expect_same_verdict<optional_args>(
+        {"[1, 2]", "[1]", "[1, null]", "[1, 2, 3]", "[1, \"2\"]"});
+}
+
+TEST(param_validation_test, agrees_with_kl_on_reflectable)
+{
+    expect_same_verdict<order>(
+        {R"({"id": 1, "items": []})",
+         R"({"id": 1, "items": [{"name": "a", "price": 2}]})",
+         R"({"id": 1, "items": [{"name": "a", "price": 2, "quantity": 3}]})",
+         R"({"id": 1, "items": [{"name": "a", "price": "2"}]})",
+         R"({"id": 1, "items": [{"price": 2}]})", R"({"id": 1})",
+         R"({"items": []})", R"([1, []])", "null"});
+}
+
+TEST(param_validation_test, reports_path_to_offending_value)
+{
+    wspc::param_error error;
+    EXPECT_FALSE(wspc::validate_params<order>(
+        parse(R"({"id": 1, "items": [{"name": "a", "price": 1},
+                                     {"name": "b", "price": "x"}]})"),
+        error));
+    EXPECT_EQ(".items[1].price", error.path);
+    EXPECT_EQ("expected number", error.message);
+
+    error = {};
+    using args = std::tuple<int, std::vector<int>>;
+    EXPECT_FALSE(wspc::validate_params<args>(parse("[1, [2, null]]"), error));
+    EXPECT_EQ("[1][1]", error.path);
+
+    error = {};
+    EXPECT_FALSE(wspc::validate_params<args>(parse("[1, [], 3]"), error));
+    EXPECT_EQ("", error.path);
+    EXPECT_EQ("too many elements", error.message);
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/request_scheduler.hpp"
+
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+TEST(request_scheduler, runs_higher_priority_first)
+{
+    boost::asio::io_service io_service;
+    wspc::request_scheduler scheduler{io_service};
+    std::string order;
+    scheduler.schedule(wspc::handler_priority::low, 1, [&] { order += 'l'; });
+    scheduler.schedule(wspc::handler_priority::normal, 2,
+                       [&] { order += 'n'; });
+    scheduler.schedule(wspc::handler_priority::high, 3, [&] { order += 'h'; });
+    io_service.run();
+    EXPECT_EQ("hnl", order);
+    EXPECT_EQ(0u, scheduler.size());
+}
+
+TEST(request_scheduler, request_is_done_when_guard_is_released)
+{
+    boost::asio::io_service io_service;
+    wspc::request_scheduler scheduler{io_service};
+    wspc::request_guard kept;
+    std::string order;
+    scheduler.schedule(wspc::handler_priority::normal, 1,
+                       [&](wspc::request_guard guard) {
+                           order += '1';
+                           kept = std::move(guard);
+                       });
+    scheduler.schedule(wspc::handler_priority::normal, 1,
+                       [&] { order += '2'; });
+    scheduler.schedule(wspc::handler_priority::normal, 2,
+                       [&] { order += '3'; });
+    io_service.run();
+    // Other connections are not held up
+    EXPECT_EQ("13", order);
+    EXPECT_TRUE(scheduler.busy(1));
+    EXPECT_FALSE(scheduler.busy(2));
+
+    kept.reset();
+    io_service.reset();
+    io_service.run();
+    EXPECT_EQ("132", order);
+    EXPECT_FALSE(scheduler.busy(1));
+}
+
+TEST(request_scheduler, high_priority_waits_for_running_request_only)
+{
+    boost::asio::io_service io_service;
+    wspc::request_scheduler scheduler{io_service};
+    wspc::request_guard kept;
+    std::string order;
+    scheduler.schedule(
+        wspc::handler_priority::low, 1, [&](wspc::request_guard guard) {
+            order += 'r';
+            kept = std::move(guard);
+            // Arrive while it's running
+            scheduler.schedule(wspc::handler_priority::low, 1,
+                               [&] { order += 'l'; });
+            scheduler.schedule(wspc::handler_priority::high, 1,
+                               [&] { order += 'h'; });
+        });
+    io_service.run();
+    EXPECT_EQ("r", order);
+
+    kept.reset();
+    io_service.reset();
+    io_service.run();
+    // Overtakes what's waiting in lower lanes
+    EXPECT_EQ("rhl", order);
+}
+
+TEST(request_scheduler, throwing_task_is_done)
+{
+    boost::asio::io_service io_service;
+    wspc::request_scheduler scheduler{io_service};
+    std::string order;
+    scheduler.schedule(wspc::handler_priority::normal, 1, [&] {
+        order += '1';
+        throw std::runtime_error{"failed"};
+    });
+    scheduler.schedule(wspc::handler_priority::normal, 1,
+                       [&] { order += '2'; });
+    EXPECT_NO_THROW(io_service.run());
+    EXPECT_EQ("12", order);
+    EXPECT_FALSE(scheduler.busy(1));
+}
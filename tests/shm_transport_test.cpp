@@ -0,0 +1,261 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/shm_transport.hpp"
+
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_service.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+namespace {
+
+class echo_processor : public wspc::processor
+{
+public:
+    std::string process_http(const std::string&) override { return {}; }
+
+    std::string process_message(wspc::connection_id,
+                                const std::string& payload) override
+    {
+        return "re:" + payload;
+    }
+
+    void process_open(wspc::connection_id id) override
+    {
+        ++opened;
+        last_id = id;
+    }
+    void process_close(wspc::connection_id) override { ++closed; }
+
+    int opened{0};
+    int closed{0};
+    wspc::connection_id last_id{0};
+};
+
+class shm_transport_test : public ::testing::Test
+{
+protected:
+    std::string name() const
+    {
+        return std::string{"wspc_test_"} +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+
+    // Runs io_service till pred is satisfied (or timeout passes)
+    bool run_until(const std::function<bool()>& pred,
+                   std::chrono::milliseconds timeout = std::chrono::seconds{5})
+    {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            io_service_.reset();
+            io_service_.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+        return true;
+    }
+
+    boost::asio::io_service io_service_;
+    echo_processor processor_;
+};
+} // namespace anonymous
+
+TEST_F(shm_transport_test, client_is_opened_and_closed)
+{
+    wspc::shm_transport transport{processor_, io_service_, name()};
+    {
+        wspc::shm_client client{name()};
+        EXPECT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+        EXPECT_EQ(1, processor_.opened);
+    }
+    EXPECT_TRUE(run_until([&] { return transport.num_clients() == 0; }));
+    EXPECT_EQ(1, processor_.closed);
+}
+
+TEST_F(shm_transport_test, idle_service_wakes_up_for_requests)
+{
+    wspc::shm_transport transport{processor_, io_service_, name()};
+    wspc::shm_client client{name()};
+    ASSERT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+    // Let the service fall asleep
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    io_service_.reset();
+    io_service_.poll();
+
+    for (int i = 0; i < 3; ++i)
+    {
+        const auto request = std::to_string(i);
+        ASSERT_TRUE(client.send(request));
+        std::string response;
+        EXPECT_TRUE(run_until([&] { return client.receive(response); }));
+        EXPECT_EQ("re:" + request, response);
+    }
+}
+
+TEST_F(shm_transport_test, slot_is_reused_after_client_detaches)
+{
+    wspc::shm_transport transport{processor_, io_service_, name(), 1};
+    {
+        wspc::shm_client client{name()};
+        EXPECT_THROW(wspc::shm_client{name()}, std::runtime_error);
+        ASSERT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+    }
+    ASSERT_TRUE(run_until([&] { return transport.num_clients() == 0; }));
+
+    wspc::shm_client client{name()};
+    EXPECT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+    EXPECT_EQ(2, processor_.opened);
+}
+
+TEST_F(shm_transport_test, client_not_reading_responses_is_dropped)
+{
+    wspc::shm_transport transport{processor_, io_service_, name(), 1,
+                                  64 * 1024, 4 * 1024};
+    wspc::shm_client client{name()};
+    ASSERT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+
+    EXPECT_TRUE(run_until([&] {
+        while (client.send("request"))
+            ;
+        return client.dropped();
+    }));
+    EXPECT_EQ(1u, transport.num_dropped_clients());
+    EXPECT_EQ(0, transport.num_clients());
+    EXPECT_EQ(1, processor_.closed);
+    EXPECT_FALSE(client.send("request"));
+}
+
+TEST_F(shm_transport_test, events_are_read_in_order)
+{
+    wspc::shm_transport transport{processor_, io_service_, name(), 1,
+                                  4 * 1024};
+    wspc::shm_client client{name()};
+
+    transport.broadcast("a");
+    transport.broadcast("b");
+    std::vector<std::string> events;
+    const auto collect = [&](const char* data, std::size_t size) {
+        events.emplace_back(data, size);
+    };
+    EXPECT_TRUE(client.read_events(collect));
+    EXPECT_EQ((std::vector<std::string>{"a", "b"}), events);
+
+    // Client gets overrun
+    for (int i = 0; i < 1000; ++i)
+        transport.broadcast(std::string(100, 'x'));
+    events.clear();
+    EXPECT_FALSE(client.read_events(collect));
+    EXPECT_TRUE(events.empty());
+
+    transport.broadcast("c");
+    EXPECT_TRUE(client.read_events(collect));
+    EXPECT_EQ((std::vector<std::string>{"c"}), events);
+}
+
+TEST_F(shm_transport_test, streams_are_pulled_as_response_ring_drains)
+{
+    wspc::shm_transport transport{processor_, io_service_, name(), 1,
+                                  4 * 1024, 4 * 1024};
+    wspc::shm_client client{name()};
+    ASSERT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+
+    class counting_stream : public wspc::message_stream
+    {
+    public:
+        explicit counting_stream(int& pulled) : pulled_{pulled} {}
+
+        bool next(std::string& payload) override
+        {
+            if (pulled_ == 1000)
+                return false;
+            payload = std::to_string(pulled_++);
+            return true;
+        }
+
+    private:
+        int& pulled_;
+    };
+
+    int pulled = 0;
+    ASSERT_TRUE(transport.stream(processor_.last_id,
+                                 std::make_unique<counting_stream>(pulled)));
+    // Far more than fits in the ring, yet client's not dropped
+    run_until([] { return false; }, std::chrono::milliseconds{20});
+    EXPECT_LT(pulled, 1000);
+
+    int received = 0;
+    std::string payload;
+    EXPECT_TRUE(run_until([&] {
+        while (client.receive(payload))
+            EXPECT_EQ(std::to_string(received++), payload);
+        return received == 1000;
+    }));
+    EXPECT_FALSE(client.dropped());
+    EXPECT_EQ(0u, transport.num_dropped_clients());
+}
+
+#if !defined(_WIN32)
+TEST_F(shm_transport_test, slot_of_dead_client_is_released)
+{
+    wspc::shm_transport transport{processor_, io_service_, name(), 1};
+
+    const auto pid = ::fork();
+    ASSERT_NE(-1, pid);
+    if (pid == 0)
+    {
+        // Die without detaching
+        new wspc::shm_client{name()};
+        ::_exit(0);
+    }
+    int status;
+    ::waitpid(pid, &status, 0);
+
+    // Slot is free again once the service notices
+    std::unique_ptr<wspc::shm_client> client;
+    EXPECT_TRUE(run_until([&] {
+        try
+        {
+            client = std::make_unique<wspc::shm_client>(name());
+        }
+        catch (std::runtime_error&)
+        {
+        }
+        return client != nullptr;
+    }));
+    EXPECT_EQ(processor_.opened, processor_.closed);
+}
+#endif
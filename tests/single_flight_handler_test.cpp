@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/single_flight_handler.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Blocks every call till it's released
+class gated_handler : public wspc::service_handler
+{
+public:
+    json11::Json operator()(const json11::Json& request) override
+    {
+        ++calls;
+        std::unique_lock<std::mutex> lock{mutex};
+        cv.wait(lock, [this] { return released; });
+        return request;
+    }
+
+    void release()
+    {
+        std::lock_guard<std::mutex> lock{mutex};
+        released = true;
+        cv.notify_all();
+    }
+
+    bool batches_notifications() const override { return true; }
+
+    std::atomic<int> calls{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool released{false};
+};
+
+class session_handler : public wspc::service_handler
+{
+public:
+    json11::Json operator()(const json11::Json& request) override
+    {
+        return request;
+    }
+
+    bool takes_session() const override { return true; }
+};
+} // namespace anonymous
+
+TEST(single_flight_handler, coalesces_identical_calls)
+{
+    auto gated = std::make_unique<gated_handler>();
+    auto& inner = *gated;
+    wspc::single_flight_handler handler{std::move(gated)};
+
+    const json11::Json request{json11::Json::array{1, 2}};
+    json11::Json first, second;
+    std::thread t1{[&] { first = handler(request); }};
+    while (inner.calls == 0)
+        std::this_thread::yield();
+    std::thread t2{[&] { second = handler(request); }};
+    // Give the second caller a chance to join the first call
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    inner.release();
+    t1.join();
+    t2.join();
+
+    EXPECT_EQ(1, inner.calls);
+    EXPECT_EQ(request, first);
+    EXPECT_EQ(request, second);
+
+    // Not in flight anymore
+    handler(request);
+    EXPECT_EQ(2, inner.calls);
+}
+
+TEST(single_flight_handler, forwards_handler_traits)
+{
+    wspc::single_flight_handler handler{std::make_unique<gated_handler>()};
+    EXPECT_TRUE(handler.batches_notifications());
+    EXPECT_FALSE(handler.takes_session());
+    EXPECT_EQ(nullptr, handler.open_stream(json11::Json{}));
+}
+
+TEST(single_flight_handler, rejects_handlers_taking_session)
+{
+    EXPECT_THROW(
+        wspc::single_flight_handler{std::make_unique<session_handler>()},
+        std::invalid_argument);
+    EXPECT_THROW(wspc::single_flight_handler{nullptr}, std::invalid_argument);
+}
@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/stream_transport.hpp"
+
+#include <gtest/gtest.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+namespace {
+
+class recording_processor : public wspc::processor
+{
+public:
+    std::string process_http(const std::string&) override { return {}; }
+
+    std::string process_message(wspc::connection_id,
+                                const std::string&) override
+    {
+        return {};
+    }
+
+    void process_open(wspc::connection_id id) override
+    {
+        opened.push_back(id);
+    }
+
+    void process_close(wspc::connection_id id) override
+    {
+        closed.push_back(id);
+    }
+
+    std::vector<wspc::connection_id> opened;
+    std::vector<wspc::connection_id> closed;
+};
+
+class stream_transport_test : public ::testing::Test
+{
+protected:
+    void TearDown() override { std::remove(path().c_str()); }
+
+    // Runs io_service till pred is satisfied (or a few seconds pass)
+    bool run_until(const std::function<bool()>& pred)
+    {
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds{5};
+        while (!pred())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+                return false;
+            io_service_.reset();
+            io_service_.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+        return true;
+    }
+
+    std::string path() const
+    {
+        return ::testing::TempDir() + "wspc_" +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+
+    boost::asio::local::stream_protocol::socket connect()
+    {
+        boost::asio::local::stream_protocol::socket socket{io_service_};
+        socket.connect(boost::asio::local::stream_protocol::endpoint{path()});
+        return socket;
+    }
+
+    boost::asio::io_service io_service_;
+    recording_processor processor_;
+};
+} // namespace anonymous
+
+TEST_F(stream_transport_test, close_notifies_processor)
+{
+    wspc::unix_transport transport{processor_, io_service_, path()};
+    auto a = connect();
+    auto b = connect();
+    ASSERT_TRUE(run_until([&] { return transport.num_clients() == 2; }));
+
+    transport.close();
+    EXPECT_EQ(0, transport.num_clients());
+    auto closed = processor_.closed;
+    std::sort(begin(closed), end(closed));
+    auto opened = processor_.opened;
+    std::sort(begin(opened), end(opened));
+    EXPECT_EQ(opened, closed);
+
+    // Not again when sessions notice their sockets are closed
+    io_service_.reset();
+    io_service_.poll();
+    EXPECT_EQ(2u, processor_.closed.size());
+}
+
+TEST_F(stream_transport_test, client_not_reading_is_closed)
+{
+    wspc::unix_transport transport{processor_, io_service_, path()};
+    transport.set_max_buffered_amount(256 * 1024);
+    auto socket = connect();
+    ASSERT_TRUE(run_until([&] { return transport.num_clients() == 1; }));
+
+    const auto id = processor_.opened.front();
+    const std::string payload(16 * 1024, 'x');
+    EXPECT_TRUE(run_until([&] {
+        // Fill socket buffers and then the queue
+        for (int i = 0; i < 64; ++i)
+            transport.send(id, payload);
+        return !processor_.closed.empty();
+    }));
+    EXPECT_EQ(1u, transport.num_buffer_overflows());
+    EXPECT_FALSE(transport.connected(id));
+}
+#endif
@@ -0,0 +1,117 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+#include "wspc/timer_wheel.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+class timer_wheel_test : public ::testing::Test
+{
+protected:
+    using clock_type = wspc::timer_wheel::clock_type;
+
+    clock_type::time_point at(std::uint64_t tick) const
+    {
+        return origin_ + static_cast<clock_type::rep>(tick) * tick_;
+    }
+
+    std::vector<std::uint64_t> advance_to(std::uint64_t tick)
+    {
+        std::vector<std::uint64_t> expired;
+        wheel_.advance(at(tick), expired);
+        return expired;
+    }
+
+    // Key is expected to fire exactly at given tick (not one earlier)
+    void expect_fires_at(std::uint64_t key, std::uint64_t tick)
+    {
+        EXPECT_TRUE(advance_to(tick - 1).empty()) << "key " << key;
+        EXPECT_EQ(std::vector<std::uint64_t>{key}, advance_to(tick))
+            << "key " << key;
+    }
+
+    const clock_type::duration tick_ = std::chrono::milliseconds{1};
+    const clock_type::time_point origin_ = clock_type::now();
+    wspc::timer_wheel wheel_{tick_, origin_};
+};
+} // namespace anonymous
+
+TEST_F(timer_wheel_test, fires_within_first_level)
+{
+    wheel_.schedule(at(5), 1);
+    // Rounded up, never fires early
+    wheel_.schedule(at(7) - tick_ / 2, 2);
+    EXPECT_EQ(2u, wheel_.size());
+
+    expect_fires_at(1, 5);
+    expect_fires_at(2, 7);
+    EXPECT_EQ(0u, wheel_.size());
+}
+
+TEST_F(timer_wheel_test, past_timeouts_fire_on_next_tick)
+{
+    advance_to(10);
+    wheel_.schedule(at(3), 1);
+    expect_fires_at(1, 11);
+}
+
+TEST_F(timer_wheel_test, cascades_from_higher_levels)
+{
+    // Spread over all levels, around slot boundaries
+    const std::uint64_t ticks[] = {63, 64, 100, 4095, 4096, 5000, 300001,
+                                   262144 * 3 + 77};
+    for (std::uint64_t key = 0; key < 8; ++key)
+        wheel_.schedule(at(ticks[key]), key);
+
+    for (std::uint64_t key = 0; key < 8; ++key)
+        expect_fires_at(key, ticks[key]);
+    EXPECT_EQ(0u, wheel_.size());
+}
+
+TEST_F(timer_wheel_test, cascades_when_scheduled_mid_slot)
+{
+    advance_to(127);
+    wheel_.schedule(at(127 + 4095), 1);
+    wheel_.schedule(at(127 + 70), 2);
+    expect_fires_at(2, 127 + 70);
+    expect_fires_at(1, 127 + 4095);
+}
+
+TEST_F(timer_wheel_test, parks_timeouts_beyond_last_level)
+{
+    const std::uint64_t far = (std::uint64_t{1} << 24) + 1000;
+    wheel_.schedule(at(far), 1);
+    expect_fires_at(1, far);
+}
+
+TEST_F(timer_wheel_test, empty_wheel_jumps_ahead)
+{
+    advance_to(1000000);
+    wheel_.schedule(at(1000000 + 3), 1);
+    expect_fires_at(1, 1000000 + 3);
+}
@@ -0,0 +1,677 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+// Drives a service with many concurrent WebSocket connections and reports
+// throughput and latency percentiles per procedure, plus broadcast delivery
+// lag.
+//
+// Requests arrive open-loop at a fixed rate, regardless of how fast the
+// service responds, and are spread round-robin over connections. Latency is
+// measured from the moment a request was scheduled to be sent (not when it
+// actually got sent), so a stalled service or a lagging load generator
+// doesn't hide queueing delay (coordinated omission). Requests still
+// unanswered 5 seconds after the test has ended are given up on and counted
+// at the latency they had by then.
+//
+// Events carry no send timestamp, so broadcast lag is measured from the
+// first connection that received given event to every other one.
+//
+// Usage: wspc_loadgen <uri> [options] <call>...
+//   -c connections  connections sending requests (default 100)
+//   -l listeners    extra connections which only receive events (default 0)
+//   -r rate         requests per second over all connections (default 1000)
+//   -d seconds      duration of the test (default 10)
+//   -t threads      client threads, each with own connections (default 1)
+//   call            method[:weight[:params]], e.g. add:3:[1,2]
+//                   (weight defaults to 1, params to [])
+//
+// Opening thousands of connections requires raising the limit of open file
+// descriptors (ulimit -n).
+
+#include "wspc/latency_stats.hpp"
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+#  define _WEBSOCKETPP_NOEXCEPT_
+#endif
+#define _WEBSOCKETPP_CPP11_CHRONO_
+#define _WEBSOCKETPP_CPP11_THREAD_
+#define _WEBSOCKETPP_CPP11_FUNCTIONAL_
+#define _WEBSOCKETPP_CPP11_SYSTEM_ERROR_
+#define _WEBSOCKETPP_CPP11_RANDOM_DEVICE_
+#define _WEBSOCKETPP_CPP11_MEMORY_
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <kl/json_convert.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using ws_client = websocketpp::client<websocketpp::config::asio_client>;
+using clock_type = std::chrono::steady_clock;
+
+struct call_spec
+{
+    std::string method;
+    double weight;
+    json11::Json params;
+};
+
+struct options
+{
+    std::string uri;
+    std::size_t connections{100};
+    std::size_t listeners{0};
+    double rate{1000};
+    std::chrono::seconds duration{10};
+    std::size_t threads{1};
+    std::vector<call_spec> calls;
+};
+
+struct method_stats
+{
+    // Includes requests left unanswered, at the latency they were given up
+    wspc::latency_stats latency;
+    std::size_t sent{0};
+    std::size_t answered{0};
+    std::size_t errors{0};
+};
+
+// Parses "method[:weight[:params]]"
+call_spec parse_call(const std::string& arg)
+{
+    call_spec call{arg, 1.0, json11::Json::array{}};
+    const auto weight_pos = arg.find(':');
+    if (weight_pos == std::string::npos)
+        return call;
+
+    call.method = arg.substr(0, weight_pos);
+    const auto params_pos = arg.find(':', weight_pos + 1);
+    call.weight = std::atof(
+        arg.substr(weight_pos + 1, params_pos - weight_pos - 1).c_str());
+    if (call.weight <= 0)
+        throw std::invalid_argument{"weight of '" + call.method +
+                                    "' must be positive"};
+    if (params_pos != std::string::npos)
+    {
+        std::string err;
+        call.params = json11::Json::parse(arg.substr(params_pos + 1), err);
+        if (!err.empty())
+            throw std::invalid_argument{"params of '" + call.method +
+                                        "': " + err};
+    }
+    return call;
+}
+
+// Events not received by every connection by then are forgotten (a
+// connection might have been closed or opened after the event was sent)
+const clock_type::duration event_expiry = std::chrono::seconds{10};
+
+// Shared by all workers: first receipt time of every event seen so far. An
+// event received again by the same connection is its next occurrence (events
+// without sequence number are identified by their payload).
+class broadcast_tracker
+{
+public:
+    // Called once connection gets opened, returns its index
+    std::size_t add_receiver()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return receivers_++;
+    }
+
+    void received(const std::string& key, std::size_t receiver,
+                  clock_type::time_point at)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        expire(at);
+
+        auto& occurrences = receipts_[key];
+        // Oldest occurrence the receiver hasn't got yet
+        auto it = std::find_if(
+            begin(occurrences), end(occurrences),
+            [receiver](const receipt& r) { return !r.seen(receiver); });
+        if (it == end(occurrences))
+        {
+            occurrences.emplace_back(at);
+            occurrences.back().mark(receiver);
+            order_.emplace_back(at, key);
+            lag_.add(std::chrono::nanoseconds::zero());
+            ++events_;
+            return;
+        }
+
+        lag_.add(at > it->at ? at - it->at : clock_type::duration::zero());
+        it->mark(receiver);
+        // Everyone got it, no need to remember it any longer
+        if (it->count == receivers_)
+        {
+            occurrences.erase(it);
+            if (occurrences.empty())
+                receipts_.erase(key);
+        }
+    }
+
+    std::size_t events() const { return events_; }
+    const wspc::latency_stats& lag() const { return lag_; }
+
+private:
+    struct receipt
+    {
+        explicit receipt(clock_type::time_point at) : at{at} {}
+
+        bool seen(std::size_t receiver) const
+        {
+            return receiver < receivers.size() && receivers[receiver];
+        }
+
+        void mark(std::size_t receiver)
+        {
+            if (receiver >= receivers.size())
+                receivers.resize(receiver + 1);
+            receivers[receiver] = true;
+            ++count;
+        }
+
+        clock_type::time_point at;
+        std::size_t count{0};
+        std::vector<bool> receivers;
+    };
+
+    // Requires mutex_ to be locked
+    void expire(clock_type::time_point now)
+    {
+        while (!order_.empty() && order_.front().first + event_expiry < now)
+        {
+            const auto& oldest = order_.front();
+            auto it = receipts_.find(oldest.second);
+            if (it != end(receipts_))
+            {
+                // Occurrences are kept in order of their first receipt
+                auto& occurrences = it->second;
+                while (!occurrences.empty() &&
+                       occurrences.front().at <= oldest.first)
+                {
+                    occurrences.pop_front();
+                }
+                if (occurrences.empty())
+                    receipts_.erase(it);
+            }
+            order_.pop_front();
+        }
+    }
+
+    std::mutex mutex_;
+    std::size_t receivers_{0};
+    std::unordered_map<std::string, std::deque<receipt>> receipts_;
+    // First receipts of all occurrences, oldest first
+    std::deque<std::pair<clock_type::time_point, std::string>> order_;
+    wspc::latency_stats lag_;
+    std::size_t events_{0};
+};
+
+// Owns a share of connections and of the request rate. Workers don't share
+// anything but the broadcast tracker, each runs its own io_service.
+class worker
+{
+public:
+    worker(const options& opts, std::size_t index, broadcast_tracker& tracker)
+        : opts_{opts},
+          tracker_{tracker},
+          interval_{std::chrono::duration_cast<clock_type::duration>(
+              std::chrono::duration<double>{opts.threads / opts.rate})},
+          random_{static_cast<std::mt19937::result_type>(index)},
+          stats_(opts.calls.size())
+    {
+        std::vector<double> weights;
+        for (const auto& call : opts_.calls)
+            weights.push_back(call.weight);
+        pick_ = std::discrete_distribution<std::size_t>{std::begin(weights),
+                                                        std::end(weights)};
+
+        client_.clear_access_channels(websocketpp::log::alevel::all);
+        client_.clear_error_channels(websocketpp::log::elevel::all);
+        client_.init_asio();
+        timer_ = std::make_unique<boost::asio::steady_timer>(
+            client_.get_io_service());
+
+        // Split connections evenly, first workers take the remainder
+        num_senders_ = share(opts_.connections, index);
+        const auto num_listeners = share(opts_.listeners, index);
+        for (std::size_t i = 0; i < num_senders_ + num_listeners; ++i)
+            connect();
+    }
+
+    void run()
+    {
+        if (hdls_.empty())
+            return;
+        client_.run();
+    }
+
+    std::size_t connected() const { return opened_; }
+    std::size_t failed() const { return failed_; }
+    std::size_t unanswered() const { return pending_.size(); }
+    const std::vector<method_stats>& stats() const { return stats_; }
+    clock_type::time_point start() const { return start_; }
+    clock_type::time_point end() const { return end_; }
+
+private:
+    std::size_t share(std::size_t total, std::size_t index) const
+    {
+        return total / opts_.threads + (index < total % opts_.threads ? 1 : 0);
+    }
+
+    void connect()
+    {
+        websocketpp::lib::error_code ec;
+        auto con = client_.get_connection(opts_.uri, ec);
+        if (ec)
+            throw std::runtime_error{ec.message()};
+
+        const auto index = hdls_.size();
+        hdls_.push_back(con->get_handle());
+        receiver_ids_.push_back(0);
+        con->set_open_handler([this, index](websocketpp::connection_hdl) {
+            receiver_ids_[index] = tracker_.add_receiver();
+            ++opened_;
+            connection_settled();
+        });
+        con->set_fail_handler([this](websocketpp::connection_hdl) {
+            ++failed_;
+            connection_settled();
+        });
+        con->set_message_handler([this, index](websocketpp::connection_hdl,
+                                               ws_client::message_ptr msg) {
+            on_message(receiver_ids_[index], msg->get_payload());
+        });
+        client_.connect(con);
+    }
+
+    void connection_settled()
+    {
+        if (opened_ + failed_ == hdls_.size())
+            start_sending();
+    }
+
+    void start_sending()
+    {
+        start_ = clock_type::now();
+        stop_at_ = start_ + opts_.duration;
+        next_at_ = start_;
+        if (opts_.calls.empty() || num_senders_ == 0)
+        {
+            // Listen for events only
+            timer_->expires_at(stop_at_);
+            timer_->async_wait([this](const boost::system::error_code& ec) {
+                if (!ec)
+                    finish_sending();
+            });
+            return;
+        }
+        send_due();
+    }
+
+    void send_due()
+    {
+        const auto now = clock_type::now();
+        // Catch up with everything that should've been sent by now
+        while (next_at_ <= now && next_at_ < stop_at_)
+        {
+            send(next_at_);
+            next_at_ += interval_;
+        }
+
+        if (next_at_ >= stop_at_)
+            return finish_sending();
+
+        timer_->expires_at(next_at_);
+        timer_->async_wait([this](const boost::system::error_code& ec) {
+            if (!ec)
+                send_due();
+        });
+    }
+
+    void send(clock_type::time_point scheduled_at)
+    {
+        const auto call_index = pick_(random_);
+        const auto& call = opts_.calls[call_index];
+        const auto id = next_id_++;
+        const auto hdl = hdls_[next_connection_++ % num_senders_];
+
+        websocketpp::lib::error_code ec;
+        client_.send(hdl,
+                     json11::Json{json11::Json::object{
+                                      {"method", call.method},
+                                      {"params", call.params},
+                                      {"id", static_cast<double>(id)}}}
+                         .dump(),
+                     websocketpp::frame::opcode::text, ec);
+
+        auto& stats = stats_[call_index];
+        ++stats.sent;
+        if (ec)
+        {
+            ++stats.errors;
+            return;
+        }
+        pending_.emplace(id, pending_request{call_index, scheduled_at});
+    }
+
+    void on_message(std::size_t receiver, const std::string& payload)
+    {
+        const auto now = clock_type::now();
+        std::string err;
+        const auto json = json11::Json::parse(payload, err);
+        if (!err.empty())
+            return;
+
+        // Broadcasts can be batched into one frame
+        if (json.is_array())
+        {
+            for (const auto& item : json.array_items())
+                on_item(receiver, item, item.dump(), now);
+        }
+        else
+        {
+            on_item(receiver, json, payload, now);
+        }
+    }
+
+    void on_item(std::size_t receiver, const json11::Json& item,
+                 const std::string& payload, clock_type::time_point now)
+    {
+        const auto& id = item["id"];
+        if (id.is_null())
+        {
+            if (!item["method"].is_string())
+                return;
+            // With event log enabled sequence number identifies an event
+            const auto& seq = item["seq"];
+            tracker_.received(seq.is_number()
+                                  ? item["method"].string_value() + '#' +
+                                        seq.dump()
+                                  : payload,
+                              receiver, now);
+            return;
+        }
+
+        // Only final results of streaming procedures are accounted for
+        if (!item["partial"].is_null())
+            return;
+
+        auto it = pending_.find(static_cast<std::uint64_t>(id.number_value()));
+        if (it == std::end(pending_))
+            return;
+
+        auto& stats = stats_[it->second.call_index];
+        if (!item["error"].is_null())
+        {
+            ++stats.errors;
+        }
+        else
+        {
+            ++stats.answered;
+            stats.latency.add(now - it->second.scheduled_at);
+        }
+        pending_.erase(it);
+        end_ = now;
+
+        if (done_sending_ && pending_.empty())
+            close();
+    }
+
+    void finish_sending()
+    {
+        done_sending_ = true;
+        end_ = clock_type::now();
+        if (pending_.empty())
+            return close();
+
+        // Give the service some time to respond to outstanding requests
+        timer_->expires_from_now(std::chrono::seconds{5});
+        timer_->async_wait([this](const boost::system::error_code& ec) {
+            if (!ec)
+                give_up();
+        });
+    }
+
+    // Requests still unanswered count as answered just now, otherwise the
+    // slowest ones wouldn't show up in percentiles at all
+    void give_up()
+    {
+        const auto now = clock_type::now();
+        for (const auto& kv : pending_)
+            stats_[kv.second.call_index].latency.add(now -
+                                                      kv.second.scheduled_at);
+        close();
+    }
+
+    void close()
+    {
+        timer_->cancel();
+        for (auto& hdl : hdls_)
+        {
+            websocketpp::lib::error_code ec;
+            client_.close(hdl, websocketpp::close::status::normal, "", ec);
+        }
+    }
+
+private:
+    struct pending_request
+    {
+        std::size_t call_index;
+        clock_type::time_point scheduled_at;
+    };
+
+    const options& opts_;
+    broadcast_tracker& tracker_;
+    const clock_type::duration interval_;
+    std::mt19937 random_;
+    std::discrete_distribution<std::size_t> pick_;
+
+    ws_client client_;
+    std::unique_ptr<boost::asio::steady_timer> timer_;
+    std::vector<websocketpp::connection_hdl> hdls_;
+    // Index of each connection in the broadcast tracker
+    std::vector<std::size_t> receiver_ids_;
+    std::size_t num_senders_{0};
+    std::size_t opened_{0};
+    std::size_t failed_{0};
+
+    clock_type::time_point start_;
+    clock_type::time_point stop_at_;
+    clock_type::time_point next_at_;
+    clock_type::time_point end_;
+    bool done_sending_{false};
+    std::uint64_t next_id_{1};
+    std::size_t next_connection_{0};
+    std::unordered_map<std::uint64_t, pending_request> pending_;
+    std::vector<method_stats> stats_;
+};
+
+options parse_options(int argc, char* argv[])
+{
+    if (argc < 2)
+        throw std::invalid_argument{"missing uri"};
+
+    options opts;
+    opts.uri = argv[1];
+    for (int i = 2; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg.size() == 2 && arg[0] == '-')
+        {
+            if (i + 1 >= argc)
+                throw std::invalid_argument{"missing value of " + arg};
+            const char* value = argv[++i];
+            switch (arg[1])
+            {
+            case 'c':
+                opts.connections = std::strtoul(value, nullptr, 10);
+                break;
+            case 'l':
+                opts.listeners = std::strtoul(value, nullptr, 10);
+                break;
+            case 'r':
+                opts.rate = std::atof(value);
+                break;
+            case 'd':
+                opts.duration = std::chrono::seconds{std::atoi(value)};
+                break;
+            case 't':
+                opts.threads = std::strtoul(value, nullptr, 10);
+                break;
+            default:
+                throw std::invalid_argument{"unknown option " + arg};
+            }
+        }
+        else
+        {
+            opts.calls.push_back(parse_call(arg));
+        }
+    }
+
+    if (opts.threads == 0)
+        throw std::invalid_argument{"at least one thread is required"};
+    if (!opts.calls.empty() && (opts.connections == 0 || opts.rate <= 0))
+        throw std::invalid_argument{"calls require connections and rate"};
+    if (opts.calls.empty() && opts.listeners == 0)
+        throw std::invalid_argument{"nothing to do - no calls nor listeners"};
+    return opts;
+}
+
+void report(const options& opts,
+            const std::vector<std::unique_ptr<worker>>& workers,
+            const broadcast_tracker& tracker)
+{
+    using seconds = std::chrono::duration<double>;
+
+    std::size_t connected = 0, failed = 0, unanswered = 0;
+    std::vector<method_stats> stats(opts.calls.size());
+    auto start = clock_type::time_point::max();
+    auto end = clock_type::time_point::min();
+    for (const auto& w : workers)
+    {
+        connected += w->connected();
+        failed += w->failed();
+        unanswered += w->unanswered();
+        // Worker without any connections never started
+        if (w->start() != clock_type::time_point{})
+        {
+            start = std::min(start, w->start());
+            end = std::max(end, w->end());
+        }
+        for (std::size_t i = 0; i < stats.size(); ++i)
+        {
+            stats[i].latency.merge(w->stats()[i].latency);
+            stats[i].sent += w->stats()[i].sent;
+            stats[i].answered += w->stats()[i].answered;
+            stats[i].errors += w->stats()[i].errors;
+        }
+    }
+    const auto elapsed =
+        start < end ? std::chrono::duration_cast<seconds>(end - start).count()
+                    : 0.0;
+
+    std::cout << "connections: " << connected << ", failed: " << failed
+              << ", unanswered: " << unanswered << ", elapsed: " << elapsed
+              << "s\n";
+
+    wspc::latency_stats total;
+    std::size_t total_answered = 0;
+    for (std::size_t i = 0; i < stats.size(); ++i)
+    {
+        const auto& s = stats[i];
+        total.merge(s.latency);
+        total_answered += s.answered;
+        std::cout << std::left << std::setw(16) << opts.calls[i].method
+                  << " sent: " << s.sent << ", errors: " << s.errors
+                  << ", throughput: "
+                  << (elapsed > 0 ? s.answered / elapsed : 0.0)
+                  << " msg/s, latency: " << s.latency << '\n';
+    }
+    if (stats.size() > 1)
+    {
+        std::cout << std::left << std::setw(16) << "(all)"
+                  << " throughput: "
+                  << (elapsed > 0 ? total_answered / elapsed : 0.0)
+                  << " msg/s, latency: " << total << '\n';
+    }
+    std::cout << "broadcast events: " << tracker.events()
+              << ", delivery lag: " << tracker.lag() << '\n';
+}
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        const auto opts = parse_options(argc, argv);
+        broadcast_tracker tracker;
+
+        std::vector<std::unique_ptr<worker>> workers;
+        for (std::size_t i = 0; i < opts.threads; ++i)
+            workers.push_back(std::make_unique<worker>(opts, i, tracker));
+
+        std::vector<std::thread> threads;
+        for (auto& w : workers)
+            threads.emplace_back([&w] { w->run(); });
+        for (auto& thread : threads)
+            thread.join();
+
+        report(opts, workers, tracker);
+    }
+    catch (std::invalid_argument& ex)
+    {
+        std::cerr << "error: " << ex.what() << "\nUsage: " << argv[0]
+                  << " <uri> [-c connections] [-l listeners] [-r rate]"
+                     " [-d seconds] [-t threads]"
+                     " <method[:weight[:params]]>...\n";
+        return EXIT_FAILURE;
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "error: " << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,137 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+// Hammers wspc::handler_registry with readers (find() and snapshots) running
+// concurrently with a writer which keeps replacing and removing handlers.
+// Meant to be built with a sanitizer (e.g. -DCMAKE_CXX_FLAGS=-fsanitize=thread
+// or -fsanitize=address): a table or a handler used after it's been freed is
+// reported by the sanitizer. Handlers found destroyed are counted as errors
+// regardless.
+//
+// Usage: wspc_registry_stress [seconds] [readers]
+
+#include "wspc/handler_registry.hpp"
+
+#include <kl/json_convert.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const std::uint32_t live_magic = 0x57535043;
+const char* names[] = {"a", "b", "c", "d"};
+const std::size_t num_names = sizeof(names) / sizeof(names[0]);
+
+// Knows whether it's been destroyed already
+class checked_handler : public wspc::service_handler
+{
+public:
+    ~checked_handler() override { magic_ = 0; }
+
+    json11::Json operator()(const json11::Json&) override
+    {
+        return static_cast<double>(magic_.load());
+    }
+
+    bool alive() const { return magic_ == live_magic; }
+
+private:
+    std::atomic<std::uint32_t> magic_{live_magic};
+};
+
+bool alive(const wspc::handler_registry::entry& e)
+{
+    return static_cast<const checked_handler&>(*e.handler).alive();
+}
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    const auto duration =
+        std::chrono::seconds{argc > 1 ? std::atoi(argv[1]) : 5};
+    const std::size_t num_readers =
+        argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4;
+
+    wspc::handler_registry registry;
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> lookups{0}, errors{0};
+
+    std::vector<std::thread> readers;
+    for (std::size_t i = 0; i < num_readers; ++i)
+    {
+        readers.emplace_back([&, i] {
+            std::uint64_t n = 0;
+            while (!stop)
+            {
+                // Keeps the handler alive even if it's removed meanwhile
+                const auto e = registry.find(names[n++ % num_names]);
+                if (e.handler && !alive(e))
+                    ++errors;
+
+                // Every other reader iterates whole tables as well
+                if (i % 2 == 0)
+                {
+                    wspc::handler_registry::snapshot snapshot{registry};
+                    for (const auto& kv : *snapshot)
+                    {
+                        if (!alive(kv.second))
+                            ++errors;
+                    }
+                }
+            }
+            lookups += n;
+        });
+    }
+
+    std::uint64_t changes = 0;
+    const auto deadline = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        const auto name = names[changes % num_names];
+        if (changes % 3 == 2)
+        {
+            registry.erase(name);
+        }
+        else
+        {
+            registry.insert(name, {std::make_shared<checked_handler>(),
+                                   wspc::handler_priority::normal});
+        }
+        ++changes;
+    }
+
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    std::cout << "changes: " << changes << ", lookups: " << lookups
+              << ", errors: " << errors << '\n';
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,290 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+// Replays traffic recorded with wspc::service::capture() against a running
+// service over WebSocket connections (one per recorded connection) and reports
+// throughput and latency percentiles. Latency is measured from the moment a
+// request was scheduled to be sent, so a stalled service doesn't hide its
+// queueing delay.
+//
+// Usage: wspc_replay <capture-file> <uri> [speed]
+//   speed - 1 replays with original timing (default), 2 twice as fast, etc.
+//           and 0 sends everything as fast as possible
+//
+// To replay a capture without any networking (CPU only) link your service
+// with wspc and call wspc::replay(service, capture_file).
+
+#include "wspc/capture.hpp"
+#include "wspc/latency_stats.hpp"
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+#  define _WEBSOCKETPP_NOEXCEPT_
+#endif
+#define _WEBSOCKETPP_CPP11_CHRONO_
+#define _WEBSOCKETPP_CPP11_THREAD_
+#define _WEBSOCKETPP_CPP11_FUNCTIONAL_
+#define _WEBSOCKETPP_CPP11_SYSTEM_ERROR_
+#define _WEBSOCKETPP_CPP11_RANDOM_DEVICE_
+#define _WEBSOCKETPP_CPP11_MEMORY_
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+
+#include <boost/asio/steady_timer.hpp>
+
+#include <kl/json_convert.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using ws_client = websocketpp::client<websocketpp::config::asio_client>;
+using clock_type = std::chrono::steady_clock;
+
+class replayer
+{
+public:
+    replayer(std::vector<wspc::capture_record> records, const std::string& uri,
+             double speed)
+        : records_{std::move(records)}, speed_{speed}
+    {
+        client_.clear_access_channels(websocketpp::log::alevel::all);
+        client_.clear_error_channels(websocketpp::log::elevel::all);
+        client_.init_asio();
+        timer_ = std::make_unique<boost::asio::steady_timer>(
+            client_.get_io_service());
+
+        for (const auto& record : records_)
+        {
+            if (connections_.count(record.connection))
+                continue;
+
+            websocketpp::lib::error_code ec;
+            auto con = client_.get_connection(uri, ec);
+            if (ec)
+                throw std::runtime_error{ec.message()};
+
+            const auto index = connections_.size();
+            connections_.emplace(record.connection, index);
+            hdls_.push_back(con->get_handle());
+
+            con->set_open_handler([this](websocketpp::connection_hdl) {
+                if (++opened_ == connections_.size())
+                    start();
+            });
+            con->set_fail_handler([](websocketpp::connection_hdl) {
+                throw std::runtime_error{"couldn't connect to the service"};
+            });
+            con->set_message_handler(
+                [this, index](websocketpp::connection_hdl,
+                              ws_client::message_ptr msg) {
+                    on_response(index, msg->get_payload());
+                });
+            client_.connect(con);
+        }
+    }
+
+    void run()
+    {
+        if (records_.empty())
+            return;
+        client_.run();
+        report();
+    }
+
+private:
+    void start()
+    {
+        start_ = clock_type::now();
+        send_next();
+    }
+
+    clock_type::time_point scheduled_at(const wspc::capture_record& record)
+    {
+        if (speed_ <= 0)
+            return start_;
+        const auto offset = std::chrono::nanoseconds{
+            static_cast<std::int64_t>((record.timestamp -
+                                       records_.front().timestamp) /
+                                      speed_)};
+        return start_ + offset;
+    }
+
+    void send_next()
+    {
+        const auto now = clock_type::now();
+        while (next_ < records_.size() &&
+               scheduled_at(records_[next_]) <= now)
+        {
+            send(records_[next_]);
+            ++next_;
+        }
+
+        if (next_ < records_.size())
+        {
+            timer_->expires_at(scheduled_at(records_[next_]));
+            timer_->async_wait([this](const boost::system::error_code& ec) {
+                if (!ec)
+                    send_next();
+            });
+        }
+        else
+        {
+            finish_sending();
+        }
+    }
+
+    void send(const wspc::capture_record& record)
+    {
+        const auto index = connections_.at(record.connection);
+
+        std::string err;
+        const auto json = json11::Json::parse(record.payload, err);
+        // Only requests with an id get a response
+        if (err.empty() && !json["id"].is_null())
+        {
+            pending_.emplace(std::make_pair(index, json["id"].dump()),
+                             scheduled_at(record));
+        }
+
+        websocketpp::lib::error_code ec;
+        client_.send(hdls_[index], record.payload,
+                     websocketpp::frame::opcode::text, ec);
+        if (!ec)
+            ++sent_;
+    }
+
+    void on_response(std::size_t index, const std::string& payload)
+    {
+        std::string err;
+        const auto json = json11::Json::parse(payload, err);
+        if (!err.empty() || json["id"].is_null())
+            return;
+
+        auto it = pending_.find(std::make_pair(index, json["id"].dump()));
+        if (it == end(pending_))
+            return;
+        latency_.add(clock_type::now() - it->second);
+        pending_.erase(it);
+        end_ = clock_type::now();
+
+        if (next_ == records_.size() && pending_.empty())
+            close();
+    }
+
+    void finish_sending()
+    {
+        end_ = clock_type::now();
+        if (pending_.empty())
+        {
+            close();
+            return;
+        }
+
+        // Give the service some time to respond to outstanding requests
+        timer_->expires_from_now(std::chrono::seconds{5});
+        timer_->async_wait([this](const boost::system::error_code& ec) {
+            if (!ec)
+                close();
+        });
+    }
+
+    void close()
+    {
+        timer_->cancel();
+        for (auto& hdl : hdls_)
+        {
+            websocketpp::lib::error_code ec;
+            client_.close(hdl, websocketpp::close::status::normal, "", ec);
+        }
+    }
+
+    void report()
+    {
+        using seconds = std::chrono::duration<double>;
+        const auto elapsed =
+            std::chrono::duration_cast<seconds>(end_ - start_).count();
+
+        std::cout << "connections: " << connections_.size()
+                  << ", sent: " << sent_
+                  << ", answered: " << latency_.count()
+                  << ", unanswered: " << pending_.size() << '\n';
+        std::cout << "elapsed: " << elapsed << "s, throughput: "
+                  << (elapsed > 0 ? sent_ / elapsed : 0.0) << " msg/s\n";
+        std::cout << "latency: " << latency_ << '\n';
+    }
+
+private:
+    std::vector<wspc::capture_record> records_;
+    double speed_;
+
+    ws_client client_;
+    std::unique_ptr<boost::asio::steady_timer> timer_;
+    // Recorded connection id -> index of replaying connection
+    std::unordered_map<wspc::connection_id, std::size_t> connections_;
+    std::vector<websocketpp::connection_hdl> hdls_;
+    std::size_t opened_{0};
+
+    std::size_t next_{0};
+    std::size_t sent_{0};
+    std::map<std::pair<std::size_t, std::string>, clock_type::time_point>
+        pending_;
+    wspc::latency_stats latency_;
+    clock_type::time_point start_;
+    clock_type::time_point end_;
+};
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <capture-file> <uri> [speed]\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        std::vector<wspc::capture_record> records;
+        wspc::capture_reader reader{argv[1]};
+        wspc::capture_record record;
+        while (reader.next(record))
+            records.push_back(record);
+
+        const double speed = argc > 3 ? std::atof(argv[3]) : 1.0;
+        replayer{std::move(records), argv[2], speed}.run();
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "error: " << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}
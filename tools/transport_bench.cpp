@@ -0,0 +1,199 @@
+/*
+ *  Copyright (c) 2016 Kajetan Swierk
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to
+ *  deal in the Software without restriction, including without limitation the
+ *  rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ *  sell copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM,OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ *  IN THE SOFTWARE.
+ */
+
+// Measures round-trip latency of a trivial "echo" procedure over every
+// transport wspc provides: WebSocket, length-prefixed TCP and Unix domain
+// socket. Service and clients run in the same process on separate threads,
+// one request in flight at a time.
+//
+// Usage: wspc_transport_bench [iterations] [payload-size]
+
+#include "wspc/latency_stats.hpp"
+#include "wspc/service.hpp"
+#include "wspc/stream_transport.hpp"
+#include "wspc/typed_service_handler.hpp"
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1900
+#  define _WEBSOCKETPP_NOEXCEPT_
+#endif
+#define _WEBSOCKETPP_CPP11_CHRONO_
+#define _WEBSOCKETPP_CPP11_THREAD_
+#define _WEBSOCKETPP_CPP11_FUNCTIONAL_
+#define _WEBSOCKETPP_CPP11_SYSTEM_ERROR_
+#define _WEBSOCKETPP_CPP11_RANDOM_DEVICE_
+#define _WEBSOCKETPP_CPP11_MEMORY_
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+using ws_client = websocketpp::client<websocketpp::config::asio_client>;
+using clock_type = std::chrono::steady_clock;
+
+const std::uint16_t ws_port = 9301;
+const std::uint16_t tcp_port = 9302;
+const char* unix_path = "/tmp/wspc_transport_bench.sock";
+
+std::string make_request(std::size_t payload_size)
+{
+    return json11::Json{json11::Json::object{
+                            {"method", "echo"},
+                            {"params", json11::Json::array{
+                                           std::string(payload_size, 'x')}},
+                            {"id", 1}}}
+        .dump();
+}
+
+template <typename Socket>
+wspc::latency_stats bench_stream(Socket& socket, const std::string& request,
+                                 std::size_t iterations)
+{
+    const auto size = static_cast<std::uint32_t>(request.size());
+    std::string frame{static_cast<char>((size >> 24) & 0xff),
+                      static_cast<char>((size >> 16) & 0xff),
+                      static_cast<char>((size >> 8) & 0xff),
+                      static_cast<char>(size & 0xff)};
+    frame += request;
+
+    wspc::latency_stats stats;
+    std::array<unsigned char, 4> header;
+    std::string response;
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        const auto start = clock_type::now();
+        boost::asio::write(socket, boost::asio::buffer(frame));
+        boost::asio::read(socket, boost::asio::buffer(header));
+        response.resize((std::size_t{header[0]} << 24) |
+                        (std::size_t{header[1]} << 16) |
+                        (std::size_t{header[2]} << 8) | header[3]);
+        boost::asio::read(socket,
+                          boost::asio::buffer(&response[0], response.size()));
+        stats.add(clock_type::now() - start);
+    }
+    return stats;
+}
+
+wspc::latency_stats bench_websocket(const std::string& request,
+                                    std::size_t iterations)
+{
+    ws_client client;
+    client.clear_access_channels(websocketpp::log::alevel::all);
+    client.clear_error_channels(websocketpp::log::elevel::all);
+    client.init_asio();
+
+    websocketpp::lib::error_code ec;
+    auto con = client.get_connection(
+        "ws://localhost:" + std::to_string(ws_port), ec);
+    if (ec)
+        throw std::runtime_error{ec.message()};
+
+    wspc::latency_stats stats;
+    std::size_t received = 0;
+    clock_type::time_point start;
+    auto send = [&](websocketpp::connection_hdl hdl) {
+        start = clock_type::now();
+        client.send(hdl, request, websocketpp::frame::opcode::text);
+    };
+
+    con->set_open_handler(send);
+    con->set_fail_handler([](websocketpp::connection_hdl) {
+        throw std::runtime_error{"couldn't connect to the service"};
+    });
+    con->set_message_handler(
+        [&](websocketpp::connection_hdl hdl, ws_client::message_ptr) {
+            stats.add(clock_type::now() - start);
+            if (++received < iterations)
+                return send(hdl);
+            client.close(hdl, websocketpp::close::status::normal, "");
+        });
+    client.connect(con);
+    client.run();
+    return stats;
+}
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    const std::size_t iterations = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const std::size_t payload_size = argc > 2 ? std::atoi(argv[2]) : 16;
+
+    try
+    {
+        boost::asio::io_service io_service;
+        wspc::service service{io_service, ws_port};
+        service.register_handler(
+            "echo",
+            wspc::make_service_handler([](std::string s) { return s; }));
+        service.add_transport<wspc::tcp_transport>(tcp_port);
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        service.add_transport<wspc::unix_transport>(unix_path);
+#endif
+        boost::asio::io_service::work work{io_service};
+        std::thread service_thread{[&] { io_service.run(); }};
+
+        const auto request = make_request(payload_size);
+        std::cout << "websocket: " << bench_websocket(request, iterations)
+                  << '\n';
+        {
+            using boost::asio::ip::tcp;
+            tcp::socket socket{io_service};
+            socket.connect(tcp::endpoint{
+                boost::asio::ip::address::from_string("::1"), tcp_port});
+            socket.set_option(tcp::no_delay{true});
+            std::cout << "tcp:       "
+                      << bench_stream(socket, request, iterations) << '\n';
+        }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        {
+            using boost::asio::local::stream_protocol;
+            stream_protocol::socket socket{io_service};
+            socket.connect(stream_protocol::endpoint{unix_path});
+            std::cout << "unix:      "
+                      << bench_stream(socket, request, iterations) << '\n';
+        }
+#endif
+
+        io_service.stop();
+        service_thread.join();
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "error: " << ex.what() << '\n';
+        return EXIT_FAILURE;
+    }
+}